@@ -1,118 +1,366 @@
-/*
- * Copyright (c) 1996 Westinghouse Electric Corporation
- * All Rights Reserved
- * Westinghouse Proprietary - Class 2
- * Description: LPWB Floating Menu Definition
- * History: 5/96 Elliott W. Jackson Initial version
- */
-
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <stdarg.h>
-
-#include "trace.h"
-
-void trace(int condition, char *group, int level, char *format, ...)
-{
-    static char *grpenv = NULL;
-    static char *levenv = NULL;
-
-    char *onlyenv = NULL;
-    static int onlyflag = 0;
-
-    static int checked = 0;
-
-    int tracelevel;
-    va_list arg_list;
-
-
-    /* get the TRACEGROUP's from the environment */
-    /* get the TRACELEVEL from the environment */
-    /* get the TRACEONLY from the environment */
-    /* only do this once, since the call to getenv() is relatively expenensive */
-    if (!checked) 
-    {
-        checked = 1;
-
-        grpenv = getenv("TRACEGROUP");
-        levenv = getenv("TRACELEVEL");
-        onlyenv = getenv("TRACEONLY");
-
-        if (onlyenv) 
-        {
-            if (0 == strcmp(onlyenv, "TRUE")) 
-            {
-                onlyflag = 1;
-            }
-        }
-    }
-
-    /* are all the pointers non-null? */
-    if (group && grpenv && levenv) 
-    {
-        /* only print if condition is true */
-        if (condition) 
-        {
-            /* is our group contained in the list? */
-            if (strstr(grpenv, group) || strstr(grpenv, "ALL")) 
-            {
-                /* is our level less or equal to the tracelevel? */
-                tracelevel = atoi(levenv);
-                if ( (onlyflag && (level == tracelevel)) || (!onlyflag && (level <= tracelevel)) )
-                {
-                    /* print! */
-                    va_start(arg_list, format);
-                    fprintf(stderr, "Trace: [%s, %d] ", group, level);
-                    vfprintf(stderr, format, arg_list);
-                    fprintf(stderr, "\n");
-                    va_end(arg_list);
-                }
-            }
-        }
-    }
-}
-
-
-
-#define TESTTRACE
-#ifdef TESTTRACE
-
-
-int main()
-{
-    int i;
-
-
-    for (i = 0; i < 10; ++i) 
-    {
-        trace(1, "Us", i, "Got Here, level %d!", i);
-
-    }
-
-
-    trace(1, "Us", 3, "Got Here, level 3!");
-    trace(1, "Us", 4, "Got Here, level 4!");
-
-    trace((1 < 2), "Us", 4, "Conditional, should print");
-    trace((3 < 2), "Us", 4, "Conditional, shouldn't print");
-
-
-    trace(1, "Them", 4, "Got Here, level %d", 4);
-
-
-
-
-
-
-
-    return 0;
-}
-
-
-
-#endif
-
-
-
+/*
+ * Copyright (c) 1996 Westinghouse Electric Corporation
+ * All Rights Reserved
+ * Westinghouse Proprietary - Class 2
+ * Description: LPWB Floating Menu Definition
+ * History: 5/96 Elliott W. Jackson Initial version
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+
+/*
+    the C++ Tracer's output, if it is linked into the same program.  When
+    its asynchronous writer is running, a line handed to it goes through the
+    same ring as Tracer lines, so the two come out in order.  Returns 0 if
+    the line should be written here instead
+*/
+extern int tracer_send_line(const char *data, int length) __attribute__((__weak__));
+
+
+/* one entry in the TRACEGROUP list */
+struct trace_group
+{
+    const char *name;
+    int level;
+};
+
+
+/* the settings, read from the environment once by trace_configure() */
+static struct trace_group *groups = NULL;
+static int groupcount = 0;
+static int allflag = 0;             /* TRACEGROUP contains ALL */
+static int alllevel = 0;            /* level for groups enabled only by ALL */
+static int onlyflag = 0;
+
+static pthread_once_t configured = PTHREAD_ONCE_INIT;
+
+
+/*
+    read TRACEGROUP, TRACELEVEL and TRACEONLY, and tokenize the group list.
+    Only done once, since the call to getenv() is relatively expensive
+*/
+static void trace_configure(void)
+{
+    char *grpenv = getenv("TRACEGROUP");
+    char *levenv = getenv("TRACELEVEL");
+    char *onlyenv = getenv("TRACEONLY");
+    int tracelevel = 0;
+    char *copy;
+    char *token;
+    char *next;
+    int n;
+
+
+    if (levenv)
+    {
+        tracelevel = atoi(levenv);
+    }
+
+    if (onlyenv)
+    {
+        if ( (0 == strcmp(onlyenv, "TRUE")) || (0 == strcmp(onlyenv, "true")) || (0 == strcmp(onlyenv, "True")) )
+        {
+            onlyflag = 1;
+        }
+    }
+
+    if (!grpenv)
+    {
+        return;
+    }
+
+    /* one entry per comma separated name, as "Name" or "Name:level" */
+    copy = strdup(grpenv);
+    if (!copy)
+    {
+        return;
+    }
+
+    n = 1;
+    for (token = copy; *token; ++token)
+    {
+        if (*token == ',')
+        {
+            ++n;
+        }
+    }
+
+    groups = (struct trace_group *)malloc(n * sizeof(struct trace_group));
+    if (!groups)
+    {
+        return;
+    }
+
+    for (token = copy; token; token = next)
+    {
+        char *colon;
+        char *end;
+        int level = tracelevel;
+
+        next = strchr(token, ',');
+        if (next)
+        {
+            *next++ = 0;
+        }
+
+        /* the level follows the last colon, as in the C++ Tracer */
+        colon = strrchr(token, ':');
+        if (colon)
+        {
+            *colon = 0;
+            level = atoi(colon + 1);
+        }
+
+        /* trim white space from around the name */
+        while ( (*token == ' ') || (*token == '\t') )
+        {
+            ++token;
+        }
+        end = token + strlen(token);
+        while ( (end > token) && ((end[-1] == ' ') || (end[-1] == '\t')) )
+        {
+            *--end = 0;
+        }
+        if (!*token)
+        {
+            continue;
+        }
+
+        if (0 == strcmp(token, "ALL"))
+        {
+            allflag = 1;
+            alllevel = level;
+            continue;
+        }
+
+        groups[groupcount].name = token;
+        groups[groupcount].level = level;
+        ++groupcount;
+    }
+}
+
+
+/*
+    does the passed group and level compare favorably to the TRACExx
+    environment variables?
+*/
+static int trace_enabled(const char *group, int level)
+{
+    int threshold;
+    int i;
+
+
+    pthread_once(&configured, trace_configure);
+
+    if (!group)
+    {
+        return 0;
+    }
+
+    /* is our group in the list, or is the list set to "ALL"? */
+    for (i = 0; i < groupcount; ++i)
+    {
+        if ( (groups[i].name[0] == group[0]) && (0 == strcmp(groups[i].name, group)) )
+        {
+            break;
+        }
+    }
+
+    if (i < groupcount)
+    {
+        threshold = groups[i].level;
+    }
+    else if (allflag)
+    {
+        threshold = alllevel;
+    }
+    else
+    {
+        return 0;
+    }
+
+    /* is our level less or equal to (or exactly) the level for the group? */
+    return (onlyflag && (level == threshold)) || (!onlyflag && (level <= threshold));
+}
+
+
+/*
+    format one line and write it out.  The whole line goes out in one
+    write(), so lines are not broken up by other output to stderr, or in
+    one slot of the C++ Tracer's ring, when that is in use
+*/
+static void trace_write(const char *group, int level, const char *format, va_list arg_list)
+{
+    char line[1024];
+    char *buffer = line;
+    int size = sizeof(line);
+    int prefix;
+    int length;
+    char *data;
+    va_list copy;
+
+
+    prefix = snprintf(line, sizeof(line), "Trace: [%s, %d] ", group, level);
+    if (prefix < 0)
+    {
+        return;
+    }
+    if (prefix >= size - 1)
+    {
+        prefix = size - 2;
+    }
+
+    va_copy(copy, arg_list);
+    length = vsnprintf(line + prefix, size - prefix, format, copy);
+    va_end(copy);
+    if (length < 0)
+    {
+        length = 0;
+    }
+
+    /* most lines fit on the stack; a longer one is formatted again */
+    if (prefix + length + 1 > size)
+    {
+        size = prefix + length + 2;
+        buffer = (char *)malloc(size);
+        if (buffer)
+        {
+            memcpy(buffer, line, prefix);
+            vsnprintf(buffer + prefix, size - prefix, format, arg_list);
+        }
+        else
+        {
+            buffer = line;
+            size = sizeof(line);
+            length = size - 1 - prefix;
+        }
+    }
+
+    length += prefix;
+    buffer[length++] = '\n';
+
+    data = buffer;
+    if (tracer_send_line && tracer_send_line(data, length))
+    {
+        length = 0;
+    }
+
+    while (length > 0)
+    {
+        ssize_t n = write(2, data, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        data += n;
+        length -= (int)n;
+    }
+
+    if (buffer != line)
+    {
+        free(buffer);
+    }
+}
+
+
+void trace(int condition, char *group, int level, char *format, ...)
+{
+    va_list arg_list;
+
+
+    /* only print if condition is true */
+    if (condition && trace_enabled(group, level))
+    {
+        /* print! */
+        va_start(arg_list, format);
+        trace_write(group, level, format, arg_list);
+        va_end(arg_list);
+    }
+}
+
+
+void trace_at(trace_site *site, const char *format, ...)
+{
+    int state = __atomic_load_n(&site->state, __ATOMIC_ACQUIRE);
+    va_list arg_list;
+
+
+    /* the first time a site is reached, decide for good.  Any thread may get
+       here first, and all of them decide the same way */
+    if (state == TRACE_SITE_UNCHECKED)
+    {
+        state = trace_enabled(site->group, site->level) ? TRACE_SITE_ENABLED : TRACE_SITE_DISABLED;
+        __atomic_store_n(&site->state, state, __ATOMIC_RELEASE);
+    }
+
+    if (state == TRACE_SITE_ENABLED)
+    {
+        va_start(arg_list, format);
+        trace_write(site->group, site->level, format, arg_list);
+        va_end(arg_list);
+    }
+}
+
+
+
+#define TESTTRACE
+#ifdef TESTTRACE
+
+
+int main()
+{
+    int i;
+
+
+    for (i = 0; i < 10; ++i)
+    {
+        trace(1, "Us", i, "Got Here, level %d!", i);
+
+    }
+
+
+    trace(1, "Us", 3, "Got Here, level 3!");
+    trace(1, "Us", 4, "Got Here, level 4!");
+
+    trace((1 < 2), "Us", 4, "Conditional, should print");
+    trace((3 < 2), "Us", 4, "Conditional, shouldn't print");
+
+
+    trace(1, "Them", 4, "Got Here, level %d", 4);
+
+
+    for (i = 0; i < 10; ++i)
+    {
+        TRACE(1, "Us", 4, "Fast path, level 4, pass %d", i);
+        TRACE(1, "Us", 12, "Fast path, level 12, pass %d", i);
+    }
+
+    TRACE((3 < 2), "Us", 4, "Fast path conditional, shouldn't print");
+
+
+
+
+    return 0;
+}
+
+
+
+#endif
+
+
+
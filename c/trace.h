@@ -1,57 +1,111 @@
-
-#ifndef __TRACE_H
-#define __TRACE_H
-
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-
-
-/*
-    trace()
-
-    Outputs a message to stderr if 
-
-        - the passed parameter 'condition' is true, and
-        - the passed parameter 'group' is contained in the TRACEGROUP
-          environment variable, and
-        - the passed parameter 'level' compares "favorably" to the
-          value contained in the TRACELEVEL environment variable
-
-    The phrase "favorably" in the above discussion is in quotes because it
-    can be controlled at runtime.  The default behavior is 'less than or
-    equal to', but it can be changed to 'is exactly equal to' if the 
-    environment variable TRACEONLY is set to the string "TRUE".  This is 
-    useful when it is desired to use the trace function as a debugging
-    tool inside a specific function, without seeing any other trace output.
-
-    Output is similar to printf, using the format string and a variable
-    number of additional parameters.
-
-    Environment variable summary:
-
-        The TRACEGROUP variable will be able to contain more than 1 group,
-        with desired groups separated with a comma.  
-
-        The TRACELEVEL variable will represent the maximum (or exact) trace
-        level which should be printed.
-
-        The TRACEONLY variable will control whether the TRACELEVEL is used
-        as a maximum trace level or an exact trace level.
-
-    Example of environment variable use in the C shell:
-
-        setenv TRACEGROUP CXMT,AWB
-        setenv TRACELEVEL 20
-        setenv TRACEONLY TRUE
-*/
-void trace(int condition, char *group, int level, char *format, ...);
-
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif /* __TRACE_H */
+#ifndef __TRACE_H
+#define __TRACE_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/*
+    trace()
+
+    Outputs a message to stderr if
+
+        - the passed parameter 'condition' is true, and
+        - the passed parameter 'group' is listed in the TRACEGROUP
+          environment variable, or TRACEGROUP contains ALL, and
+        - the passed parameter 'level' compares "favorably" to the
+          value contained in the TRACELEVEL environment variable
+
+    The phrase "favorably" in the above discussion is in quotes because it
+    can be controlled at runtime.  The default behavior is 'less than or
+    equal to', but it can be changed to 'is exactly equal to' if the
+    environment variable TRACEONLY is set to "TRUE", "true" or "True".  This is
+    useful when it is desired to use the trace function as a debugging
+    tool inside a specific function, without seeing any other trace output.
+
+    Output is similar to printf, using the format string and a variable
+    number of additional parameters.  Each message goes out in a single
+    write(), so lines from several threads, or from the C++ Tracer in the
+    same process, are never broken up:
+
+        Trace: [CXMT, 5] Got Here, level 5!
+
+    If the C++ Tracer is linked into the same program, and its asynchronous
+    writer is running, lines go through its ring instead, so they keep
+    their order with the Tracer lines around them.
+
+    Environment variable summary:
+
+        The TRACEGROUP variable will be able to contain more than 1 group,
+        with desired groups separated with a comma.  Group names are
+        trimmed of white space and matched exactly, and each may carry its
+        own level, which overrides TRACELEVEL for that group only, as in
+        the C++ Tracer.
+
+        The TRACELEVEL variable will represent the maximum (or exact) trace
+        level which should be printed.  If it is not set, the level is 0.
+
+        The TRACEONLY variable will control whether the TRACELEVEL is used
+        as a maximum trace level or an exact trace level.
+
+    The environment is read once, by whichever thread traces first; any
+    other thread arriving meanwhile waits until it is done.
+
+    Example of environment variable use in the C shell:
+
+        setenv TRACEGROUP CXMT,AWB:10
+        setenv TRACELEVEL 20
+        setenv TRACEONLY TRUE
+*/
+void trace(int condition, char *group, int level, char *format, ...);
+
+
+
+/*
+    TRACE()
+
+    The fast path, for trace calls in tight loops:
+
+        TRACE(1, "CXMT", 5, "Got Here, level %d!", 5);
+
+    Each call site keeps its enable decision in a static trace_site, made
+    the first time the site is reached.  After that, a disabled call costs
+    one load and compare, and neither 'condition' nor the message arguments
+    are evaluated.  'group' must be a string literal, and 'level' a
+    constant, since they are used to initialize the static.
+*/
+#define TRACE_SITE_UNCHECKED    0       /* decision not made yet */
+#define TRACE_SITE_DISABLED     1       /* never prints */
+#define TRACE_SITE_ENABLED      2       /* prints if its condition is true */
+
+typedef struct trace_site
+{
+    const char *group;                  /* group for this call site */
+    int level;                          /* trace level for this call site */
+    int state;                          /* cached decision, TRACE_SITE_xxx */
+} trace_site;
+
+#define TRACE(condition, group, level, ...)                                                     \
+    do {                                                                                        \
+        static trace_site trace_site_ = { group, level, TRACE_SITE_UNCHECKED };                 \
+        if ( (__atomic_load_n(&trace_site_.state, __ATOMIC_ACQUIRE) != TRACE_SITE_DISABLED) &&  \
+             (condition) )                                                                      \
+            trace_at(&trace_site_, __VA_ARGS__);                                                \
+    } while (0)
+
+/* used by TRACE(); makes the site's decision if needed, then prints */
+void trace_at(trace_site *site, const char *format, ...)
+#ifdef __GNUC__
+    __attribute__((__format__(__printf__, 2, 3)))
+#endif
+    ;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H */
@@ -1,255 +1,740 @@
-#include "Tracer.h"
-
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <stdarg.h>
-
-
-//
-// init static variables
-//
-char*       Tracer::grpenv      = 0;
-int         Tracer::tracelevel  = 0;
-bool        Tracer::onlyflag    = false;
-bool        Tracer::envchecked  = false;
-unsigned    Tracer::tracecount  = 0;
-
-
-//
-// ctor
-//
-// print a message to stderr if the passed 'condition' variable
-// is non-zero, and if this Tracer object SHOULD be printing, based
-// on the TRACExx environment varialbes
-//
-Tracer::Tracer(bool condition, char *aGroup, int aLevel, char *format, ...)
-    : group(0), level(aLevel), serial(0), usecount(0)
-{
-    // variable arg list
-    va_list arg_list;
-
-    // copy the group
-    if (aGroup)
-    {
-        group = new char[strlen(aGroup) + 1];
-        strcpy(group, aGroup);
-    }
-
-    // only do this once, since the call to getenv() is relatively expenensive
-    if (!envchecked)
-    {
-        envchecked = true;
-        CheckEnvironment();
-    }
-
-    // are all the pointers non-null
-    if (group && grpenv)
-    {
-        // is our group contained in the list, or is the environment variable set to "ALL"?
-        if (strstr(grpenv, group) || strstr(grpenv, "ALL"))
-        {
-            // is our level less or equal to the tracelevel environment variable?
-            if ( (onlyflag && (level == tracelevel)) || (!onlyflag && (level <= tracelevel)) )
-            {
-                // a non-zero value for 'serial' not only uniquely identifies this tracer,
-                // but also doubles as a flag to indicate that this Tracer SHOULD print
-                // the tracecount variable is a static class value
-                serial = ++tracecount;
-
-                // is the 'condition' variable non-zero?
-                if (condition)
-                {
-                    // print!
-                    va_start(arg_list, format);
-                    fprintf(stderr, "Tracer: [%d][%s, %d] ", serial, group, level);
-                    vfprintf(stderr, format, arg_list);
-                    fprintf(stderr, "\n");
-                    va_end(arg_list);
-                }
-            }
-        }
-    }
-}
-
-
-//
-// dtor
-//
-Tracer::~Tracer()
-{
-    // print a closing message, if the serial number is non-zero
-    if ( serial && (usecount > 0) )
-    {
-        fprintf(stderr, "Tracer: [%d][%s, %d] -exit-", serial, group, level);
-        fprintf(stderr, "\n");
-    }
-
-    // clean up
-    delete[] group;
-}
-
-
-//
-// because calls to getenv() are expensive, this function is only
-// called once, and the results are saved in static class variables
-//
-void Tracer::CheckEnvironment()
-{
-    // get the TRACEGROUP's from the environment
-    // get the TRACELEVEL from the environment
-    // get the TRACEONLY from the environment
-    grpenv = getenv("TRACEGROUP");
-    char* levenv = getenv("TRACELEVEL");
-    char* onlyenv = getenv("TRACEONLY");
-
-    if (levenv)
-        tracelevel = atoi(levenv);
-
-    if (onlyenv)
-    {
-        if ( (0 == strcmp(onlyenv, "TRUE")) || (0 == strcmp(onlyenv, "true")) || (0 == strcmp(onlyenv, "True")) )
-        {
-            onlyflag = true;
-        }
-    }
-}
-
-
-
-//
-// print a message to stderr if the passed 'condition' variable
-// is non-zero, and if this Tracer object SHOULD be printing, based
-// on the TRACExx environment varialbes
-//
-void Tracer::Print(bool condition, char *format, ...)
-{
-    // variable arg list
-    va_list arg_list;
-
-    // print message if 'condition' is true, and if this Tracer SHOULD print
-    if (condition && serial)
-    {
-        // print!
-        va_start(arg_list, format);
-        fprintf(stderr, "Tracer: [%d][%s, %d] ", serial, group, level);
-        vfprintf(stderr, format, arg_list);
-        fprintf(stderr, "\n");
-        va_end(arg_list);
-
-        // increment use counter
-        ++usecount;
-    }
-}
-
-//#define TESTTRACER
-#ifdef TESTTRACER
-
-
-class Foo
-{
-public:
-    void FooFunction()
-    {
-        // Tracer for an entering message - set group to "Foo" and level to 5
-        Tracer(true, "Foo", 5, "Entering FooFunction()");
-
-        // ...do some Foo stuff.  Perhaps there could be an error condition involved
-        // indicated with a boolean someErrorFlag.
-        bool someErrorFlag = true;
-        const char* someErrorMessage = "Too Close for Comfort!";
-        Tracer(someErrorFlag, "Foo", 5, "Encountered an error condition: %s", someErrorMessage);
-
-        // higher level of detail, group is still set to "Foo" but level is now 10
-        Tracer tt(true, "Foo", 10, "Doing some detailed calculations");
-        for (int i = 0; i < 10; i++)
-            tt.Print(true, "Iteration %d", i);
-    }
-};
-
-class Bar
-{
-public:
-    void BarFunction()
-    {
-        // Tracer for an entering message - set group to "Bar" and level to 5
-        Tracer(true, "Bar", 5, "Entering BarFunction()");
-
-        // ...more Bar stuff 
-    }
-};
-
-
-int main()
-{
-    //
-    // to turn on tracer messages for these two instances, depending on what you wish to 
-    // see at run time, do one of the following at the command line prior to execution
-    //          export TRACEGROUP=Foo
-    //          export TRACEGROUP=Bar
-    //          export TRACEGROUP=Foo,Bar
-    //          export TRACEGROUP=ALL
-    //
-    // also need to set the desired level of detail. Do something like this, depending on
-    // how much detail you wish to see
-    //          export TRACELEVEL=5
-    //          export TRACELEVEL=10
-    //
-    // Setting TRACELEVEL to 10 will normally show all tracers with levels <= 10
-    // if you ONLY want to see tracers of level 10, you would do
-    //          export TRACELEVEL=10
-    //          export TRACEONLY=TRUE
-    //
-
-    Foo f;
-    Bar b;
-
-    f.FooFunction();
-    b.BarFunction();
-
-    //
-    // sample stderr output, with TRACEGROUP=Foo,Bar and TRACELEVEL=5
-    //
-    //          Tracer: [1][Foo, 5] Entering FooFunction()
-    //          Tracer: [2][Foo, 5] Encountered an error condition: Too Close for Comfort!
-    //          Tracer: [3][Bar, 5] Entering BarFunction()
-    //
-    // sample stderr output, with TRACEGROUP=Foo,Bar and TRACELEVEL=10
-    //
-    //          Tracer: [1][Foo, 5] Entering FooFunction()
-    //          Tracer: [2][Foo, 5] Encountered an error condition: Too Close for Comfort!
-    //          Tracer: [3][Foo, 10] Doing some detailed calculations
-    //          Tracer: [3][Foo, 10] Iteration 0
-    //          Tracer: [3][Foo, 10] Iteration 1
-    //          Tracer: [3][Foo, 10] Iteration 2
-    //          Tracer: [3][Foo, 10] Iteration 3
-    //          Tracer: [3][Foo, 10] Iteration 4
-    //          Tracer: [3][Foo, 10] Iteration 5
-    //          Tracer: [3][Foo, 10] Iteration 6
-    //          Tracer: [3][Foo, 10] Iteration 7
-    //          Tracer: [3][Foo, 10] Iteration 8
-    //          Tracer: [3][Foo, 10] Iteration 9
-    //          Tracer: [3][Foo, 10] -exit-
-    //          Tracer: [4][Bar, 5] Entering BarFunction()
-    //
-    // setting TRACEONLY=TRUE and re-running yields
-    //
-    //          Tracer: [1][Foo, 10] Doing some detailed calculations
-    //          Tracer: [1][Foo, 10] Iteration 0
-    //          Tracer: [1][Foo, 10] Iteration 1
-    //          Tracer: [1][Foo, 10] Iteration 2
-    //          Tracer: [1][Foo, 10] Iteration 3
-    //          Tracer: [1][Foo, 10] Iteration 4
-    //          Tracer: [1][Foo, 10] Iteration 5
-    //          Tracer: [1][Foo, 10] Iteration 6
-    //          Tracer: [1][Foo, 10] Iteration 7
-    //          Tracer: [1][Foo, 10] Iteration 8
-    //          Tracer: [1][Foo, 10] Iteration 9
-    //          Tracer: [1][Foo, 10] -exit-
-    //
-
-    return 0;
-}
-
-#endif
+#include "Tracer.h"
+#include "TracerGroups.h"
+#include "TracerOutput.h"
+#include "TracerAsync.h"
+#include "TracerControl.h"
+#include "TracerRecorder.h"
+#include "TracerStats.h"
+#include "TracerShared.h"
+#include "TracerSocket.h"
+#include "TracerCoalesce.h"
+#include "TracerArchive.h"
+#include "TracerProfile.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <mutex>
+
+
+//
+// init static variables
+//
+int         Tracer::tracelevel  = 0;
+std::atomic<bool> Tracer::onlyflag(false);
+int         Tracer::timing      = TRACER_TIMING_OFF;
+std::atomic<int> Tracer::localepoch(0);
+std::atomic<std::atomic<int> *> Tracer::epoch(&Tracer::localepoch);
+std::atomic<unsigned> Tracer::tracecount(0);
+
+// nesting depth of timed scopes on this thread
+static thread_local int tracedepth = 0;
+
+// guards the one-time read of the environment
+static std::once_flag envonce;
+
+// serializes changes to the configuration
+static std::mutex configlock;
+
+
+//
+// ctor
+//
+// print a message to stderr if the passed 'condition' variable
+// is non-zero, and if this Tracer object SHOULD be printing, based
+// on the TRACExx environment varialbes
+//
+Tracer::Tracer(bool condition, const char *aGroup, int aLevel, const char *format, ...)
+    : Tracer()
+{
+    // variable arg list
+    va_list arg_list;
+
+    // is our group and level enabled, and is the 'condition' variable non-zero?
+    if ( Enter(aGroup, aLevel, format, condition) && condition )
+    {
+        // print!
+        va_start(arg_list, format);
+        Output(TRACER_RECORD_BEGIN, format, arg_list, 0);
+        va_end(arg_list);
+    }
+}
+
+
+//
+// common part of the ctors.  Decide whether this Tracer should print, and
+// if so, start it.  Returns true if it should
+//
+bool Tracer::Enter(const char *aGroup, int aLevel, const char *format, bool condition)
+{
+    // look up the group ID.  The group table keeps its own copy of the name,
+    // so there is no need for this Tracer to copy it
+    if (!aGroup)
+        return false;
+    groupid = TracerGroups::Intern(aGroup);
+    level = aLevel;
+
+    // is our group and level enabled, or does the flight recorder want it?
+
+    bool enabled = Enabled(groupid, aLevel);
+    recording = TracerRecorder::Records(aLevel);
+    if ( !enabled && !recording )
+        return false;
+
+    group = groupid ? TracerGroups::Name(groupid) : TracerGroups::Keep(aGroup);
+    Count(enabled, format);
+    Start(condition);
+    return true;
+}
+
+
+//
+// call site version of Enter(), reached from the TRACER() and 
+// TRACER_SCOPE() macros only if the site is not known to be disabled.
+// The first time through in each configuration epoch, the site enable
+// decision is made and cached
+//
+bool Tracer::Enter(TracerSite& site, const char *format, bool condition)
+{
+    int state = site.state.load(std::memory_order_acquire);
+    int current = epoch.load(std::memory_order_acquire)->load(std::memory_order_relaxed);
+    if ( (state != TRACER_SITE_STATE(current, TRACER_SITE_ENABLED)) &&
+         (state != TRACER_SITE_STATE(current, TRACER_SITE_RECORDED)) )
+        state = CheckSite(site, format);
+
+    if ( ((state & 3) != TRACER_SITE_ENABLED) && ((state & 3) != TRACER_SITE_RECORDED) )
+        return false;
+
+    // count the site for tracerctl
+    TracerSharedSite *shared = site.shared.load(std::memory_order_relaxed);
+    if (shared)
+        TracerShared::Hit(shared);
+
+    // the group is the string literal held by the site, so no copy is needed
+    group = site.group;
+    groupid = site.groupid.load(std::memory_order_relaxed);
+    level = site.level;
+    recording = TracerRecorder::Records(level);
+    Count((state & 3) == TRACER_SITE_ENABLED, format);
+    Start(condition);
+    return true;
+}
+
+
+//
+// decide whether an enabled Tracer prints, or in statistics mode, is
+// counted against its site instead, or in profiler mode, opens a frame
+//
+void Tracer::Count(bool enabled, const char *format)
+{
+    printing = enabled;
+
+    if ( enabled && TracerStats::Running() )
+    {
+        printing = false;
+        stat = TracerStats::Find(format, group, groupid, level);
+        if (stat)
+            TracerStats::Hit(stat);
+    }
+    else if ( enabled && TracerProfile::Running() )
+    {
+        printing = false;
+        frame = TracerProfile::Enter(format, group, groupid, level);
+    }
+}
+
+
+//
+// common start for an enabled Tracer, shared by both ctors
+//
+void Tracer::Start(bool condition)
+{
+    // a non-zero value for 'serial' not only uniquely identifies this tracer,
+    // but also doubles as a flag to indicate that this Tracer SHOULD print
+    // the tracecount variable is a static class value
+    serial = tracecount.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // in timing mode, note when this scope started, and how deeply it is
+    // nested in other timed scopes on this thread
+    if (timing)
+    {
+        start = TracerOutput::Monotonic();
+        depth = tracedepth++;
+    }
+    else if ( stat || frame )
+        start = TracerOutput::Monotonic();
+
+    // a trace event sink needs the start of every span, even if the ctor
+    // prints nothing
+    if ( printing && !condition && (TracerOutput::Mode() == TRACER_FORMAT_CHROME) )
+    {
+        TracerRecord rec = { TRACER_RECORD_BEGIN, serial, groupid, level, TracerOutput::Thread(), 0, group, "", 0, depth, -1, 0 };
+        if (TracerCoalesce::Running())
+            TracerCoalesce::Flush();
+        TracerOutput::Begin(rec);
+    }
+}
+
+
+//
+// print the closing message for the dtor, if the Tracer has been used, or
+// if every timed scope should report its elapsed time
+//
+void Tracer::Exit()
+{
+    long long elapsed = -1;
+    if (timing)
+    {
+        elapsed = TracerOutput::Monotonic() - start;
+        tracedepth = depth;
+    }
+
+    // in statistics mode, the lifetime goes into the site's histogram
+    if (stat)
+        TracerStats::Exit(stat, timing ? elapsed : TracerOutput::Monotonic() - start);
+
+    // in profiler mode, the lifetime goes to the frame's call path
+    if (frame)
+        TracerProfile::Exit(frame, timing ? elapsed : TracerOutput::Monotonic() - start);
+
+    // print a closing message, if the serial number is non-zero.  A trace
+    // event sink needs the end of every span
+    if ( serial && ((usecount > 0) || (suppressed > 0) || (timing == TRACER_TIMING_ALL) ||
+                    (printing && (TracerOutput::Mode() == TRACER_FORMAT_CHROME))) )
+    {
+        TracerRecord rec = { TRACER_RECORD_EXIT, serial, groupid, level, TracerOutput::Thread(), 0, group, 0, 0, depth, elapsed, suppressed };
+        if (recording)
+            TracerRecorder::Record(rec);
+        if (printing)
+        {
+            // the -exit- line ends any run of repeats, and its count goes
+            // ahead of it
+            if (TracerCoalesce::Running())
+                TracerCoalesce::Flush();
+            TracerOutput::Exit(rec);
+        }
+    }
+}
+
+
+//
+// is an environment variable set to TRUE?
+//
+bool Tracer::EnvTrue(const char *env)
+{
+    return env && ( (0 == strcmp(env, "TRUE")) || (0 == strcmp(env, "true")) || (0 == strcmp(env, "True")) );
+}
+
+
+//
+// because calls to getenv() are expensive, this function is only
+// called once, and the results are saved in static class variables
+//
+void Tracer::CheckEnvironment()
+{
+    // get the TRACEGROUP's from the environment
+    // get the TRACELEVEL from the environment
+    // get the TRACEONLY from the environment
+    char* grpenv = getenv("TRACEGROUP");
+    char* levenv = getenv("TRACELEVEL");
+    char* onlyenv = getenv("TRACEONLY");
+
+    if (levenv)
+        tracelevel = atoi(levenv);
+
+    if (EnvTrue(onlyenv))
+        onlyflag.store(true, std::memory_order_relaxed);
+
+    // scope timing, either on -exit- lines only, or for every scope
+    char* timeenv = getenv("TRACETIME");
+    if (EnvTrue(timeenv))
+        timing = TRACER_TIMING_ON;
+    else if ( timeenv && ((0 == strcmp(timeenv, "ALL")) || (0 == strcmp(timeenv, "all"))) )
+        timing = TRACER_TIMING_ALL;
+
+    // output format and destination
+    char* formatenv = getenv("TRACEFORMAT");
+    int format = TRACER_FORMAT_TEXT;
+    if ( formatenv && ((0 == strcmp(formatenv, "BINARY")) || (0 == strcmp(formatenv, "binary"))) )
+        format = TRACER_FORMAT_BINARY;
+    else if ( formatenv && ((0 == strcmp(formatenv, "CHROME")) || (0 == strcmp(formatenv, "chrome"))) )
+        format = TRACER_FORMAT_CHROME;
+    else if ( formatenv && ((0 == strcmp(formatenv, "JSON")) || (0 == strcmp(formatenv, "json"))) )
+        format = TRACER_FORMAT_JSON;
+
+    // a compressed archive, if requested, takes the records in place of
+    // the output file, its format and the writer thread
+    char* archiveenv = getenv("TRACEARCHIVE");
+    bool archive = archiveenv && TracerArchive::Start(archiveenv);
+
+    if (archive)
+        TracerOutput::Open(0, TRACER_FORMAT_TEXT, EnvTrue(getenv("TRACETHREAD")), 0);
+    else
+        TracerOutput::Open(getenv("TRACEFILE"), format, EnvTrue(getenv("TRACETHREAD")), getenv("TRACEMAP"));
+
+    // output to the tracerd aggregator, if requested.  It is sent by the
+    // writer thread, so it turns on asynchronous output
+    char* socketenv = getenv("TRACESOCKET");
+    bool socket = !archive && socketenv && TracerSocket::Start(EnvTrue(socketenv) ? TRACER_SOCKET_PATH : socketenv, format);
+
+    // asynchronous output, if requested
+    if ( !archive && (socket || EnvTrue(getenv("TRACEASYNC"))) )
+    {
+        char* sizeenv = getenv("TRACEASYNCSIZE");
+        char* overflowenv = getenv("TRACEOVERFLOW");
+
+        unsigned slots = sizeenv ? (unsigned)atoi(sizeenv) : TRACER_ASYNC_SLOTS;
+        int overflow = TRACER_OVERFLOW_DROP;
+        if ( overflowenv && ((0 == strcmp(overflowenv, "BLOCK")) || (0 == strcmp(overflowenv, "block"))) )
+            overflow = TRACER_OVERFLOW_BLOCK;
+
+        TracerAsync::Start(slots, overflow);
+    }
+
+    // statistics mode, if requested
+    if (EnvTrue(getenv("TRACESTATS")))
+        TracerStats::Start();
+
+    // profiler mode, if requested, writing the folded stacks to the file
+    // named, or the default one
+    char* profileenv = getenv("TRACEPROFILE");
+    if ( profileenv && *profileenv && strcmp(profileenv, "FALSE") && strcmp(profileenv, "false") && strcmp(profileenv, "False") )
+    {
+        char* topenv = getenv("TRACEPROFILETOP");
+        TracerProfile::Start(EnvTrue(profileenv) ? TRACER_PROFILE_FILE : profileenv, topenv ? atoi(topenv) : TRACER_PROFILE_TOP);
+    }
+
+    // collapsing of repeated messages, if requested
+    char* coalesceenv = getenv("TRACECOALESCE");
+    if ( EnvTrue(coalesceenv) || (coalesceenv && (atoi(coalesceenv) > 0)) )
+        TracerCoalesce::Start(EnvTrue(coalesceenv) ? TRACER_COALESCE_WINDOW : atoi(coalesceenv));
+
+    // the flight recorder, if requested, or needed to hold the records
+    // around a trigger.  It is started before the group list is parsed, so
+    // that call sites can take it into account
+    char* recordenv = getenv("TRACERECORD");
+    char* triggerenv = getenv("TRACETRIGGER");
+    if ( recordenv || triggerenv )
+    {
+        if (triggerenv)
+        {
+            char* beforeenv = getenv("TRACETRIGGERBEFORE");
+            char* afterenv = getenv("TRACETRIGGERAFTER");
+            TracerRecorder::Trigger(triggerenv, beforeenv ? atoi(beforeenv) : TRACER_TRIGGER_BEFORE,
+                                    afterenv ? atoi(afterenv) : TRACER_TRIGGER_AFTER);
+        }
+
+        char* sizeenv = getenv("TRACERECORDSIZE");
+        TracerRecorder::Start(recordenv ? atoi(recordenv) : INT_MAX, sizeenv ? (unsigned)atoi(sizeenv) : TRACER_RECORDER_SLOTS,
+                              getenv("TRACERECORDFILE"), EnvTrue(getenv("TRACERECORDEXIT")));
+    }
+
+    // the shared control segment, if requested.  It is published before
+    // the group list is parsed, so that every group is published with it,
+    // and from then on call sites check the epoch it holds
+    if (EnvTrue(getenv("TRACESHARED")))
+    {
+        int current = (localepoch.load(std::memory_order_relaxed) + 1) & TRACER_EPOCH_MASK;
+        std::atomic<int> *shared = TracerShared::Start(grpenv, tracelevel, onlyflag.load(std::memory_order_relaxed), current);
+        if (shared)
+            epoch.store(shared, std::memory_order_release);
+    }
+
+    // tokenize the group list once, into the group table
+    TracerGroups::Parse(grpenv, tracelevel);
+
+    // a control file, if given, replaces these settings now, and again
+    // whenever it changes or the process gets a SIGHUP
+    char* controlenv = getenv("TRACECONTROL");
+    if (controlenv)
+    {
+        char* pollenv = getenv("TRACECONTROLPOLL");
+        TracerControl::Start(controlenv, pollenv ? atoi(pollenv) : TRACER_CONTROL_POLL);
+    }
+}
+
+
+//
+// change the group, level and only settings while the program runs
+//
+void Tracer::Configure(const char *groups, int level, bool only)
+{
+    // the environment is read first, so it can't later undo this
+    std::call_once(envonce, CheckEnvironment);
+    Apply(groups, level, only);
+}
+
+
+//
+// install new settings, then start a new epoch so that every call site
+// makes its enable decision again.  Threads tracing meanwhile take no lock,
+// and see either the old settings or the new
+//
+void Tracer::Apply(const char *groups, int level, bool only)
+{
+    std::lock_guard<std::mutex> guard(configlock);
+
+    tracelevel = level;
+    onlyflag.store(only, std::memory_order_relaxed);
+    TracerGroups::Parse(groups, level);
+    TracerShared::Settings(groups, level, only);
+
+    // tracerctl may advance a shared epoch too, so this must not lose its step
+    std::atomic<int>& word = *epoch.load(std::memory_order_acquire);
+    int current = word.load(std::memory_order_relaxed);
+    while (!word.compare_exchange_weak(current, (current + 1) & TRACER_EPOCH_MASK, std::memory_order_release))
+        ;
+}
+
+
+//
+// does the passed group and level compare favorably to the TRACExx 
+// environment variables?
+//
+bool Tracer::Enabled(int aGroupID, int aLevel)
+{
+    // only do this once, since the call to getenv() is relatively expenensive.
+    // Any other thread arriving meanwhile waits until it is done
+    std::call_once(envonce, CheckEnvironment);
+
+    // take up any settings tracerctl has asked for
+    TracerShared::Poll();
+
+    // is our group in the list, or is the environment variable set to "ALL", and
+    // is our level less or equal to the level for the group?
+    return TracerGroups::Enabled(aGroupID, aLevel, onlyflag.load(std::memory_order_relaxed));
+}
+
+
+//
+// make the enable decision for a call site, and cache it in the site so
+// that it need not be made again until the configuration changes
+//
+int Tracer::CheckSite(TracerSite& site, const char *format)
+{
+    // any thread may get here first, and all of them decide the same way,
+    // and store the same ID and shared entry
+    int groupid = TracerGroups::Intern(site.group);
+    site.groupid.store(groupid, std::memory_order_relaxed);
+    std::call_once(envonce, CheckEnvironment);
+    TracerShared::Poll();
+
+    TracerSharedSite *shared = site.shared.load(std::memory_order_relaxed);
+    if ( !shared && TracerShared::Running() )
+    {
+        shared = TracerShared::Site(&site, format, groupid, site.level);
+        site.shared.store(shared, std::memory_order_relaxed);
+    }
+
+    // the epoch is read before the decision is made, so a decision that
+    // races with Configure() is stamped with the old epoch, and made again
+    int current = epoch.load(std::memory_order_acquire)->load(std::memory_order_acquire);
+    int decision = TRACER_SITE_DISABLED;
+    if (Enabled(groupid, site.level))
+        decision = TRACER_SITE_ENABLED;
+    else if (TracerRecorder::Records(site.level))
+        decision = TRACER_SITE_RECORDED;
+
+    if (shared)
+        shared->decision.store(decision, std::memory_order_relaxed);
+
+    int state = TRACER_SITE_STATE(current, decision);
+    site.state.store(state, std::memory_order_release);
+    return state;
+}
+
+
+//
+// print a message to stderr if the passed 'condition' variable
+// is non-zero, and if this Tracer object SHOULD be printing, based
+// on the TRACExx environment varialbes
+//
+void Tracer::Print(bool condition, const char *format, ...)
+{
+    // variable arg list
+    va_list arg_list;
+
+    // print message if 'condition' is true, and if this Tracer SHOULD print
+    if (condition && serial)
+    {
+        // print!
+        va_start(arg_list, format);
+        Output(TRACER_RECORD_MESSAGE, format, arg_list, 0);
+        va_end(arg_list);
+
+        // increment use counter
+        ++usecount;
+    }
+}
+
+
+//
+// for a limited Print(), does this call pass the policy of its call site?
+// A suppressed call is counted, and the count shown on the next line
+// printed from the site, returned in 'skipped'
+//
+bool Tracer::Pass(TracerLimit& limit, int& skipped)
+{
+    if (!Admit(limit))
+    {
+        limit.pending.fetch_add(1, std::memory_order_relaxed);
+        ++suppressed;
+        return false;
+    }
+
+    // claim the count of calls suppressed since the last one printed
+    skipped = 0;
+    if (limit.pending.load(std::memory_order_relaxed))
+        skipped = limit.pending.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+
+//
+// apply the policy of a limited call.  Only atomics are used, so many
+// threads may share one call site
+//
+bool Tracer::Admit(TracerLimit& limit)
+{
+    if (limit.count <= 0)
+        return true;
+
+    switch (limit.policy)
+    {
+        case TRACER_LIMIT_EVERY:
+            return (limit.calls.fetch_add(1, std::memory_order_relaxed) % limit.count) == 0;
+
+        case TRACER_LIMIT_FIRST:
+            // once the limit is reached, stop writing the shared counter
+            if (limit.calls.load(std::memory_order_relaxed) >= (unsigned long long)limit.count)
+                return false;
+            return limit.calls.fetch_add(1, std::memory_order_relaxed) < (unsigned long long)limit.count;
+
+        case TRACER_LIMIT_RATE:
+        {
+            // a token bucket holding up to one second's worth of calls, kept
+            // as the time at which it will next be full.  Each call moves that
+            // time on by one interval, unless it is more than a second away
+            long long interval = 1000000000LL / limit.count;
+            long long now = TracerOutput::Monotonic();
+            long long next = limit.next.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                long long later = ((next > now) ? next : now) + interval;
+                if (later - now > 1000000000LL)
+                    return false;
+                if (limit.next.compare_exchange_weak(next, later, std::memory_order_relaxed))
+                    return true;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+//
+// hand one message to the output
+//
+void Tracer::Output(int kind, const char *format, va_list arg_list, int skipped)
+{
+    TracerRecord rec = { kind, serial, groupid, level, TracerOutput::Thread(), 0, group, 0, 0, depth, -1, skipped };
+
+    if (recording)
+    {
+        va_list arg_copy;
+        va_copy(arg_copy, arg_list);
+        TracerRecorder::Record(rec, format, arg_copy);
+        va_end(arg_copy);
+    }
+
+    if (printing)
+    {
+        // a message with no arguments is known by its format alone.  One
+        // with arguments is formatted, and known by its text
+        if (TracerCoalesce::Running())
+        {
+            if (!strchr(format, '%'))
+            {
+                if (TracerCoalesce::Repeat(rec, format, "", 0))
+                    return;
+            }
+            else
+            {
+                char text[TRACER_COALESCE_TEXT];
+                va_list arg_copy;
+                va_copy(arg_copy, arg_list);
+                int length = vsnprintf(text, sizeof(text), format, arg_copy);
+                va_end(arg_copy);
+
+                bool whole = (length >= 0) && (length < (int)sizeof(text));
+                if (TracerCoalesce::Repeat(rec, format, whole ? text : 0, length))
+                    return;
+            }
+        }
+
+        TracerOutput::Message(rec, format, arg_list);
+    }
+    else if (stat)
+        TracerStats::Message(stat);
+}
+
+
+//
+// hand one message, with its captured arguments, to the output
+//
+void Tracer::Output(int kind, const char *format, const TracerArg *args, int count, int skipped)
+{
+    TracerRecord rec = { kind, serial, groupid, level, TracerOutput::Thread(), 0, group, 0, 0, depth, -1, skipped };
+
+    if (recording)
+        TracerRecorder::Record(rec, format, args, count);
+    if (printing)
+    {
+        if ( !TracerCoalesce::Running() || !TracerCoalesce::Repeat(rec, format, args, count) )
+            TracerOutput::Message(rec, format, args, count);
+    }
+    else if (stat)
+        TracerStats::Message(stat);
+}
+
+
+//
+// write the statistics mode summary table now
+//
+void Tracer::ReportStats()
+{
+    TracerStats::Report();
+}
+
+
+//
+// write the profiler mode folded stacks and table now
+//
+void Tracer::ReportProfile()
+{
+    TracerProfile::Report();
+}
+
+
+//
+// write the flight recorder's records now
+//
+void Tracer::DumpRecorder()
+{
+    TracerRecorder::Dump("request");
+}
+
+//#define TESTTRACER
+#ifdef TESTTRACER
+
+
+class Foo
+{
+public:
+    void FooFunction()
+    {
+        // Tracer for an entering message - set group to "Foo" and level to 5
+        Tracer(true, "Foo", 5, "Entering FooFunction()");
+
+        // ...do some Foo stuff.  Perhaps there could be an error condition involved
+        // indicated with a boolean someErrorFlag.
+        bool someErrorFlag = true;
+        const char* someErrorMessage = "Too Close for Comfort!";
+        Tracer(someErrorFlag, "Foo", 5, "Encountered an error condition: %s", someErrorMessage);
+
+        // higher level of detail, group is still set to "Foo" but level is now 10
+        Tracer tt(true, "Foo", 10, "Doing some detailed calculations");
+        for (int i = 0; i < 10; i++)
+            tt.Print(true, "Iteration %d", i);
+    }
+};
+
+class Bar
+{
+public:
+    void BarFunction()
+    {
+        // Tracer for an entering message - set group to "Bar" and level to 5
+        Tracer(true, "Bar", 5, "Entering BarFunction()");
+
+        // ...more Bar stuff 
+    }
+};
+
+
+int main()
+{
+    //
+    // to turn on tracer messages for these two instances, depending on what you wish to 
+    // see at run time, do one of the following at the command line prior to execution
+    //          export TRACEGROUP=Foo
+    //          export TRACEGROUP=Bar
+    //          export TRACEGROUP=Foo,Bar
+    //          export TRACEGROUP=ALL
+    //
+    // also need to set the desired level of detail. Do something like this, depending on
+    // how much detail you wish to see
+    //          export TRACELEVEL=5
+    //          export TRACELEVEL=10
+    //
+    // Setting TRACELEVEL to 10 will normally show all tracers with levels <= 10
+    // if you ONLY want to see tracers of level 10, you would do
+    //          export TRACELEVEL=10
+    //          export TRACEONLY=TRUE
+    //
+
+    Foo f;
+    Bar b;
+
+    f.FooFunction();
+    b.BarFunction();
+
+    //
+    // sample stderr output, with TRACEGROUP=Foo,Bar and TRACELEVEL=5
+    //
+    //          Tracer: [1][Foo, 5] Entering FooFunction()
+    //          Tracer: [2][Foo, 5] Encountered an error condition: Too Close for Comfort!
+    //          Tracer: [3][Bar, 5] Entering BarFunction()
+    //
+    // sample stderr output, with TRACEGROUP=Foo,Bar and TRACELEVEL=10
+    //
+    //          Tracer: [1][Foo, 5] Entering FooFunction()
+    //          Tracer: [2][Foo, 5] Encountered an error condition: Too Close for Comfort!
+    //          Tracer: [3][Foo, 10] Doing some detailed calculations
+    //          Tracer: [3][Foo, 10] Iteration 0
+    //          Tracer: [3][Foo, 10] Iteration 1
+    //          Tracer: [3][Foo, 10] Iteration 2
+    //          Tracer: [3][Foo, 10] Iteration 3
+    //          Tracer: [3][Foo, 10] Iteration 4
+    //          Tracer: [3][Foo, 10] Iteration 5
+    //          Tracer: [3][Foo, 10] Iteration 6
+    //          Tracer: [3][Foo, 10] Iteration 7
+    //          Tracer: [3][Foo, 10] Iteration 8
+    //          Tracer: [3][Foo, 10] Iteration 9
+    //          Tracer: [3][Foo, 10] -exit-
+    //          Tracer: [4][Bar, 5] Entering BarFunction()
+    //
+    // setting TRACEONLY=TRUE and re-running yields
+    //
+    //          Tracer: [1][Foo, 10] Doing some detailed calculations
+    //          Tracer: [1][Foo, 10] Iteration 0
+    //          Tracer: [1][Foo, 10] Iteration 1
+    //          Tracer: [1][Foo, 10] Iteration 2
+    //          Tracer: [1][Foo, 10] Iteration 3
+    //          Tracer: [1][Foo, 10] Iteration 4
+    //          Tracer: [1][Foo, 10] Iteration 5
+    //          Tracer: [1][Foo, 10] Iteration 6
+    //          Tracer: [1][Foo, 10] Iteration 7
+    //          Tracer: [1][Foo, 10] Iteration 8
+    //          Tracer: [1][Foo, 10] Iteration 9
+    //          Tracer: [1][Foo, 10] -exit-
+    //
+
+    return 0;
+}
+
+#endif
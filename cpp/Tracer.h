@@ -1,142 +1,706 @@
-
-#ifndef __TRACER_H
-#define __TRACER_H
-
-//
-//    Tracer
-//
-//    A class to conditionally output a debugging message to stderr, depending on the 
-//    settings of several environment variables, which the user can control
-//    at run time via the shell command line, prior to execution of the code
-// 
-//    Outputs a message to stderr if
-//
-//        - the passed parameter 'condition' is true, and
-//        - the passed parameter 'group' is contained in the TRACEGROUP
-//          environment variable, and
-//        - the passed parameter 'level' compares "favorably" to the
-//          value contained in the TRACELEVEL environment variable
-// 
-//    The phrase "favorably" in the above discussion is in quotes because it
-//    can be controlled at runtime.  The default behavior is 'less than or
-//    equal to', but it can be changed to 'is exactly equal to' if the
-//    environment variable TRACEONLY is set to the string "TRUE".  This is
-//    useful when it is desired to use the trace function as a debugging
-//    tool inside a specific function, without seeing any other trace output.
-//
-//    Output is similar to printf, using the format string and a variable
-//    number of additional parameters.
-//
-//    Environment variable summary:
-//
-//        The TRACEGROUP variable indicates which group(s) of Tracer messages
-//        will be printed.  To turn on more than 1 group, separate the desired 
-//        groups with a comma, or alternatively, set TRACEGROUP to ALL
-//
-//        The TRACELEVEL variable will represent the maximum (or exact) trace
-//        level which should be printed.
-//
-//        The TRACEONLY variable will control whether the TRACELEVEL is used
-//        as a maximum trace level or an exact trace level.
-//
-//    Example of environment variable use in the C shell:
-//
-//        setenv TRACEGROUP CXMT,AWB
-//        setenv TRACELEVEL 20
-//        setenv TRACEONLY TRUE
-//
-//    Examples for Raspbian bash shell
-// 
-//        export TRACEGROUP=CXMT,AWB
-//        export TRACEGROUP=ALL
-// 
-//        export TRACELEVEL=20
-// 
-//        export TRACEONLY=TRUE
-//        unset TRACEONLY
-// 
-//    The intended use, would be to set up Tracer instances throughout the code,
-//    with Tracer "groups" set up by module or class, and Tracer "levels" set up
-//    with higher level values corresponding to higher amounts of detail
-// 
-//    Example:
-// 
-//        class Foo
-//        {
-//        public:
-//            void FooFunction()
-//            {
-//                // Tracer for an entering message - set group to "Foo" and level to 5
-//                Tracer(true, "Foo", 5, "Entering FooFunction()");
-//
-//                // ...do some Foo stuff.  Perhaps there could be an error condition involved
-//                // indicated with a boolean someErrorFlag.
-//                bool someErrorFlag = true;
-//                const char* someErrorMessage = "Too Close for Comfort!";
-//                Tracer(someErrorFlag, "Foo", 5, "Encountered an error condition: %s", someErrorMessage);
-//
-//                // higher level of detail, group is still set to "Foo" but level is now 10
-//                Tracer tt(true, "Foo", 10, "Doing some detailed calculations");
-//                for (int i = 0; i < 10; i++)
-//                    tt.Print(true, "Iteration %d", i);
-// 
-//            }
-//        };
-//
-//        class Bar
-//        {
-//        public:
-//            void BarFunction()
-//            {
-//                // Tracer for an entering message - set group to "Bar" and level to 5
-//                Tracer(true, "Bar", 5, "Entering BarFunction()");
-//
-//                // ...more Bar stuff 
-//            }
-//        };
-//
-
-
-class Tracer
-{
-    // environment variables, shared by all Tracer instances
-    static char *grpenv;        // pointer to TRACEGROUP environment variable
-    static int tracelevel;      // equal to TRACELEVEL environment variable
-    static bool onlyflag;       // cooresponds to TRACEONLY environment variable
-    static bool envchecked;     // boolean
-
-    static unsigned tracecount; // used to generate unique serial numbers for
-                                // each Tracer object
-
-    // utility function to get the TRACE settings from the environment
-    void CheckEnvironment();
-
-    // group this Tracer belongs to
-    char *group;
-
-    // trace level of this Tracer
-    int level;
-
-    // which number is this Tracer - 0 if not printing
-    int serial;
-
-    // simple integer to keep track of whether an exit message is printed
-    // at destruction.  If usecount == 0, no message is printed
-    // set to 0 in ctor, incremented at every call to Print().
-    int usecount;
-
-public:
-
-    Tracer(bool condition, char *aGroup, int aLevel, char *format, ...);
-    ~Tracer();
-
-    void Print(bool condition, char *format, ...);
-
-};
-
-
-
-
-#endif   // __TRACER_H
-
-
+
+#ifndef __TRACER_H
+#define __TRACER_H
+
+#include <stdarg.h>
+#include <limits.h>
+#include <atomic>
+
+#include "TracerFormat.h"
+#include "TracerRecord.h"
+
+//
+//    Tracer
+//
+//    A class to conditionally output a debugging message to stderr, depending on the 
+//    settings of several environment variables, which the user can control
+//    at run time via the shell command line, prior to execution of the code
+// 
+//    Outputs a message to stderr if
+//
+//        - the passed parameter 'condition' is true, and
+//        - the passed parameter 'group' is contained in the TRACEGROUP
+//          environment variable, and
+//        - the passed parameter 'level' compares "favorably" to the
+//          value contained in the TRACELEVEL environment variable
+// 
+//    The phrase "favorably" in the above discussion is in quotes because it
+//    can be controlled at runtime.  The default behavior is 'less than or
+//    equal to', but it can be changed to 'is exactly equal to' if the
+//    environment variable TRACEONLY is set to the string "TRUE".  This is
+//    useful when it is desired to use the trace function as a debugging
+//    tool inside a specific function, without seeing any other trace output.
+//
+//    Output is similar to printf, using the format string and a variable
+//    number of additional parameters.  The arguments keep their C++ types,
+//    so std::string and user types may be passed for %s, and a mismatched
+//    argument is formatted sensibly rather than crashing the program.  The
+//    macros below also check literal format strings at compile time (see
+//    TracerFormat.h).
+//
+//    Environment variable summary:
+//
+//        The TRACEGROUP variable indicates which group(s) of Tracer messages
+//        will be printed.  To turn on more than 1 group, separate the desired 
+//        groups with a comma, or alternatively, set TRACEGROUP to ALL.  Group
+//        names must match exactly.  Any group may be followed by a colon and
+//        a level, which overrides TRACELEVEL for that group (see TracerGroups.h)
+//
+//        The TRACELEVEL variable will represent the maximum (or exact) trace
+//        level which should be printed.
+//
+//        The TRACEONLY variable will control whether the TRACELEVEL is used
+//        as a maximum trace level or an exact trace level.
+//
+//        The TRACEASYNC variable, if set to TRUE, moves the writing of
+//        messages to stderr onto a background thread (see TracerAsync.h)
+//
+//        The TRACEFORMAT and TRACEFILE variables select a binary log format,
+//        Chrome Trace Event JSON or JSON lines in place of text, and a file
+//        in place of stderr (see TracerOutput.h).  TRACEMAP writes the file
+//        through a memory mapping, in rotating segments (see TracerMapped.h).
+//        TRACEARCHIVE writes records to a compressed archive in their place,
+//        to be searched with tracer-query (see TracerArchive.h)
+//
+//        The TRACESOCKET variable sends the output of the process to the
+//        tracerd aggregator, which merges the output of many processes into
+//        one log (see TracerSocket.h)
+//
+//        The TRACETHREAD variable, if set to TRUE, adds the ID of the calling
+//        thread to each line
+//
+//        The TRACECONTROL variable names a control file holding TRACEGROUP,
+//        TRACELEVEL and TRACEONLY settings, which replace the environment,
+//        and are read again whenever the file changes or the process gets a
+//        SIGHUP (see TracerControl.h).  Programs may also change the
+//        settings at any time with Tracer::Configure()
+//
+//        The TRACESHARED variable, if set to TRUE, publishes the settings,
+//        the group table and the call sites in shared memory, where the
+//        tracerctl tool can show them, and change the settings while the
+//        program runs (see TracerShared.h)
+//
+//        The TRACERECORD variable turns on an in-memory flight recorder,
+//        which keeps the recent records of each thread up to its own level,
+//        printed or not, and writes them out only on a crash, or when asked.
+//        The TRACETRIGGER variable has it write a window of records around
+//        each message that matches a trigger instead (see TracerRecorder.h)
+//
+//        The TRACECOALESCE variable, if set to TRUE, prints a run of
+//        identical messages from one call site on one thread as the first
+//        of them, and a count of the rest (see TracerCoalesce.h)
+//
+//        The TRACESTATS variable, if set to TRUE, counts each enabled Tracer
+//        against its call site, with a histogram of how long it lived,
+//        instead of printing it, and writes a summary table at exit (see
+//        TracerStats.h)
+//
+//        The TRACEPROFILE variable, if set to TRUE or to a file name, makes
+//        each enabled Tracer a frame in a call tree of nested Tracer scopes,
+//        instead of printing it, and writes the tree as folded stacks, for
+//        flame graph tools, with a table of the sites with the most self
+//        time, at exit (see TracerProfile.h)
+//
+//        The TRACETIME variable turns each Tracer into a latency probe.  Set
+//        to TRUE, the -exit- line printed by ~Tracer shows the nanoseconds
+//        elapsed since the Tracer was constructed, and messages are indented
+//        by how deeply their Tracer is nested in other Tracer scopes on the
+//        same thread.  Set to ALL, every enabled Tracer prints a timed -exit-
+//        line, even if Print() was never called:
+//
+//            Tracer: [3][Foo, 10] Doing some detailed calculations
+//            Tracer: [4][Foo, 20]   Inner loop
+//            Tracer: [4][Foo, 20]   -exit- 1520 ns
+//            Tracer: [3][Foo, 10] -exit- 48210 ns
+//
+//    Tracer may be used from any number of threads.  The environment is read
+//    exactly once, serial numbers are allocated atomically, and each line is
+//    written with a single write(), so lines from different threads never
+//    interleave.
+//
+//    Example of environment variable use in the C shell:
+//
+//        setenv TRACEGROUP CXMT,AWB
+//        setenv TRACELEVEL 20
+//        setenv TRACEONLY TRUE
+//
+//    Examples for Raspbian bash shell
+// 
+//        export TRACEGROUP=CXMT,AWB
+//        export TRACEGROUP=CXMT:20,AWB:5
+//        export TRACEGROUP=ALL
+// 
+//        export TRACELEVEL=20
+// 
+//        export TRACEONLY=TRUE
+//        unset TRACEONLY
+// 
+//    The intended use, would be to set up Tracer instances throughout the code,
+//    with Tracer "groups" set up by module or class, and Tracer "levels" set up
+//    with higher level values corresponding to higher amounts of detail
+// 
+//    Example:
+// 
+//        class Foo
+//        {
+//        public:
+//            void FooFunction()
+//            {
+//                // Tracer for an entering message - set group to "Foo" and level to 5
+//                Tracer(true, "Foo", 5, "Entering FooFunction()");
+//
+//                // ...do some Foo stuff.  Perhaps there could be an error condition involved
+//                // indicated with a boolean someErrorFlag.
+//                bool someErrorFlag = true;
+//                const char* someErrorMessage = "Too Close for Comfort!";
+//                Tracer(someErrorFlag, "Foo", 5, "Encountered an error condition: %s", someErrorMessage);
+//
+//                // higher level of detail, group is still set to "Foo" but level is now 10
+//                Tracer tt(true, "Foo", 10, "Doing some detailed calculations");
+//                for (int i = 0; i < 10; i++)
+//                    tt.Print(true, "Iteration %d", i);
+// 
+//            }
+//        };
+//
+//        class Bar
+//        {
+//        public:
+//            void BarFunction()
+//            {
+//                // Tracer for an entering message - set group to "Bar" and level to 5
+//                Tracer(true, "Bar", 5, "Entering BarFunction()");
+//
+//                // ...more Bar stuff 
+//            }
+//        };
+//
+//    Call site macros:
+//
+//        The TRACER() and TRACER_SCOPE() macros take the same arguments as the
+//        Tracer constructor, but also give each call site a static TracerSite
+//        descriptor holding its group and level.  Whether or not the site is
+//        enabled is decided once, the first time the site is reached, and
+//        cached in the descriptor.  After that, a disabled site costs three
+//        dependent loads, of the site's state, the epoch pointer and the
+//        epoch, and a branch, with no allocation and no string work.  The
+//        decision is made again after Tracer::Configure() is called.
+//
+//            // same as Tracer(true, "Foo", 5, "Entering FooFunction()");
+//            TRACER(true, "Foo", 5, "Entering FooFunction()");
+//
+//            // same as Tracer tt(true, "Foo", 10, "Doing some detailed calculations");
+//            TRACER_SCOPE(tt, true, "Foo", 10, "Doing some detailed calculations");
+//            for (int i = 0; i < 10; i++)
+//                tt.Print(true, "Iteration %d", i);
+//
+//        The message arguments of these macros are evaluated only if the
+//        message will be printed or recorded, so an expensive argument costs
+//        nothing at a disabled site.  The TRACER_PRINT() macro does the same
+//        for Print(), checking that the Tracer is active before its
+//        condition and arguments are evaluated:
+//
+//            TRACER_SCOPE(tt, true, "Db", 10, "Query %s", query.Text());
+//            TRACER_PRINT(tt, true, "Plan %s", query.Explain());
+//
+//        The Tracer ctor and Print() themselves are ordinary calls, so their
+//        arguments are always evaluated.
+//
+//    Sampling and rate limiting:
+//
+//        A Print() call in a hot loop can be limited with the
+//        TRACER_PRINT_LIMITED() macro, which gives the call its own static
+//        TracerLimit, and one of these policies:
+//
+//            TRACER_LIMIT_EVERY      print every Nth call
+//            TRACER_LIMIT_RATE       print at most N calls per second
+//            TRACER_LIMIT_FIRST      print the first N calls, then nothing
+//
+//            TRACER_SCOPE(tt, true, "Foo", 10, "Doing some detailed calculations");
+//            for (int i = 0; i < 1000000; i++)
+//                TRACER_PRINT_LIMITED(tt, TRACER_LIMIT_RATE, 100, true, "Iteration %d", i);
+//
+//        The next line printed from the call shows how many calls were
+//        suppressed since the last one, and the -exit- line shows how many
+//        of the Tracer's calls were suppressed in all:
+//
+//            Tracer: [3][Foo, 10] Iteration 81220 (81114 suppressed)
+//            Tracer: [3][Foo, 10] -exit- (999900 suppressed)
+//
+//        The limit is checked without locks or allocation, and only after
+//        the Tracer is known to be enabled, so a suppressed call costs an
+//        atomic increment and never formats its message.
+//
+
+
+//
+// printf format checking for the printf style overloads, where the compiler
+// supports it
+//
+#ifdef __GNUC__
+#define TRACER_PRINTF(string, first)    __attribute__((__format__(__printf__, string, first)))
+#else
+#define TRACER_PRINTF(string, first)
+#endif
+
+
+//
+// possible values for the TRACETIME setting
+//
+#define TRACER_TIMING_OFF       0       // no timing
+#define TRACER_TIMING_ON        1       // elapsed time on -exit- lines
+#define TRACER_TIMING_ALL       2       // an -exit- line, with elapsed time, for every scope
+
+
+//
+// possible decisions for TracerSite::state.  A decision is stored along with
+// the configuration epoch it was made in, so once Tracer::Configure() starts
+// a new epoch, every cached decision stops matching and is made again
+//
+#define TRACER_SITE_UNCHECKED   0
+#define TRACER_SITE_DISABLED    1
+#define TRACER_SITE_ENABLED     2
+#define TRACER_SITE_RECORDED    3       // not printed, but kept by the flight recorder
+
+#define TRACER_SITE_STATE(epoch, decision)  (((epoch) << 2) | (decision))
+#define TRACER_EPOCH_MASK       0x1fffffff
+
+
+struct TracerStat;
+struct TracerSharedSite;
+
+
+//
+// possible values for TracerLimit::policy
+//
+#define TRACER_LIMIT_EVERY      0       // every Nth call
+#define TRACER_LIMIT_RATE       1       // at most N calls per second
+#define TRACER_LIMIT_FIRST      2       // the first N calls only
+
+
+//
+// static descriptor for one Tracer call site, created by the TRACER() and
+// TRACER_SCOPE() macros.  It is an aggregate, so the function-local static
+// is constant initialized and needs no guard variable.  Any number of
+// threads may decide a site at once, and again after every Configure(),
+// but they all store the same 'groupid' and 'shared', so those are relaxed
+// atomics.  They are stored before 'state' is released, so a thread that
+// acquires a decided state finds them set
+//
+struct TracerSite
+{
+    const char *group;          // group for this call site
+    int level;                  // trace level for this call site
+    std::atomic<int> state;     // cached enable decision, TRACER_SITE_STATE()
+    std::atomic<int> groupid;   // TracerGroups ID, set when the state is decided
+    std::atomic<TracerSharedSite *> shared;     // TracerShared entry, if
+                                // published, set along with 'groupid'
+};
+
+
+//
+// static descriptor for one limited Print() call, created by the
+// TRACER_PRINT_LIMITED() macro.  Also an aggregate, so the counters start
+// at zero with no guard variable
+//
+struct TracerLimit
+{
+    int policy;                             // TRACER_LIMIT_xxx
+    long long count;                        // N, for the policy
+    std::atomic<unsigned long long> calls;  // calls so far, for EVERY and FIRST
+    std::atomic<long long> next;            // for RATE, the monotonic time the
+                                            // bucket is next full up to
+    std::atomic<int> pending;               // calls suppressed since the last one
+                                            // printed
+};
+
+
+class Tracer
+{
+    // environment variables, shared by all Tracer instances
+    static int tracelevel;      // equal to TRACELEVEL environment variable
+    static std::atomic<bool> onlyflag;  // cooresponds to TRACEONLY environment variable
+    static int timing;          // TRACER_TIMING_xxx, from TRACETIME environment variable
+
+    static std::atomic<int> localepoch;             // configuration epoch, advanced by every Configure()
+    static std::atomic<std::atomic<int> *> epoch;   // the epoch call sites check: 'localepoch', or the
+                                                    // one in the TracerShared segment, once published
+
+    static std::atomic<unsigned> tracecount;    // used to generate unique serial numbers for
+                                                // each Tracer object
+
+    // utility function to get the TRACE settings from the environment
+    static void CheckEnvironment();
+    static bool EnvTrue(const char *env);
+
+    // install new group, level and only settings, and start a new epoch
+    static void Apply(const char *groups, int level, bool only);
+    friend class TracerControl;
+    friend class TracerShared;
+
+    // does the group and level compare favorably to the environment?
+    static bool Enabled(int aGroupID, int aLevel);
+
+    // decide whether a call site is enabled, and cache the result in the site
+    static int CheckSite(TracerSite& site, const char *format);
+
+    // does a limited call pass its policy?
+    static bool Admit(TracerLimit& limit);
+
+    // utility functions shared by the ctors, Print() and the dtor
+    bool Enter(const char *aGroup, int aLevel, const char *format, bool condition);
+    bool Enter(TracerSite& site, const char *format, bool condition);
+    bool Pass(TracerLimit& limit, int& skipped);
+    void Count(bool enabled, const char *format);
+    void Start(bool condition);
+    void Output(int kind, const char *format, va_list arg_list, int skipped);
+    void Output(int kind, const char *format, const TracerArg *args, int count, int skipped);
+    void Exit();
+
+    // capture the arguments of a message, and hand it to the output
+    template <typename... Args>
+    void Emit(int kind, int skipped, const char *format, const Args&... args)
+    {
+        TracerArg list[] = { TracerMakeArg(args)..., TracerArg() };
+        Output(kind, format, list, (int)sizeof...(Args), skipped);
+    }
+
+    // group this Tracer belongs to.  Points either to the call site group,
+    // or to the name interned in the group table
+    const char *group;
+
+    // TracerGroups ID of the group
+    int groupid;
+
+    // trace level of this Tracer
+    int level;
+
+    // which number is this Tracer - 0 if not printing
+    int serial;
+
+    // simple integer to keep track of whether an exit message is printed
+    // at destruction.  If usecount == 0, no message is printed
+    // set to 0 in ctor, incremented at every call to Print().
+    int usecount;
+
+    // in timing mode, monotonic time in nanoseconds at construction, and
+    // the nesting depth of this scope on its thread
+    long long start;
+    int depth;
+
+    // number of limited Print() calls suppressed over the life of this Tracer
+    int suppressed;
+
+    // does this Tracer print, and does the flight recorder keep its records?
+    // If either is true, 'serial' is non-zero
+    bool printing;
+    bool recording;
+
+    // in statistics mode, the counters for this Tracer's site
+    TracerStat *stat;
+
+    // in profiler mode, this Tracer's frame in its thread's call tree
+    int frame;
+
+public:
+
+    // type safe ctor.  The arguments are captured, and only formatted if
+    // this Tracer prints
+    template <typename... Args>
+    Tracer(bool condition, const char *aGroup, int aLevel, const char *format, const Args&... args)
+        : Tracer()
+    {
+        if ( Enter(aGroup, aLevel, format, condition) && condition )
+            Emit(TRACER_RECORD_BEGIN, 0, format, args...);
+    }
+
+    // printf style ctor, for a message with no arguments
+    Tracer(bool condition, const char *aGroup, int aLevel, const char *format, ...) TRACER_PRINTF(5, 6);
+
+    // call site ctor, used by the TRACER() and TRACER_SCOPE() macros.  Does
+    // no work of its own; Open() is called only if the site is not disabled
+    Tracer()
+        : group(0), groupid(0), level(0), serial(0), usecount(0), start(0), depth(0), suppressed(0),
+          printing(false), recording(false), stat(0), frame(0)
+    {
+    }
+
+    ~Tracer()
+    {
+        if (serial)
+            Exit();
+    }
+
+    template <typename... Args>
+    void Begin(TracerSite& site, bool condition, const char *format, const Args&... args)
+    {
+        if ( Enter(site, format, condition) && condition )
+            Emit(TRACER_RECORD_BEGIN, 0, format, args...);
+    }
+
+    // lazy form of Begin(), used by the macros so that the ctor message's
+    // arguments are evaluated only if it will be printed or recorded.  Open()
+    // starts the Tracer, and returns true if Announce() should follow
+    bool Open(TracerSite& site, bool condition, const char *format)
+    {
+        return Enter(site, format, condition) && condition;
+    }
+
+    template <typename... Args>
+    void Announce(const char *format, const Args&... args)
+    {
+        Emit(TRACER_RECORD_BEGIN, 0, format, args...);
+    }
+
+    // does this Tracer print, record or count?  If not, Print() does nothing
+    bool Active() const
+    {
+        return serial != 0;
+    }
+
+    template <typename... Args>
+    void Print(bool condition, const char *format, const Args&... args)
+    {
+        if ( condition && serial )
+        {
+            Emit(TRACER_RECORD_MESSAGE, 0, format, args...);
+            ++usecount;
+        }
+    }
+
+    // printf style Print(), for a message with no arguments
+    void Print(bool condition, const char *format, ...) TRACER_PRINTF(3, 4);
+
+    // Print(), subject to the sampling or rate limit policy of a call site.
+    // Used by the TRACER_PRINT_LIMITED() macro
+    template <typename... Args>
+    void Print(TracerLimit& limit, bool condition, const char *format, const Args&... args)
+    {
+        int skipped;
+        if ( condition && serial && Pass(limit, skipped) )
+        {
+            Emit(TRACER_RECORD_MESSAGE, skipped, format, args...);
+            ++usecount;
+        }
+    }
+
+    // replace the TRACEGROUP, TRACELEVEL and TRACEONLY settings while the
+    // program runs.  Tracers already constructed are not affected
+    static void Configure(const char *groups, int level, bool only);
+
+    // write the flight recorder's records now (see TracerRecorder.h)
+    static void DumpRecorder();
+
+    // write the statistics mode summary table now (see TracerStats.h)
+    static void ReportStats();
+
+    // write the profiler mode folded stacks and table now (see
+    // TracerProfile.h)
+    static void ReportProfile();
+
+    // the state of a call site known to be disabled in the current epoch
+    static int SiteDisabled()
+    {
+        // the pointer is acquired, as it may have just been switched to
+        // the shared segment, mapped by another thread
+        return TRACER_SITE_STATE(epoch.load(std::memory_order_acquire)->load(std::memory_order_relaxed), TRACER_SITE_DISABLED);
+    }
+
+};
+
+
+//
+// compile time filtering
+//
+// For release builds, a compile time floor can be set with the following
+// preprocessor symbols.  Any TRACER() or TRACER_SCOPE() site outside the floor
+// is discarded by 'if constexpr': no code, no TracerSite, no strings, and its
+// format arguments are never evaluated.  A stripped TRACER_SCOPE() declares a
+// TracerStub in place of the Tracer, and TRACER_PRINT() on a TracerStub is
+// discarded by 'if constexpr' too, so none of this depends on the optimizer.
+// The plain Tracer ctor is not affected, nor is a Print() called directly on
+// a TracerStub, which is an inline no-op, but keeps its strings at -O0.
+//
+//        TRACER_COMPILE_LEVEL    highest level kept (default: all levels)
+//        TRACER_COMPILE_GROUPS   comma separated list of groups kept, or "ALL"
+//                                (default: "ALL")
+//
+//    Example:
+//
+//        g++ -DTRACER_COMPILE_LEVEL=5 -DTRACER_COMPILE_GROUPS='"Net,Db"' ...
+//
+//    Since the decision is made by the compiler, the group and level passed to
+//    the macros must be a string literal and an integer constant expression.
+//    Stripped sites can be confirmed absent from an object file with
+//
+//        nm -C foo.o | grep tracer_site
+//        strings foo.o | grep 'message text'
+//
+//    which tracer-floor-check.sh does at each optimization level.
+//
+#ifndef TRACER_COMPILE_LEVEL
+#define TRACER_COMPILE_LEVEL    INT_MAX
+#endif
+
+#ifndef TRACER_COMPILE_GROUPS
+#define TRACER_COMPILE_GROUPS   "ALL"
+#endif
+
+
+//
+// is 'aGroup' an exact, complete entry in the comma separated 'list'?
+//
+constexpr bool TracerGroupListed(const char *aGroup, const char *list)
+{
+    while (*list)
+    {
+        // compare this entry against the group
+        const char *g = aGroup;
+        while (*g && (*list == *g))
+        {
+            ++g;
+            ++list;
+        }
+
+        if ( (*g == 0) && ((*list == ',') || (*list == 0)) )
+            return true;
+
+        // skip to the next entry
+        while (*list && (*list != ','))
+            ++list;
+        if (*list == ',')
+            ++list;
+    }
+
+    return false;
+}
+
+
+//
+// is a call site with this group and level kept by the compile time floor?
+//
+constexpr bool TracerCompiledIn(const char *aGroup, int aLevel)
+{
+    return (aLevel <= TRACER_COMPILE_LEVEL) &&
+           (TracerGroupListed("ALL", TRACER_COMPILE_GROUPS) || TracerGroupListed(aGroup, TRACER_COMPILE_GROUPS));
+}
+
+
+//
+// stand-in for a Tracer declared by TRACER_SCOPE() for a site that has been
+// compiled out.  Everything is an inline no-op, so Print() calls on it vanish
+//
+class TracerStub
+{
+public:
+    template <typename... Args> void Begin(TracerSite&, bool, const char *, const Args&...) {}
+    bool Open(TracerSite&, bool, const char *) { return false; }
+    template <typename... Args> void Announce(const char *, const Args&...) {}
+    template <typename... Args> void Print(TracerLimit&, bool, const char *, const Args&...) {}
+    template <typename... Args> void Print(bool, const char *, const Args&...) {}
+    constexpr bool Active() const { return false; }
+};
+
+template <bool kept> struct TracerScopeType             { typedef Tracer type; };
+template <>          struct TracerScopeType<false>      { typedef TracerStub type; };
+
+// is the Tracer named in TRACER_PRINT() a stand-in?
+template <typename T> struct TracerStubbed              { static constexpr bool value = false; };
+template <>           struct TracerStubbed<TracerStub>  { static constexpr bool value = true; };
+
+
+//
+// compile time format checking.  TRACER_CHECK_FORMAT(format, args...) fails
+// to compile if 'format' is a literal that doesn't match the types of
+// 'args'.  A format that isn't a constant is checked only at run time.
+// GCC and Clang fold a constexpr call on a literal, so __builtin_constant_p()
+// tells the two apart
+//
+#define TRACER_FORMAT_STRING(format, ...)   format
+#define TRACER_FORMAT_VALID(...)                                                                \
+    decltype(TracerFormatTypes(__VA_ARGS__))::Check(TRACER_FORMAT_STRING(__VA_ARGS__, 0))
+
+#ifdef __GNUC__
+#define TRACER_CHECK_FORMAT(...)                                                                \
+    static_assert(!__builtin_constant_p(TRACER_FORMAT_VALID(__VA_ARGS__)) ||                    \
+                  TRACER_FORMAT_VALID(__VA_ARGS__),                                             \
+                  "Tracer format string does not match its arguments")
+#else
+#define TRACER_CHECK_FORMAT(...)
+#endif
+
+
+//
+// call site macros.  The static TracerSite is checked before anything else
+// is done, so a disabled site costs three loads, of its state, of the
+// pointer to the epoch and of the epoch itself, and a branch.  The condition
+// is evaluated next, and the message arguments last, only if the message
+// will be printed or recorded, so
+//
+//      TRACER(true, "Db", 10, "%s", ExpensiveDump());
+//
+// never calls ExpensiveDump() unless group Db is enabled at level 10
+//
+#define TRACER(condition, aGroup, aLevel, ...)                                                  \
+    do {                                                                                        \
+        TRACER_CHECK_FORMAT(__VA_ARGS__);                                                       \
+        if constexpr (TracerCompiledIn(aGroup, aLevel))                                         \
+        {                                                                                       \
+            static TracerSite tracer_site = { aGroup, aLevel, TRACER_SITE_UNCHECKED, 0, 0 };    \
+            if (tracer_site.state.load(std::memory_order_relaxed) != Tracer::SiteDisabled())    \
+            {                                                                                   \
+                Tracer tracer;                                                                  \
+                if (tracer.Open(tracer_site, condition, TRACER_FORMAT_STRING(__VA_ARGS__, 0)))  \
+                    tracer.Announce(__VA_ARGS__);                                               \
+            }                                                                                   \
+        }                                                                                       \
+    } while (0)
+
+#define TRACER_SCOPE(name, condition, aGroup, aLevel, ...)                                      \
+    TRACER_CHECK_FORMAT(__VA_ARGS__);                                                           \
+    TracerScopeType<TracerCompiledIn(aGroup, aLevel)>::type name;                               \
+    if constexpr (TracerCompiledIn(aGroup, aLevel))                                             \
+    {                                                                                           \
+        static TracerSite name##_site = { aGroup, aLevel, TRACER_SITE_UNCHECKED, 0, 0 };        \
+        if ( (name##_site.state.load(std::memory_order_relaxed) != Tracer::SiteDisabled()) &&   \
+             name.Open(name##_site, condition, TRACER_FORMAT_STRING(__VA_ARGS__, 0)) )          \
+            name.Announce(__VA_ARGS__);                                                         \
+    }
+
+
+//
+// a Print() on a Tracer declared with TRACER_SCOPE(), or as a plain Tracer.
+// The condition and arguments are evaluated only if the Tracer is active,
+// and on a site stripped by the compile time floor, the call is discarded
+//
+#define TRACER_PRINT(name, condition, ...)                                                      \
+    do {                                                                                        \
+        TRACER_CHECK_FORMAT(__VA_ARGS__);                                                       \
+        if constexpr (!TracerStubbed<decltype(name)>::value)                                    \
+        {                                                                                       \
+            if ( name.Active() && (condition) )                                                 \
+                name.Print(true, __VA_ARGS__);                                                  \
+        }                                                                                       \
+    } while (0)
+
+
+//
+// the same, limited by its own static TracerLimit
+//
+#define TRACER_PRINT_LIMITED(name, policy, count, condition, ...)                               \
+    do {                                                                                        \
+        TRACER_CHECK_FORMAT(__VA_ARGS__);                                                       \
+        if constexpr (!TracerStubbed<decltype(name)>::value)                                    \
+        {                                                                                       \
+            static TracerLimit name##_limit = { policy, count, 0, 0, 0 };                      \
+            if ( name.Active() && (condition) )                                                 \
+                name.Print(name##_limit, true, __VA_ARGS__);                                    \
+        }                                                                                       \
+    } while (0)
+
+
+
+
+#endif   // __TRACER_H
+
+
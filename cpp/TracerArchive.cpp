@@ -0,0 +1,362 @@
+
+#include "TracerArchive.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef TRACER_ZLIB
+#include <zlib.h>
+#endif
+
+
+//
+// init static variables
+//
+std::atomic<bool>   TracerArchive::running(false);
+
+
+#ifdef TRACER_ZLIB
+
+//
+// a full block, waiting for the writer thread
+//
+struct Full
+{
+    char                           *records;
+    int                             used;
+    TracerArchiveBlock              block;
+    std::string                     names;
+};
+
+
+//
+// the block being filled, and the full ones waiting.  Only touched with
+// 'archivelock' held
+//
+static std::mutex                   archivelock;
+static int                          fd          = -1;
+
+static char                        *records     = 0;        // TRACER_ARCHIVE_BLOCK bytes
+static int                          used        = 0;
+static TracerArchiveBlock           block;
+static std::string                  names;                  // groups first seen in this block
+
+static std::deque<Full>             full;                   // oldest first
+static std::vector<char *>          spare;                  // buffers the writer is done with
+static std::condition_variable      ready;                  // a block is waiting, or stopping
+static std::condition_variable      room;                   // the writer has taken a block
+static bool                         stopping    = false;
+static std::thread                 *writer      = 0;
+
+//
+// where the blocks have gone.  Only touched by the writer thread, and by
+// Start() and Close() while there is none
+//
+static long long                    offset      = 0;        // where the next block goes
+static std::vector<long long>       blocks;                 // offsets of the blocks written
+
+// group numbers, by TracerGroups ID, plus one, and by name for notices,
+// which have no ID
+static std::vector<int>             numbers;
+static std::map<std::string, int>   bynames;
+
+
+//
+// write all of 'data', at the end of the archive
+//
+static bool Put(const void *data, int length)
+{
+    const char *p = (const char *)data;
+    while (length > 0)
+    {
+        ssize_t n = write(fd, p, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        p += n;
+        length -= (int)n;
+        offset += n;
+    }
+    return true;
+}
+
+
+//
+// start a new, empty block
+//
+static void Empty()
+{
+    memset(&block, 0, sizeof(block));
+    memcpy(block.magic, TRACER_ARCHIVE_BLOCKMAGIC, sizeof(block.magic));
+    used = 0;
+    names.clear();
+}
+
+
+//
+// the archive's number for a group, given a number the first time it is
+// seen, and its name added to the block
+//
+static int Number(const TracerRecord& rec)
+{
+    if ( (rec.groupid > 0) && (rec.groupid < (int)numbers.size()) && numbers[rec.groupid] )
+        return numbers[rec.groupid] - 1;
+
+    std::string name(rec.group);
+    auto found = bynames.find(name);
+    int number;
+    if (found != bynames.end())
+        number = found->second;
+    else
+    {
+        number = (int)bynames.size();
+        bynames[name] = number;
+
+        unsigned short header[2] = { (unsigned short)number, (unsigned short)name.length() };
+        names.append((const char *)header, sizeof(header));
+        names.append(name);
+    }
+
+    if (rec.groupid > 0)
+    {
+        if (rec.groupid >= (int)numbers.size())
+            numbers.resize(rec.groupid + 1);
+        numbers[rec.groupid] = number + 1;
+    }
+    return number;
+}
+
+
+//
+// hand the block being filled to the writer thread, and start an empty one
+// in a spare buffer.  Waits, with 'archivelock' released, while
+// TRACER_ARCHIVE_QUEUE blocks are waiting already, so the block being
+// filled may have changed by the time this returns
+//
+static void Hand(std::unique_lock<std::mutex>& guard)
+{
+    room.wait(guard, [] { return full.size() < TRACER_ARCHIVE_QUEUE; });
+    if (block.records == 0)
+        return;
+
+    full.push_back(Full{ records, used, block, std::move(names) });
+    if (spare.empty())
+        records = new char[TRACER_ARCHIVE_BLOCK];
+    else
+    {
+        records = spare.back();
+        spare.pop_back();
+    }
+    Empty();
+    ready.notify_one();
+}
+
+
+//
+// compress a full block, and write it out behind its header
+//
+static void Compress(const Full& done)
+{
+    uLongf size = compressBound(done.used);
+    std::vector<char> compressed(size);
+    if (compress2((Bytef *)compressed.data(), &size, (const Bytef *)done.records, done.used, TRACER_ARCHIVE_LEVEL) != Z_OK)
+        return;
+
+    TracerArchiveBlock header = done.block;
+    header.length = done.used;
+    header.compressed = (int)size;
+    header.names = (int)done.names.length();
+
+    long long start = offset;
+    if ( Put(&header, sizeof(header)) && Put(done.names.data(), (int)done.names.length()) && Put(compressed.data(), (int)size) )
+        blocks.push_back(start);
+}
+
+
+//
+// writer thread.  Compresses and writes each full block, oldest first,
+// until stopped with none left
+//
+static void Writer()
+{
+    std::unique_lock<std::mutex> guard(archivelock);
+    for (;;)
+    {
+        ready.wait(guard, [] { return stopping || !full.empty(); });
+        if (full.empty())
+            break;
+
+        Full done = std::move(full.front());
+        full.pop_front();
+        room.notify_all();
+
+        guard.unlock();
+        Compress(done);
+        guard.lock();
+
+        spare.push_back(done.records);
+    }
+}
+
+#endif
+
+
+//
+// start writing records to the archive
+//
+bool TracerArchive::Start(const char *path)
+{
+#ifdef TRACER_ZLIB
+    if (Running())
+        return true;
+
+    std::lock_guard<std::mutex> guard(archivelock);
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        TracerOutput::Notice("archive", "cannot create TRACEARCHIVE");
+        return false;
+    }
+
+    TracerArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACER_ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = TRACER_ARCHIVE_VERSION;
+    header.pid = (int)getpid();
+    header.created = TracerOutput::Now();
+
+    records = new char[TRACER_ARCHIVE_BLOCK];
+    Empty();
+
+    if (!Put(&header, sizeof(header)))
+    {
+        close(fd);
+        fd = -1;
+        TracerOutput::Notice("archive", "cannot write TRACEARCHIVE");
+        return false;
+    }
+
+    writer = new std::thread(Writer);
+    running.store(true);
+    atexit(Close);
+    return true;
+#else
+    (void)path;
+    TracerOutput::Notice("archive", "TRACEARCHIVE needs a build with TRACER_ZLIB");
+    return false;
+#endif
+}
+
+
+//
+// add one record to the block being filled
+//
+void TracerArchive::Add(const TracerRecord& rec)
+{
+#ifdef TRACER_ZLIB
+    // a message too long for a whole block is truncated
+    int length = rec.length;
+    if (length > TRACER_ARCHIVE_BLOCK - (int)sizeof(TracerArchiveEntry))
+        length = TRACER_ARCHIVE_BLOCK - (int)sizeof(TracerArchiveEntry);
+
+    std::unique_lock<std::mutex> guard(archivelock);
+    while ( (fd >= 0) && !stopping && (used + (int)sizeof(TracerArchiveEntry) + length > TRACER_ARCHIVE_BLOCK) )
+        Hand(guard);
+    if ( (fd < 0) || stopping )
+        return;
+
+    TracerArchiveEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.timestamp = rec.timestamp;
+    entry.serial = rec.serial;
+    entry.level = rec.level;
+    entry.thread = rec.thread;
+    entry.kind = (short)rec.kind;
+    entry.group = (unsigned short)Number(rec);
+    entry.length = length;
+    entry.suppressed = rec.suppressed;
+    entry.depth = rec.depth;
+
+    memcpy(records + used, &entry, sizeof(entry));
+    memcpy(records + used + sizeof(entry), rec.text, length);
+    used += (int)sizeof(entry) + length;
+
+    // widen the ranges in the block header
+    if ( (block.records == 0) || (rec.level < block.minlevel) )
+        block.minlevel = rec.level;
+    if ( (block.records == 0) || (rec.level > block.maxlevel) )
+        block.maxlevel = rec.level;
+    if ( (block.records == 0) || (rec.serial < block.minserial) )
+        block.minserial = rec.serial;
+    if ( (block.records == 0) || (rec.serial > block.maxserial) )
+        block.maxserial = rec.serial;
+    if ( (block.records == 0) || (rec.timestamp < block.mintime) )
+        block.mintime = rec.timestamp;
+    if ( (block.records == 0) || (rec.timestamp > block.maxtime) )
+        block.maxtime = rec.timestamp;
+
+    int bit = (entry.group < TRACER_ARCHIVE_GROUPS) ? entry.group : TRACER_ARCHIVE_GROUPS - 1;
+    block.groups[bit / 64] |= 1ULL << (bit % 64);
+    ++block.records;
+#else
+    (void)rec;
+#endif
+}
+
+
+//
+// hand over the last block, wait for the writer thread to write every
+// block, then write the index, at exit.  Anything traced after that goes
+// to the usual output
+//
+void TracerArchive::Close()
+{
+#ifdef TRACER_ZLIB
+    {
+        std::unique_lock<std::mutex> guard(archivelock);
+        running.store(false);
+        if ( (fd < 0) || stopping )
+            return;
+
+        Hand(guard);
+        stopping = true;
+    }
+    ready.notify_all();
+
+    writer->join();
+    delete writer;
+    writer = 0;
+
+    TracerArchiveIndex index;
+    memset(&index, 0, sizeof(index));
+    index.offset = offset;
+    index.blocks = (int)blocks.size();
+    index.version = TRACER_ARCHIVE_VERSION;
+    memcpy(index.magic, TRACER_ARCHIVE_INDEXMAGIC, sizeof(index.magic));
+
+    Put(blocks.data(), (int)(blocks.size() * sizeof(long long)));
+    Put(&index, sizeof(index));
+
+    std::lock_guard<std::mutex> guard(archivelock);
+    close(fd);
+    fd = -1;
+#endif
+}
@@ -0,0 +1,148 @@
+#ifndef __TRACERARCHIVE_H
+#define __TRACERARCHIVE_H
+
+#include "TracerRecord.h"
+
+#include <atomic>
+
+//
+//    TracerArchive
+//
+//    Writes records to a compressed archive, in place of the usual output,
+//    so that a long capture takes a fraction of the space, and the records
+//    of one group or one stretch of time can be found without reading the
+//    rest.  Records are collected into blocks of TRACER_ARCHIVE_BLOCK bytes,
+//    and each block is compressed with zlib on its own, behind a header
+//    giving the range of times, serial numbers and levels of its records,
+//    and the set of groups they belong to.  The tracer-query tool reads the
+//    headers, and decompresses only the blocks that can hold a match:
+//
+//        tracer-query -g Db -l 1-5 -t 12:00:00-12:05:00 trace.tza
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACEARCHIVE=trace.tza    write records to an archive
+//
+//    The archive starts with a TracerArchiveHeader.  Each block follows as
+//    a TracerArchiveBlock, then the names of the groups first seen in it,
+//    then its compressed records.  At exit an index of the offsets of the
+//    blocks is appended, ending with a TracerArchiveIndex, so a reader can
+//    go straight to each block header.  An archive without the index, from
+//    a process that died, is read by walking the headers from the start.
+//    Only the blocks not yet written are lost; the flight recorder is the
+//    place to look for the records leading up to a crash.
+//
+//    Each record is kept with its time, serial, level, thread and kind,
+//    and its group as a number in the archive's own group table, with the
+//    formatted message.  The archive takes the place of TRACEFILE, and of
+//    TRACEFORMAT and asynchronous output, which don't apply to it.  Records
+//    are added under a lock.  A full block is handed to a writer thread,
+//    which compresses and writes it, while the thread that filled it goes
+//    on with an empty buffer.  It only waits when TRACER_ARCHIVE_QUEUE
+//    blocks are waiting to be written already.
+//
+//    zlib is needed, so the archive is built only with TRACER_ZLIB defined:
+//
+//        g++ -std=c++17 -O2 -pthread -DTRACER_ZLIB -o prog prog.cpp Tracer*.cpp -lz
+//
+//    Without it, TRACEARCHIVE gives a notice, and output goes where it
+//    otherwise would.
+//
+
+#define TRACER_ARCHIVE_MAGIC    "TRACERZ1"
+#define TRACER_ARCHIVE_BLOCKMAGIC "TRZB"
+#define TRACER_ARCHIVE_INDEXMAGIC "TRACERZX"
+#define TRACER_ARCHIVE_VERSION  1
+#define TRACER_ARCHIVE_BLOCK    (1 << 20)   // bytes of records in a block, before compression
+#define TRACER_ARCHIVE_LEVEL    6           // zlib compression level
+#define TRACER_ARCHIVE_QUEUE    2           // full blocks waiting for the writer thread
+#define TRACER_ARCHIVE_GROUPS   256         // groups with a bit of their own in a block's set.
+                                            // Later ones share the last bit
+
+
+//
+// at the start of the archive
+//
+struct TracerArchiveHeader
+{
+    char magic[8];                          // TRACER_ARCHIVE_MAGIC
+    int version;                            // TRACER_ARCHIVE_VERSION
+    int pid;                                // of the writing process
+    long long created;                      // nanoseconds since the epoch
+};
+
+
+//
+// before each block.  The group names are each a 2 byte group number, a
+// 2 byte length, then the characters, numbered from 0 in the order they
+// are first seen
+//
+struct TracerArchiveBlock
+{
+    char magic[4];                          // TRACER_ARCHIVE_BLOCKMAGIC
+    int records;                            // records in the block
+    int length;                             // bytes of records, uncompressed
+    int compressed;                         // bytes of records, compressed
+    int names;                              // bytes of group names that follow
+    int minlevel, maxlevel;
+    int minserial, maxserial;
+    long long mintime, maxtime;             // nanoseconds since the epoch
+    unsigned long long groups[TRACER_ARCHIVE_GROUPS / 64];     // bit n set if
+                                            // group n has records in the block
+};
+
+
+//
+// each record in a block, followed by its message
+//
+struct TracerArchiveEntry
+{
+    long long timestamp;                    // nanoseconds since the epoch
+    int serial;
+    int level;
+    int thread;
+    short kind;                             // TRACER_RECORD_xxx
+    unsigned short group;                   // group number
+    int length;                             // bytes of message
+    int suppressed;                         // as TracerRecord::suppressed
+    int depth;                              // as TracerRecord::depth
+};
+
+
+//
+// at the very end of a finished archive, after the offsets of the blocks
+//
+struct TracerArchiveIndex
+{
+    long long offset;                       // of the first block offset
+    int blocks;                             // block offsets
+    int version;                            // TRACER_ARCHIVE_VERSION
+    char magic[8];                          // TRACER_ARCHIVE_INDEXMAGIC
+};
+
+
+class TracerArchive
+{
+    static std::atomic<bool> running;       // true while records go to the archive
+
+    static void Close();
+
+public:
+
+    // write records to the archive at 'path', from now on.  Returns false,
+    // with a notice, if it can't be created
+    static bool Start(const char *path);
+
+    // are records going to the archive?
+    static bool Running()
+    {
+        return running.load(std::memory_order_relaxed);
+    }
+
+    // add one record, with its formatted message and timestamp set
+    static void Add(const TracerRecord& rec);
+};
+
+
+#endif   // __TRACERARCHIVE_H
@@ -0,0 +1,488 @@
+
+#include "TracerArgs.h"
+#include "TracerFormat.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+
+//
+// one parsed conversion specification
+//
+struct Conversion
+{
+    const char *end;            // just past the conversion character
+    char codes[3];              // argument codes consumed, in order
+    int count;                  // number of codes
+    int wide;                   // non-zero for 8 byte integers
+    char conversion;            // the conversion character
+};
+
+
+//
+// parse one conversion specification, starting just after the '%'.  Returns
+// false if it can't be captured
+//
+static bool ParseConversion(const char *p, Conversion& conv)
+{
+    conv.count = 0;
+    conv.wide = 0;
+
+    // flags
+    while (*p && strchr("-+ #0'", *p))
+        ++p;
+
+    // width
+    if (*p == '*')
+    {
+        conv.codes[conv.count++] = TRACER_ARG_INT;
+        ++p;
+    }
+    else
+    {
+        while ( (*p >= '0') && (*p <= '9') )
+            ++p;
+    }
+
+    // precision
+    if (*p == '.')
+    {
+        ++p;
+        if (*p == '*')
+        {
+            conv.codes[conv.count++] = TRACER_ARG_INT;
+            ++p;
+        }
+        else
+        {
+            while ( (*p >= '0') && (*p <= '9') )
+                ++p;
+        }
+    }
+
+    // length modifier
+    int longs = 0;
+    bool sized = false;
+    bool longdouble = false;
+    for (;;)
+    {
+        if (*p == 'h')
+            ;
+        else if (*p == 'l')
+            ++longs;
+        else if ( (*p == 'j') || (*p == 'z') || (*p == 't') || (*p == 'q') )
+            sized = true;
+        else if (*p == 'L')
+            longdouble = true;
+        else
+            break;
+        ++p;
+    }
+
+    char code;
+    conv.conversion = *p;
+    switch (*p)
+    {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+        if (sized || (longs > 1))
+            code = TRACER_ARG_LONGLONG;
+        else if (longs == 1)
+            code = TRACER_ARG_LONG;
+        else
+            code = TRACER_ARG_INT;
+        conv.wide = (code != TRACER_ARG_INT);
+        break;
+
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        code = longdouble ? TRACER_ARG_LONGDOUBLE : TRACER_ARG_DOUBLE;
+        break;
+
+    case 'c':
+        if (longs)
+            return false;
+        code = TRACER_ARG_INT;
+        break;
+
+    case 's':
+        if (longs)
+            return false;
+        code = TRACER_ARG_STRING;
+        break;
+
+    case 'p':
+        code = TRACER_ARG_POINTER;
+        break;
+
+    default:
+        // %n, %m, wide characters, and anything unknown
+        return false;
+    }
+
+    conv.codes[conv.count++] = code;
+    conv.end = p + 1;
+    return true;
+}
+
+
+//
+// parse a format string into a signature
+//
+int TracerArgs::Parse(const char *format, char *signature)
+{
+    int count = 0;
+
+    for (const char *p = format; *p; )
+    {
+        if (*p++ != '%')
+            continue;
+
+        if (*p == '%')
+        {
+            ++p;
+            continue;
+        }
+
+        Conversion conv;
+        if (!ParseConversion(p, conv) || (count + conv.count > TRACER_MAX_ARGS))
+            return -1;
+
+        for (int i = 0; i < conv.count; i++)
+            signature[count++] = conv.codes[i];
+        p = conv.end;
+    }
+
+    signature[count] = 0;
+    return count;
+}
+
+
+//
+// pack one string, of length 'n', or -1 for a null pointer, truncating it
+// as needed.  Returns the bytes used, or 0 if there is no room
+//
+static int PackString(const char *s, int n, char *buffer, int size)
+{
+    if (size < 2)
+        return 0;
+
+    unsigned short length = 0xffff;
+    if (n >= 0)
+    {
+        if (n > size - 2)
+            n = size - 2;
+        if (n > 0xfffe)
+            n = 0xfffe;
+        length = (unsigned short)n;
+    }
+
+    memcpy(buffer, &length, 2);
+    if (n < 0)
+        return 2;
+
+    memcpy(buffer + 2, s, length);
+    return 2 + length;
+}
+
+
+//
+// pack the arguments described by 'signature'
+//
+int TracerArgs::Pack(const char *signature, va_list arg_list, char *buffer, int size)
+{
+    int used = 0;
+
+    for (const char *code = signature; *code; code++)
+    {
+        if (*code == TRACER_ARG_STRING)
+        {
+            const char *s = va_arg(arg_list, const char *);
+            int n = PackString(s, s ? (int)strnlen(s, 0xfffe) : -1, buffer + used, size - used);
+            if (!n)
+                break;
+            used += n;
+            continue;
+        }
+
+        // everything else has a fixed size
+        if (*code == TRACER_ARG_INT)
+        {
+            int v = va_arg(arg_list, int);
+            if (used + 4 > size)
+                break;
+            memcpy(buffer + used, &v, 4);
+            used += 4;
+        }
+        else
+        {
+            long long i = 0;
+            double d = 0;
+            bool isdouble = false;
+
+            switch (*code)
+            {
+            case TRACER_ARG_LONG:       i = va_arg(arg_list, long);                         break;
+            case TRACER_ARG_LONGLONG:   i = va_arg(arg_list, long long);                    break;
+            case TRACER_ARG_POINTER:    i = (long long)(uintptr_t)va_arg(arg_list, void *); break;
+            case TRACER_ARG_DOUBLE:     d = va_arg(arg_list, double);       isdouble = true; break;
+            case TRACER_ARG_LONGDOUBLE: d = (double)va_arg(arg_list, long double); isdouble = true; break;
+            }
+
+            if (used + 8 > size)
+                break;
+            memcpy(buffer + used, isdouble ? (const void *)&d : (const void *)&i, 8);
+            used += 8;
+        }
+    }
+
+    return used;
+}
+
+
+//
+// pack the arguments described by 'signature' from their captured values.
+// Each must suit its code: an integer wider than 4 bytes, say, can't be
+// packed for %d without changing the message
+//
+int TracerArgs::Pack(const char *signature, const TracerArg *args, int count, char *buffer, int size)
+{
+    if ((int)strlen(signature) != count)
+        return -1;
+
+    int used = 0;
+
+    for (int n = 0; n < count; n++)
+    {
+        const TracerArg& arg = args[n];
+        bool integer = (arg.type == TRACER_VALUE_INT) || (arg.type == TRACER_VALUE_UINT);
+        bool floating = (arg.type == TRACER_VALUE_DOUBLE) || (arg.type == TRACER_VALUE_LONGDOUBLE);
+
+        switch (signature[n])
+        {
+        case TRACER_ARG_STRING:
+            {
+                int length;
+                if (arg.type == TRACER_VALUE_STRING)
+                    length = PackString(arg.s, !arg.s ? -1 : (arg.size >= 0) ? arg.size : (int)strnlen(arg.s, 0xfffe),
+                                        buffer + used, size - used);
+                else if (arg.type == TRACER_VALUE_USER)
+                {
+                    // a user type is formatted now, as its text
+                    char text[TRACER_ARGS_TEXT];
+                    TracerBuffer out(text, sizeof(text));
+                    arg.append(out, arg.p);
+                    length = PackString(text, (out.Length() < (int)sizeof(text)) ? out.Length() : (int)sizeof(text),
+                                        buffer + used, size - used);
+                }
+                else
+                    return -1;
+
+                if (!length)
+                    return used;
+                used += length;
+            }
+            break;
+
+        case TRACER_ARG_INT:
+            {
+                if ( !integer || (arg.size > 4) )
+                    return -1;
+                int v = (int)arg.i;
+                if (used + 4 > size)
+                    return used;
+                memcpy(buffer + used, &v, 4);
+                used += 4;
+            }
+            break;
+
+        case TRACER_ARG_LONG:
+        case TRACER_ARG_LONGLONG:
+        case TRACER_ARG_POINTER:
+        case TRACER_ARG_DOUBLE:
+        case TRACER_ARG_LONGDOUBLE:
+            {
+                long long i = 0;
+                double d = 0;
+
+                if ( (signature[n] == TRACER_ARG_DOUBLE) || (signature[n] == TRACER_ARG_LONGDOUBLE) )
+                {
+                    if (!floating)
+                        return -1;
+                    d = (arg.type == TRACER_VALUE_LONGDOUBLE) ? (double)*arg.ld : arg.d;
+                }
+                else if (signature[n] == TRACER_ARG_POINTER)
+                {
+                    if ( (arg.type != TRACER_VALUE_POINTER) && (arg.type != TRACER_VALUE_STRING) )
+                        return -1;
+                    i = (long long)(uintptr_t)arg.p;
+                }
+                else
+                {
+                    if (!integer)
+                        return -1;
+                    i = arg.i;
+                }
+
+                if (used + 8 > size)
+                    return used;
+                memcpy(buffer + used, floating ? (const void *)&d : (const void *)&i, 8);
+                used += 8;
+            }
+            break;
+
+        default:
+            return -1;
+        }
+    }
+
+    return used;
+}
+
+
+//
+// format a message from a format string and its packed arguments
+//
+int TracerArgs::Format(const char *format, const char *data, int length, char *buffer, int size)
+{
+    int used = 0;
+    int offset = 0;
+
+    // read the next fixed size value from the packed data, or zero past the end
+    #define TRACER_TAKE(var, n)                                                 \
+        do {                                                                    \
+            memset(&var, 0, sizeof(var));                                       \
+            if (offset + n <= length)                                           \
+                memcpy(&var, data + offset, n);                                 \
+            offset += n;                                                        \
+        } while (0)
+
+    for (const char *p = format; *p && (used < size - 1); )
+    {
+        if (*p != '%')
+        {
+            buffer[used++] = *p++;
+            continue;
+        }
+
+        const char *start = p++;
+        if (*p == '%')
+        {
+            buffer[used++] = '%';
+            ++p;
+            continue;
+        }
+
+        Conversion conv;
+        if (!ParseConversion(p, conv))
+        {
+            // copy anything unexpected through as is
+            buffer[used++] = *start;
+            continue;
+        }
+
+        // rebuild the conversion specification, with * widths and precisions
+        // replaced by their values, and the length modifier normalized to
+        // the packed size of the argument
+        char spec[64];
+        int n = 0;
+        int star = 0;
+        for (const char *q = start; (q < conv.end - 1) && (n < (int)sizeof(spec) - 16); q++)
+        {
+            if (*q == '*')
+            {
+                int v;
+                TRACER_TAKE(v, 4);
+                n += snprintf(spec + n, sizeof(spec) - n, "%d", v);
+                ++star;
+            }
+            else if (!strchr("ljztqL", *q))
+                spec[n++] = *q;
+        }
+        if (conv.wide)
+        {
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+        }
+        spec[n++] = conv.conversion;
+        spec[n] = 0;
+
+        int room = size - used;
+        int written = 0;
+        switch (conv.codes[star])
+        {
+        case TRACER_ARG_INT:
+            {
+                int v;
+                TRACER_TAKE(v, 4);
+                written = snprintf(buffer + used, room, spec, v);
+            }
+            break;
+
+        case TRACER_ARG_LONG:
+        case TRACER_ARG_LONGLONG:
+            {
+                long long v;
+                TRACER_TAKE(v, 8);
+                written = snprintf(buffer + used, room, spec, v);
+            }
+            break;
+
+        case TRACER_ARG_DOUBLE:
+        case TRACER_ARG_LONGDOUBLE:
+            {
+                double v;
+                TRACER_TAKE(v, 8);
+                written = snprintf(buffer + used, room, spec, v);
+            }
+            break;
+
+        case TRACER_ARG_POINTER:
+            {
+                long long v;
+                TRACER_TAKE(v, 8);
+                written = snprintf(buffer + used, room, spec, (void *)(uintptr_t)v);
+            }
+            break;
+
+        case TRACER_ARG_STRING:
+            {
+                unsigned short len = 0;
+                if (offset + 2 <= length)
+                    memcpy(&len, data + offset, 2);
+                offset += 2;
+
+                if (len == 0xffff)
+                {
+                    written = snprintf(buffer + used, room, spec, "(null)");
+                }
+                else
+                {
+                    // the packed string is not null terminated, so copy it
+                    char small[256];
+                    int avail = (offset + len <= length) ? len : ((length > offset) ? length - offset : 0);
+                    char *text = (avail < (int)sizeof(small)) ? small : new char[avail + 1];
+                    memcpy(text, data + offset, avail);
+                    text[avail] = 0;
+                    offset += len;
+
+                    written = snprintf(buffer + used, room, spec, text);
+
+                    if (text != small)
+                        delete[] text;
+                }
+            }
+            break;
+        }
+
+        if (written > 0)
+            used += (written < room) ? written : room - 1;
+        p = conv.end;
+    }
+
+    #undef TRACER_TAKE
+
+    buffer[used] = 0;
+    return used;
+}
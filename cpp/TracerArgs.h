@@ -0,0 +1,76 @@
+#ifndef __TRACERARGS_H
+#define __TRACERARGS_H
+
+#include <stdarg.h>
+
+//
+//    TracerArgs
+//
+//    Captures the arguments of a printf style call as raw bytes, so that the
+//    message can be formatted later, possibly in another process.  A format
+//    string is first parsed into a signature, one code per argument it
+//    consumes.  Pack() then pulls each argument off the va_list with its
+//    proper type and stores it, and Format() rebuilds the message from the
+//    format string and the stored bytes.
+//
+//    Signature codes, and their packed layout in host byte order:
+//
+//        TRACER_ARG_INT          int, packed in 4 bytes.  Also used for %c,
+//                                and for * widths and precisions
+//        TRACER_ARG_LONG         long, packed in 8 bytes
+//        TRACER_ARG_LONGLONG     long long, intmax_t, size_t or ptrdiff_t,
+//                                packed in 8 bytes
+//        TRACER_ARG_DOUBLE       double, packed in 8 bytes
+//        TRACER_ARG_LONGDOUBLE   long double, narrowed to an 8 byte double
+//        TRACER_ARG_POINTER      pointer, packed in 8 bytes
+//        TRACER_ARG_STRING       2 byte length, then the characters.  A
+//                                length of 0xffff stands for a null pointer
+//
+//    Formats using %n, or wide character conversions, have no signature and
+//    must be formatted at the call site instead.  So must arguments captured
+//    by the Tracer templates that don't suit their conversion, such as an
+//    8 byte integer for %d.
+//
+
+#define TRACER_ARG_INT          'i'
+#define TRACER_ARG_LONG         'l'
+#define TRACER_ARG_LONGLONG     'L'
+#define TRACER_ARG_DOUBLE       'd'
+#define TRACER_ARG_LONGDOUBLE   'D'
+#define TRACER_ARG_POINTER      'p'
+#define TRACER_ARG_STRING       's'
+
+#define TRACER_MAX_ARGS         32      // most arguments in one signature
+#define TRACER_ARGS_TEXT        256     // longest text packed for a user type
+
+
+struct TracerArg;
+
+
+class TracerArgs
+{
+public:
+
+    // parse a format string into a signature, terminated by a 0.  Returns the
+    // number of arguments, or -1 if the format can't be captured
+    static int Parse(const char *format, char *signature);
+
+    // pack the arguments described by 'signature' into 'buffer'.  Strings are
+    // truncated as needed to fit in 'size' bytes.  Returns the number of
+    // bytes used
+    static int Pack(const char *signature, va_list arg_list, char *buffer, int size);
+
+    // pack arguments captured by the Tracer templates (see TracerFormat.h)
+    // in the same way.  A type with a TracerAppend() overload is packed as
+    // the text it formats to.  Returns -1, having packed nothing useful, if
+    // the arguments don't suit the signature
+    static int Pack(const char *signature, const TracerArg *args, int count, char *buffer, int size);
+
+    // format a message from a format string and its packed arguments.  Returns
+    // the length of the message, which is truncated to fit in 'size' bytes,
+    // including the terminating null
+    static int Format(const char *format, const char *data, int length, char *buffer, int size);
+};
+
+
+#endif   // __TRACERARGS_H
@@ -0,0 +1,536 @@
+
+#include "TracerAsync.h"
+#include "TracerOutput.h"
+#include "TracerFormat.h"
+#include "TracerSocket.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+
+
+//
+// slot kinds for already encoded output, and for a slot given up by a
+// record that turned out too long for it, alongside the TRACER_RECORD_xxx
+// kinds
+//
+#define SLOT_RAW    -1
+#define SLOT_SKIP   -2
+
+
+//
+// one ring slot.  'sequence' is the slot's place in the ring: equal to the
+// position a producer may claim it at, or one past that once the record in
+// it has been published for the writer thread.  It is stored less the
+// slot's index, so the zeroed memory the ring starts as has every slot free
+// for its first lap
+//
+struct Slot
+{
+    std::atomic<unsigned long> sequence;
+    int kind;                   // TRACER_RECORD_xxx, or SLOT_xxx
+    int serial;
+    int groupid;
+    int level;
+    int thread;
+    int depth;
+    int suppressed;
+    long long timestamp;
+    const char *group;          // interned or literal, so the pointer stays valid
+    int length;                 // of the whole text, across every part
+    int parts;                  // slots taken, the text continuing in the ones after
+    char text[TRACER_ASYNC_TEXT];
+};
+
+static_assert(sizeof(Slot) <= TRACER_ASYNC_SLOT, "TRACER_ASYNC_TEXT too large for TRACER_ASYNC_SLOT");
+
+
+//
+// init static variables
+//
+std::atomic<bool>   TracerAsync::running(false);
+
+
+//
+// ring state.  Producers share 'tail', the writer thread alone owns 'head',
+// so they are kept on separate cache lines
+//
+static Slot                         *ring       = 0;
+static unsigned long                 mask       = 0;
+static int                           policy     = TRACER_OVERFLOW_DROP;
+alignas(64) static std::atomic<unsigned long> tail(0);
+alignas(64) static unsigned long     head       = 0;
+static std::atomic<unsigned long>    written(0);
+static std::atomic<unsigned long>    dropped(0);
+static unsigned long                 reported   = 0;
+static std::atomic<bool>             stopping(false);
+static std::atomic<bool>             writing(false);     // the writer thread exists, for Flush()
+static std::thread                  *writer     = 0;
+static bool                          registered = false;
+
+
+//
+// read and set a slot's sequence, stored less the slot's index
+//
+static unsigned long Sequence(const Slot *slot, std::memory_order order)
+{
+    return slot->sequence.load(order) + (unsigned long)(slot - ring);
+}
+
+static void SetSequence(Slot *slot, unsigned long sequence)
+{
+    slot->sequence.store(sequence - (unsigned long)(slot - ring), std::memory_order_release);
+}
+
+
+//
+// start the writer thread
+//
+void TracerAsync::Start(unsigned slots, int overflow)
+{
+    if (writer)
+        return;
+
+    // the ring is allocated once, and kept even after Stop(), in case a
+    // producer that raced with Stop() is still finishing with a slot.  It
+    // is allocated zeroed, which marks every slot free, so a large ring
+    // comes straight from the kernel, and its pages are only touched as
+    // records first reach them
+    if (!ring)
+    {
+        unsigned long size = 2;
+        while (size < slots)
+            size <<= 1;
+
+        ring = (Slot *)calloc(size, sizeof(Slot));
+        if (!ring)
+            return;
+        mask = size - 1;
+    }
+
+    policy = overflow;
+    stopping.store(false);
+    running.store(true);
+    writing.store(true);
+    writer = new std::thread(Writer);
+
+    // make sure whatever is left in the ring gets written at exit
+    if (!registered)
+    {
+        registered = true;
+        atexit(Stop);
+    }
+}
+
+
+//
+// write everything in the ring, then stop the writer thread
+//
+void TracerAsync::Stop()
+{
+    if (!writer)
+        return;
+
+    // new records go straight to stderr from here on
+    running.store(false);
+    stopping.store(true);
+
+    writer->join();
+    delete writer;
+    writer = 0;
+
+    // pick up anything pushed by a producer that saw 'running' just before
+    // it was cleared
+    Drain();
+    if (TracerSocket::Running())
+        TracerSocket::Flush();
+    writing.store(false);
+}
+
+
+//
+// wait until every record pushed so far has been written
+//
+void TracerAsync::Flush()
+{
+    unsigned long target = tail.load(std::memory_order_acquire);
+    while (writing.load() && (written.load(std::memory_order_acquire) < target))
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+
+//
+// claim a run of 'parts' free slots, applying the overflow policy if the
+// ring is full, and return the first.  Returns 0 if the record was dropped,
+// or if the writer thread stopped while waiting for a slot
+//
+static Slot *Claim(int parts = 1)
+{
+    unsigned long pos = tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        // the writer thread hands slots back in order, so the run is free
+        // once its last slot is
+        unsigned long last = pos + parts - 1;
+        long diff = (long)(Sequence(&ring[last & mask], std::memory_order_acquire) - last);
+
+        if (diff == 0)
+        {
+            // the run is free at this position; try to take it
+            if (tail.compare_exchange_weak(pos, pos + parts, std::memory_order_relaxed))
+                return &ring[pos & mask];
+        }
+        else if (diff < 0)
+        {
+            // the ring is full
+            if ( (policy == TRACER_OVERFLOW_DROP) || !TracerAsync::Running() )
+                return 0;
+
+            std::this_thread::yield();
+            pos = tail.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            // another producer took this position first
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+//
+// fill in the record header and hand the slot to the writer thread
+//
+static void Publish(Slot *slot, const TracerRecord& rec)
+{
+    slot->kind = rec.kind;
+    slot->serial = rec.serial;
+    slot->groupid = rec.groupid;
+    slot->level = rec.level;
+    slot->thread = rec.thread;
+    slot->depth = rec.depth;
+    slot->suppressed = rec.suppressed;
+    slot->timestamp = rec.timestamp;
+    slot->group = rec.group;
+
+    SetSequence(slot, Sequence(slot, std::memory_order_relaxed) + 1);
+}
+
+
+//
+// give up a slot taken for a record that turned out too long for it.  The
+// writer thread passes over it
+//
+static void Skip(Slot *slot)
+{
+    slot->kind = SLOT_SKIP;
+    slot->length = 0;
+    slot->parts = 1;
+
+    SetSequence(slot, Sequence(slot, std::memory_order_relaxed) + 1);
+}
+
+
+//
+// queue 'length' characters of text in a run of as many slots as it needs,
+// with the header from 'rec', or as already encoded output if 'rec' is 0.
+// A message is truncated to TRACER_ASYNC_LONGEST characters, or to what the
+// ring holds, but encoded output can't be.  Returns false if the output is
+// too long, or if the writer thread is not running
+//
+static bool Queue(const TracerRecord *rec, const char *text, int length, long long timestamp)
+{
+    int longest = TRACER_ASYNC_LONGEST;
+    if ((unsigned long)longest > (mask + 1) * TRACER_ASYNC_TEXT)
+        longest = (int)((mask + 1) * TRACER_ASYNC_TEXT);
+    if (length > longest)
+    {
+        if (!rec)
+            return false;
+        length = longest;
+    }
+
+    int parts = (length > TRACER_ASYNC_TEXT) ? (length + TRACER_ASYNC_TEXT - 1) / TRACER_ASYNC_TEXT : 1;
+    Slot *slot = Claim(parts);
+    if (!slot)
+    {
+        if (!TracerAsync::Running())
+            return false;
+
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // the parts after the first are published before it, so the writer
+    // thread finds the whole text once it sees the first
+    unsigned long pos = Sequence(slot, std::memory_order_relaxed);
+    for (int part = 0; part < parts; part++)
+    {
+        Slot& next = ring[(pos + part) & mask];
+        int offset = part * TRACER_ASYNC_TEXT;
+        memcpy(next.text, text + offset, (length - offset < TRACER_ASYNC_TEXT) ? length - offset : TRACER_ASYNC_TEXT);
+        if (part > 0)
+            SetSequence(&next, pos + part + 1);
+    }
+    slot->length = length;
+    slot->parts = parts;
+
+    if (rec)
+    {
+        Publish(slot, *rec);
+        return true;
+    }
+
+    slot->kind = SLOT_RAW;
+    slot->timestamp = timestamp;
+    SetSequence(slot, pos + 1);
+    return true;
+}
+
+
+//
+// queue a record, formatting the message directly into the ring slot
+//
+bool TracerAsync::Push(const TracerRecord& rec, const char *format, va_list arg_list)
+{
+    if (!running.load(std::memory_order_relaxed))
+        return false;
+
+    Slot *slot = Claim();
+    if (!slot)
+    {
+        if (!running.load(std::memory_order_relaxed))
+            return false;
+
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    va_list arg_copy;
+    va_copy(arg_copy, arg_list);
+
+    int length = vsnprintf(slot->text, sizeof(slot->text), format, arg_list);
+    if (length < 0)
+        length = 0;
+
+    if (length < (int)sizeof(slot->text))
+    {
+        slot->length = length;
+        slot->parts = 1;
+        Publish(slot, rec);
+    }
+    else
+    {
+        // too long for one slot, so this one goes out empty, and the whole
+        // message follows it in a run of slots
+        char *text = new char[length + 1];
+        vsnprintf(text, length + 1, format, arg_copy);
+        Skip(slot);
+        if (!Queue(&rec, text, length, 0))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        delete[] text;
+    }
+    va_end(arg_copy);
+    return true;
+}
+
+
+//
+// queue a record, formatting captured arguments directly into the ring slot
+//
+bool TracerAsync::Push(const TracerRecord& rec, const char *format, const TracerArg *args, int count)
+{
+    if (!running.load(std::memory_order_relaxed))
+        return false;
+
+    Slot *slot = Claim();
+    if (!slot)
+    {
+        if (!running.load(std::memory_order_relaxed))
+            return false;
+
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    TracerBuffer out(slot->text, sizeof(slot->text));
+    TracerFormat::Format(out, format, args, count);
+
+    int length = out.Length();
+    if (length <= (int)sizeof(slot->text))
+    {
+        slot->length = length;
+        slot->parts = 1;
+        Publish(slot, rec);
+    }
+    else
+    {
+        // as above, a message too long for one slot follows it in a run
+        char *text = new char[length];
+        TracerBuffer all(text, length);
+        TracerFormat::Format(all, format, args, count);
+        Skip(slot);
+        if (!Queue(&rec, text, length, 0))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        delete[] text;
+    }
+    return true;
+}
+
+
+//
+// queue a record, copying its text
+//
+bool TracerAsync::Push(const TracerRecord& rec)
+{
+    if (!running.load(std::memory_order_relaxed))
+        return false;
+
+    return Queue(&rec, rec.text, rec.length, 0);
+}
+
+
+//
+// queue already encoded output
+//
+bool TracerAsync::Push(const char *data, int length, long long timestamp)
+{
+    if (!running.load(std::memory_order_relaxed))
+        return false;
+
+    return Queue(0, data, length, timestamp);
+}
+
+
+//
+// number of records dropped because the ring was full
+//
+unsigned long TracerAsync::Dropped()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+
+//
+// writer thread.  Write whatever is in the ring, then nap when it is
+// empty.  When stopping, keep going until every claimed slot has been
+// published and written
+//
+void TracerAsync::Writer()
+{
+    int idle = 0;
+
+    for (;;)
+    {
+        if (Drain() > 0)
+        {
+            idle = 0;
+        }
+        else if (stopping.load())
+        {
+            if (head == tail.load())
+                break;
+
+            std::this_thread::yield();
+        }
+        else
+        {
+            // back off from 100us up to 5ms while there is nothing to write
+            if (idle < 50)
+                ++idle;
+            std::this_thread::sleep_for(std::chrono::microseconds(100 * idle));
+        }
+    }
+}
+
+
+//
+// format every published record into a batch buffer, and write the batch
+// to stderr when it fills up, or when the ring is empty.  When sending to
+// tracerd, each line is handed to the socket batch instead.  Returns the
+// number of records written
+//
+int TracerAsync::Drain()
+{
+    static char batch[65536];
+    static char joined[TRACER_ASYNC_LONGEST];
+    int used = 0;
+    int count = 0;
+
+    for (;;)
+    {
+        Slot& slot = ring[head & mask];
+        if (Sequence(&slot, std::memory_order_acquire) != head + 1)
+            break;
+
+        // a long text is put back together from the slots it spans
+        const char *text = slot.text;
+        int length = slot.length;
+        int parts = slot.parts;
+        if (parts > 1)
+        {
+            for (int part = 0; part < parts; part++)
+            {
+                int offset = part * TRACER_ASYNC_TEXT;
+                memcpy(joined + offset, ring[(head + part) & mask].text, (length - offset < TRACER_ASYNC_TEXT) ? length - offset : TRACER_ASYNC_TEXT);
+            }
+            text = joined;
+        }
+
+        // make sure there is room for the line, allowing for every character
+        // of the message to be escaped as JSON.  A line too long for even an
+        // empty batch is truncated by Format()
+        int room = (slot.kind == SLOT_RAW) ? length : 8 * length + TRACER_ASYNC_SLOT;
+        if ( used && (used + room > (int)sizeof(batch)) )
+        {
+            TracerOutput::Write(batch, used);
+            used = 0;
+        }
+
+        if (slot.kind == SLOT_RAW)
+            memcpy(batch + used, text, length);
+        else if (slot.kind == SLOT_SKIP)
+            length = 0;
+        else
+        {
+            TracerRecord rec = { slot.kind, slot.serial, slot.groupid, slot.level, slot.thread, slot.timestamp, slot.group, text, length, slot.depth, -1, slot.suppressed };
+            length = TracerOutput::Format(rec, batch + used, (int)sizeof(batch) - used);
+        }
+
+        if ( length && TracerSocket::Running() )
+            TracerSocket::Add(slot.timestamp, batch + used, length);
+        else
+            used += length;
+
+        // hand the slots back to the producers, one lap further on, and in
+        // order, as Claim() relies on
+        for (int part = 0; part < parts; part++)
+            SetSequence(&ring[(head + part) & mask], head + part + mask + 1);
+        head += parts;
+        ++count;
+    }
+
+    if (used)
+        TracerOutput::Write(batch, used);
+
+    // the socket batch goes out when it is full, or once the ring has been
+    // empty for a while
+    if ( !count && TracerSocket::Running() )
+        TracerSocket::Idle();
+
+    // report any records dropped since the last batch
+    unsigned long total = dropped.load(std::memory_order_relaxed);
+    if (total != reported)
+    {
+        char notice[64];
+        snprintf(notice, sizeof(notice), "%lu records dropped", total - reported);
+        TracerOutput::Notice("async", notice);
+        reported = total;
+    }
+
+    written.store(head, std::memory_order_release);
+    return count;
+}
@@ -0,0 +1,103 @@
+#ifndef __TRACERASYNC_H
+#define __TRACERASYNC_H
+
+#include "TracerRecord.h"
+
+#include <stdarg.h>
+#include <atomic>
+
+struct TracerArg;
+
+//
+//    TracerAsync
+//
+//    Optional asynchronous output for Tracer.  When running, a Tracer formats
+//    its message straight into a slot of a bounded, lock-free, multi-producer
+//    ring buffer and returns; a background writer thread takes records from
+//    the ring, formats the Tracer: [serial][group, level] lines, and writes
+//    them to stderr in batches.  The -exit- lines from ~Tracer go through the
+//    same ring, so output order per thread is preserved.
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACEASYNC=TRUE           turn on asynchronous output
+//        TRACEASYNCSIZE=65536      number of slots in the ring (rounded up to
+//                                  a power of 2)
+//        TRACEOVERFLOW=DROP        when the ring is full, drop the record and
+//                                  count it.  The count is reported by the
+//                                  writer thread.  This is the default
+//        TRACEOVERFLOW=BLOCK       when the ring is full, wait for a free slot
+//
+//    or from code, with Start() and Stop().  The ring is allocated zeroed
+//    when the writer thread first starts, so its pages are only touched as
+//    records reach them, rather than all at once.  Records still in the
+//    ring are always written at exit, or by Flush().  A message, or a line
+//    encoded by the caller, too long for one slot takes a run of slots, so
+//    a long line keeps its place without waiting for the writer thread.
+//    Messages longer than TRACER_ASYNC_LONGEST characters are truncated in
+//    asynchronous mode.
+//
+//    The writer thread uses std::thread, so link with -pthread.
+//
+
+#define TRACER_OVERFLOW_DROP    0
+#define TRACER_OVERFLOW_BLOCK   1
+
+#define TRACER_ASYNC_SLOTS      65536   // default ring size
+#define TRACER_ASYNC_SLOT       256     // bytes per ring slot
+#define TRACER_ASYNC_TEXT       (TRACER_ASYNC_SLOT - 64)
+#define TRACER_ASYNC_LONGEST    16384   // longest message or line, across slots
+
+
+class TracerAsync
+{
+    static std::atomic<bool> running;   // true while the writer thread accepts records
+
+    static void Writer();
+    static int Drain();
+
+public:
+
+    // start the writer thread, with a ring of 'slots' records and the given
+    // TRACER_OVERFLOW_xxx policy.  Does nothing if already running
+    static void Start(unsigned slots, int overflow);
+
+    // write everything in the ring, then stop the writer thread.  Called
+    // automatically at exit
+    static void Stop();
+
+    // wait until every record pushed so far has been written.  Safe to call
+    // from any thread, even while another is stopping the writer
+    static void Flush();
+
+    // is the writer thread accepting records?
+    static bool Running()
+    {
+        return running.load(std::memory_order_relaxed);
+    }
+
+    // queue a record.  The message is formatted from 'format' and 'arg_list'
+    // directly into the ring slot, and the record text is ignored.  Returns
+    // false, without touching 'arg_list', if the record could not be queued
+    // because the writer thread is not running
+    static bool Push(const TracerRecord& rec, const char *format, va_list arg_list);
+
+    // queue a record, formatting the message from arguments captured by the
+    // Tracer templates directly into the ring slot
+    static bool Push(const TracerRecord& rec, const char *format, const TracerArg *args, int count);
+
+    // queue a record, copying its text
+    static bool Push(const TracerRecord& rec);
+
+    // queue already encoded output, written as is, with the time of its
+    // record, if it has one.  Returns false if the writer thread is not
+    // running, or if the data is longer than TRACER_ASYNC_LONGEST
+    static bool Push(const char *data, int length, long long timestamp = 0);
+
+    // number of records dropped because the ring was full
+    static unsigned long Dropped();
+};
+
+
+#endif   // __TRACERASYNC_H
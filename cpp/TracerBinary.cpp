@@ -0,0 +1,305 @@
+
+#include "TracerBinary.h"
+#include "TracerArgs.h"
+#include "TracerFormat.h"
+#include "TracerGroups.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+
+
+//
+// possible values for FormatSlot::state
+//
+#define FORMAT_EMPTY        0
+#define FORMAT_FILLING      1
+#define FORMAT_READY        2
+
+
+//
+// one registered format string.  Slots are claimed with a compare and swap
+// on 'state', and never change once they are ready, so lookups take no lock
+//
+struct FormatSlot
+{
+    std::atomic<int> state;                 // FORMAT_xxx
+    unsigned hash;                          // hash of the format string
+    int id;                                 // format ID, 0 if the arguments can't be packed
+    char *copy;                             // private copy of the format string
+    char signature[TRACER_MAX_ARGS + 1];    // see TracerArgs.h
+};
+
+
+//
+// format and group registries
+//
+static FormatSlot               formats[TRACER_MAX_FORMATS];
+static std::atomic<int>         formatcount(0);
+static std::atomic<bool>        groupsent[TRACER_MAX_GROUPS + 1];
+
+
+//
+// write an entry header.  Returns its length
+//
+static int EntryHeader(char *buffer, char type, int length)
+{
+    unsigned short n = (unsigned short)length;
+
+    buffer[0] = type;
+    buffer[1] = 0;
+    memcpy(buffer + 2, &n, 2);
+    return TRACER_ENTRY_HEADER;
+}
+
+
+//
+// write the serial, group ID, level, thread, timestamp and depth shared by
+// the record entries.  Returns their length
+//
+static int EntryCommon(char *buffer, const TracerRecord& rec)
+{
+    memcpy(buffer, &rec.serial, 4);
+    memcpy(buffer + 4, &rec.groupid, 4);
+    memcpy(buffer + 8, &rec.level, 4);
+    memcpy(buffer + 12, &rec.thread, 4);
+    memcpy(buffer + 16, &rec.timestamp, 8);
+    memcpy(buffer + 24, &rec.depth, 4);
+    return TRACER_BINARY_COMMON;
+}
+
+
+//
+// write the count of suppressed calls that goes with a record
+//
+static void Suppressed(const TracerRecord& rec)
+{
+    char buffer[TRACER_ENTRY_HEADER + TRACER_BINARY_COMMON + 4];
+
+    int used = TRACER_ENTRY_HEADER;
+    used += EntryCommon(buffer + used, rec);
+    memcpy(buffer + used, &rec.suppressed, 4);
+    used += 4;
+
+    EntryHeader(buffer, TRACER_ENTRY_SUPPRESSED, used - TRACER_ENTRY_HEADER);
+    TracerOutput::Send(buffer, used);
+}
+
+
+//
+// write a group or format definition
+//
+static void Define(char type, int id, const char *name)
+{
+    int length = (int)strlen(name);
+    if (length > 0xffff - 4)
+        length = 0xffff - 4;
+
+    char small[256];
+    int size = TRACER_ENTRY_HEADER + 4 + length;
+    char *buffer = (size <= (int)sizeof(small)) ? small : new char[size];
+
+    EntryHeader(buffer, type, 4 + length);
+    memcpy(buffer + TRACER_ENTRY_HEADER, &id, 4);
+    memcpy(buffer + TRACER_ENTRY_HEADER + 4, name, length);
+    TracerOutput::Send(buffer, size);
+
+    if (buffer != small)
+        delete[] buffer;
+}
+
+
+//
+// find the slot for a format string, registering it the first time it is
+// seen.  Format strings are matched by content, not by address, since a
+// format passed as a char* may be a reused buffer.  Returns 0 if the table
+// is full
+//
+static const FormatSlot *Register(const char *format)
+{
+    unsigned h = 2166136261u;
+    for (const char *p = format; *p; p++)
+    {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+
+    unsigned index = h & (TRACER_MAX_FORMATS - 1);
+    for (int probes = 0; probes < TRACER_MAX_FORMATS; )
+    {
+        FormatSlot& slot = formats[index];
+        int state = slot.state.load(std::memory_order_acquire);
+
+        if (state == FORMAT_EMPTY)
+        {
+            int expected = FORMAT_EMPTY;
+            if (!slot.state.compare_exchange_strong(expected, FORMAT_FILLING))
+                continue;
+
+            // this thread owns the slot; fill it in and define the format
+            slot.hash = h;
+            slot.copy = new char[strlen(format) + 1];
+            strcpy(slot.copy, format);
+            slot.id = (TracerArgs::Parse(format, slot.signature) >= 0) ? ++formatcount : 0;
+            if (slot.id)
+                Define(TRACER_ENTRY_FORMAT, slot.id, slot.copy);
+
+            slot.state.store(FORMAT_READY, std::memory_order_release);
+            return &slot;
+        }
+
+        if (state == FORMAT_FILLING)
+        {
+            // another thread is filling this slot; wait for it
+            std::this_thread::yield();
+            continue;
+        }
+
+        if ( (slot.hash == h) && (0 == strcmp(slot.copy, format)) )
+            return &slot;
+
+        index = (index + 1) & (TRACER_MAX_FORMATS - 1);
+        ++probes;
+    }
+
+    return 0;
+}
+
+
+//
+// define the group of a message record, the first time it is used, and
+// write its count of suppressed calls
+//
+static void Prepare(const TracerRecord& rec)
+{
+    if ( (rec.groupid > 0) && (rec.groupid <= TRACER_MAX_GROUPS) && !groupsent[rec.groupid].exchange(true) )
+        Define(TRACER_ENTRY_GROUP, rec.groupid, rec.group);
+
+    if (rec.suppressed)
+        Suppressed(rec);
+}
+
+
+//
+// encode and write one message record
+//
+void TracerBinary::Message(const TracerRecord& rec, const char *format, va_list arg_list)
+{
+    char buffer[TRACER_BINARY_ENTRY];
+    int size = (int)sizeof(buffer);
+
+    Prepare(rec);
+
+    int used = TRACER_ENTRY_HEADER;
+    const FormatSlot *slot = Register(format);
+
+    if (slot && slot->id)
+    {
+        // the usual case: the format ID, and the raw arguments
+        memcpy(buffer + used, &slot->id, 4);
+        used += 4;
+        used += EntryCommon(buffer + used, rec);
+        used += TracerArgs::Pack(slot->signature, arg_list, buffer + used, size - used);
+        EntryHeader(buffer, TRACER_ENTRY_MESSAGE, used - TRACER_ENTRY_HEADER);
+    }
+    else
+    {
+        // the arguments can't be packed, so format the message here
+        used += EntryCommon(buffer + used, rec);
+        int length = vsnprintf(buffer + used, size - used, format, arg_list);
+        if (length < 0)
+            length = 0;
+        used += (length < size - used) ? length : size - used - 1;
+        EntryHeader(buffer, TRACER_ENTRY_TEXT, used - TRACER_ENTRY_HEADER);
+    }
+
+    TracerOutput::Send(buffer, used);
+}
+
+
+//
+// encode and write one message record, from captured arguments
+//
+void TracerBinary::Message(const TracerRecord& rec, const char *format, const TracerArg *args, int count)
+{
+    char buffer[TRACER_BINARY_ENTRY];
+    int size = (int)sizeof(buffer);
+
+    Prepare(rec);
+
+    int used = TRACER_ENTRY_HEADER;
+    const FormatSlot *slot = Register(format);
+
+    if (slot && slot->id)
+    {
+        // the usual case: the format ID, and the raw arguments
+        memcpy(buffer + used, &slot->id, 4);
+        used += 4;
+        used += EntryCommon(buffer + used, rec);
+
+        int packed = TracerArgs::Pack(slot->signature, args, count, buffer + used, size - used);
+        if (packed >= 0)
+        {
+            used += packed;
+            EntryHeader(buffer, TRACER_ENTRY_MESSAGE, used - TRACER_ENTRY_HEADER);
+            TracerOutput::Send(buffer, used);
+            return;
+        }
+
+        used = TRACER_ENTRY_HEADER;
+    }
+
+    // the arguments can't be packed, so format the message here
+    used += EntryCommon(buffer + used, rec);
+    TracerBuffer out(buffer + used, size - used);
+    TracerFormat::Format(out, format, args, count);
+    used += (out.Length() < size - used) ? out.Length() : size - used;
+    EntryHeader(buffer, TRACER_ENTRY_TEXT, used - TRACER_ENTRY_HEADER);
+
+    TracerOutput::Send(buffer, used);
+}
+
+
+//
+// encode and write one exit record
+//
+void TracerBinary::Exit(const TracerRecord& rec)
+{
+    char buffer[TRACER_ENTRY_HEADER + TRACER_BINARY_COMMON + 8];
+
+    if (rec.suppressed)
+        Suppressed(rec);
+
+    int used = TRACER_ENTRY_HEADER;
+    used += EntryCommon(buffer + used, rec);
+
+    // the elapsed time is only present in timing mode
+    if (rec.elapsed >= 0)
+    {
+        memcpy(buffer + used, &rec.elapsed, 8);
+        used += 8;
+    }
+
+    EntryHeader(buffer, TRACER_ENTRY_EXIT, used - TRACER_ENTRY_HEADER);
+    TracerOutput::Send(buffer, used);
+}
+
+
+//
+// encode a record with already formatted text as a text entry
+//
+int TracerBinary::Text(const TracerRecord& rec, char *buffer, int size)
+{
+    int used = TRACER_ENTRY_HEADER;
+    used += EntryCommon(buffer + used, rec);
+
+    int length = (rec.length < size - used) ? rec.length : size - used;
+    memcpy(buffer + used, rec.text, length);
+    used += length;
+
+    EntryHeader(buffer, TRACER_ENTRY_TEXT, used - TRACER_ENTRY_HEADER);
+    return used;
+}
@@ -0,0 +1,92 @@
+#ifndef __TRACERBINARY_H
+#define __TRACERBINARY_H
+
+#include "TracerRecord.h"
+
+#include <stdarg.h>
+
+struct TracerArg;
+
+//
+//    TracerBinary
+//
+//    The binary trace log, selected with TRACEFORMAT=BINARY.  Instead of
+//    formatting each message with vfprintf, a Tracer records only the ID of
+//    its format string, its serial, group ID, level, a timestamp, and the raw
+//    bytes of its arguments (see TracerArgs.h).  Each format string and group
+//    name is written to the log once, the first time it is used.  The
+//    tracer-decode tool rebuilds the familiar text lines offline:
+//
+//        export TRACEFORMAT=BINARY
+//        export TRACEFILE=trace.bin
+//        ./myprogram
+//        tracer-decode trace.bin
+//
+//    File layout, in host byte order.  The file starts with the 8 characters
+//    TRACER_BINARY_MAGIC, followed by entries.  Every entry starts with a 4
+//    byte header
+//
+//        1 byte      entry type, TRACER_ENTRY_xxx
+//        1 byte      reserved, 0
+//        2 bytes     length of the rest of the entry
+//
+//    followed by
+//
+//        TRACER_ENTRY_GROUP      4 byte group ID, group name
+//        TRACER_ENTRY_FORMAT     4 byte format ID, format string
+//        TRACER_ENTRY_MESSAGE    4 byte format ID, TRACER_BINARY_COMMON,
+//                                packed arguments
+//        TRACER_ENTRY_TEXT       TRACER_BINARY_COMMON, formatted message.  Used
+//                                for formats whose arguments can't be packed,
+//                                and, with group ID 0, for notices from the
+//                                Tracer machinery itself
+//        TRACER_ENTRY_EXIT       TRACER_BINARY_COMMON, and in timing mode an
+//                                8 byte elapsed time in nanoseconds
+//        TRACER_ENTRY_SUPPRESSED TRACER_BINARY_COMMON, 4 byte count of limited
+//                                Print() calls suppressed.  Written just before
+//                                the message or exit entry it belongs to
+//
+//    where TRACER_BINARY_COMMON is a 4 byte serial, 4 byte group ID, 4 byte
+//    level, 4 byte thread ID, 8 byte timestamp in nanoseconds since the
+//    epoch, and 4 byte nesting depth.  Names and strings are not null
+//    terminated.  A group or format may be defined after the first entry
+//    that uses it, when written from several threads.
+//
+
+#define TRACER_BINARY_MAGIC     "TRACERB1"
+
+#define TRACER_ENTRY_GROUP      'G'
+#define TRACER_ENTRY_FORMAT     'F'
+#define TRACER_ENTRY_MESSAGE    'M'
+#define TRACER_ENTRY_TEXT       'T'
+#define TRACER_ENTRY_EXIT       'X'
+#define TRACER_ENTRY_SUPPRESSED 'S'
+
+#define TRACER_ENTRY_HEADER     4
+#define TRACER_BINARY_COMMON    28
+
+#define TRACER_BINARY_ENTRY     1024    // longest entry; long strings are truncated
+#define TRACER_MAX_FORMATS      4096    // distinct format strings, a power of 2
+
+
+class TracerBinary
+{
+public:
+
+    // encode and write one message record
+    static void Message(const TracerRecord& rec, const char *format, va_list arg_list);
+
+    // encode and write one message record, from arguments captured by the
+    // Tracer templates
+    static void Message(const TracerRecord& rec, const char *format, const TracerArg *args, int count);
+
+    // encode and write one exit record
+    static void Exit(const TracerRecord& rec);
+
+    // encode a record with already formatted text as a text entry, into
+    // 'buffer'.  Returns the entry length
+    static int Text(const TracerRecord& rec, char *buffer, int size);
+};
+
+
+#endif   // __TRACERBINARY_H
@@ -0,0 +1,354 @@
+
+#include "TracerCoalesce.h"
+#include "TracerOutput.h"
+#include "TracerFormat.h"
+#include "TracerArgs.h"
+
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+
+
+//
+// init static variables
+//
+bool        TracerCoalesce::running = false;
+
+// nanoseconds between counts of a run that goes on
+static long long window = TRACER_COALESCE_WINDOW * 1000000LL;
+
+
+//
+// the last message a thread printed, and the run of repeats of it.  Only
+// the thread itself compares messages and counts repeats.  The count may
+// also be written by the timer thread, once the run has gone on for the
+// window, so it is taken with an exchange, and 'lock' is held while it is
+// written, and while a new run is started
+//
+struct CoalesceRun
+{
+    bool last;                  // is the thread's last printed message hashed?
+    uint64_t hash;              // of the last message's site and arguments
+    bool listed;                // is the run in the timer's list?
+
+    std::mutex lock;
+    std::atomic<int> repeats;   // counted since the message, or the last count
+    std::atomic<int> serial;    // of the last repeat
+    long long started;          // monotonic time of the first of those repeats
+    TracerRecord rec;           // the first of them, for the count line.  The
+                                // group name is interned or literal, so the
+                                // pointer stays valid
+
+    CoalesceRun()
+        : last(false), hash(0), listed(false), repeats(0), serial(0), started(0), rec()
+    {
+    }
+
+    ~CoalesceRun();
+};
+
+static thread_local CoalesceRun run;
+
+
+//
+// the runs of all threads, for the timer.  Never destroyed, so a thread
+// exiting late in the life of the process can still leave it
+//
+static std::mutex                   listlock;
+static std::set<CoalesceRun *>     *runs        = new std::set<CoalesceRun *>;
+
+// timer thread state
+static std::mutex                   timerlock;
+static std::condition_variable      wakeup;
+static bool                         stopping    = false;
+static std::thread                 *timer       = 0;
+
+
+//
+// write the count of a run, if there is one.  Called with the run's lock
+// held, by its thread or the timer
+//
+static void Count(CoalesceRun& r)
+{
+    int repeats = r.repeats.exchange(0, std::memory_order_acquire);
+    if (!repeats)
+        return;
+
+    TracerRecord rec = r.rec;
+    rec.serial = r.serial.load(std::memory_order_relaxed);
+    rec.kind = TRACER_RECORD_MESSAGE;
+    rec.timestamp = 0;
+    rec.elapsed = -1;
+    rec.suppressed = 0;
+
+    TracerArg list[] = { TracerMakeArg(repeats), TracerArg() };
+    TracerOutput::Message(rec, "last message repeated %d times", list, 1);
+}
+
+
+//
+// a thread leaving takes its run out of the list, waiting for the timer to
+// be done with it, then writes its count
+//
+CoalesceRun::~CoalesceRun()
+{
+    if (listed)
+    {
+        std::lock_guard<std::mutex> guard(listlock);
+        runs->erase(this);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    Count(*this);
+}
+
+
+//
+// timer thread.  Writes the count of any run that has gone on for the
+// window, several times a window, so a count is never held much longer
+// than that, whether or not its thread prints again
+//
+static void Timer()
+{
+    long long tick = window / 4;
+    if (tick < 1000000LL)
+        tick = 1000000LL;
+
+    std::unique_lock<std::mutex> sleeping(timerlock);
+    while (!stopping)
+    {
+        wakeup.wait_for(sleeping, std::chrono::nanoseconds(tick));
+        if (stopping)
+            break;
+
+        long long now = TracerOutput::Monotonic();
+        std::lock_guard<std::mutex> guard(listlock);
+        for (CoalesceRun *r : *runs)
+        {
+            if (r->repeats.load(std::memory_order_relaxed) == 0)
+                continue;
+
+            std::lock_guard<std::mutex> held(r->lock);
+            if (now - r->started >= window)
+                Count(*r);
+        }
+    }
+}
+
+
+//
+// stop the timer at exit, and write the counts of threads still running
+//
+static void Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(timerlock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+
+    if (timer)
+    {
+        timer->join();
+        delete timer;
+        timer = 0;
+    }
+
+    std::lock_guard<std::mutex> guard(listlock);
+    for (CoalesceRun *r : *runs)
+    {
+        std::lock_guard<std::mutex> held(r->lock);
+        Count(*r);
+    }
+}
+
+
+//
+// turn on collapsing
+//
+void TracerCoalesce::Start(int milliseconds)
+{
+    if (running)
+        return;
+
+    if (milliseconds > 0)
+        window = milliseconds * 1000000LL;
+    running = true;
+
+    timer = new std::thread(Timer);
+    atexit(Stop);
+}
+
+
+//
+// fold 'length' bytes into a hash, FNV-1a style
+//
+static uint64_t Mix(uint64_t h, const void *data, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+static uint64_t Mix(uint64_t h, uint64_t value)
+{
+    return Mix(h, &value, sizeof(value));
+}
+
+
+//
+// hash a message's site
+//
+static uint64_t Site(const TracerRecord& rec, const char *format)
+{
+    // the format is hashed by address, as statistics mode keys its sites
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = Mix(h, (uint64_t)(uintptr_t)format);
+    h = Mix(h, ((uint64_t)(unsigned)rec.groupid << 32) | (unsigned)rec.level);
+    if (!rec.groupid)
+        h = Mix(h, (uint64_t)(uintptr_t)rec.group);     // a group that didn't fit in the table
+    return Mix(h, ((uint64_t)(unsigned)rec.kind << 32) | (unsigned)rec.depth);
+}
+
+
+//
+// hash a message by its site and argument values.  Returns false if the
+// message can't be hashed whole, so can never be taken for a repeat
+//
+static bool Hash(const TracerRecord& rec, const char *format, const TracerArg *args, int count, uint64_t& h)
+{
+    h = Site(rec, format);
+
+    for (int i = 0; i < count; i++)
+    {
+        const TracerArg& arg = args[i];
+        h = Mix(h, ((uint64_t)(unsigned)arg.type << 32) | (unsigned)arg.size);
+        h = Mix(h, (uint64_t)(uintptr_t)arg.key);
+
+        switch (arg.type)
+        {
+            case TRACER_VALUE_DOUBLE:
+                h = Mix(h, &arg.d, sizeof(arg.d));
+                break;
+
+            case TRACER_VALUE_LONGDOUBLE:
+            {
+                // only the value bytes, not the padding
+                double value = (double)*arg.ld;
+                h = Mix(h, &value, sizeof(value));
+                break;
+            }
+
+            case TRACER_VALUE_STRING:
+                if (arg.s)
+                    h = Mix(h, arg.s, (arg.size >= 0) ? (size_t)arg.size : strlen(arg.s));
+                else
+                    h = Mix(h, 0xffffULL);
+                break;
+
+            case TRACER_VALUE_USER:
+            {
+                // a user type is only known by the text it formats to
+                char text[TRACER_ARGS_TEXT];
+                TracerBuffer out(text, sizeof(text));
+                arg.append(out, arg.p);
+                if (out.Length() > (int)sizeof(text))
+                    return false;
+                h = Mix(h, text, out.Length());
+                break;
+            }
+
+            default:
+                h = Mix(h, (uint64_t)arg.i);
+                break;
+        }
+    }
+
+    return true;
+}
+
+
+//
+// is a message with hash 'h' a repeat of the last one this thread printed?
+//
+static bool Repeat(const TracerRecord& rec, bool hashed, uint64_t h)
+{
+    // the start of a Chrome span must always be written, and a count of
+    // suppressed calls is news in itself
+    bool repeat = hashed && run.last && (h == run.hash) && (rec.suppressed == 0) &&
+                  ( (rec.kind == TRACER_RECORD_MESSAGE) || (TracerOutput::Mode() != TRACER_FORMAT_CHROME) );
+
+    if (repeat)
+    {
+        // the first repeat starts the run, and puts it in the timer's list
+        if (run.repeats.load(std::memory_order_relaxed) == 0)
+        {
+            if (!run.listed)
+            {
+                std::lock_guard<std::mutex> guard(listlock);
+                runs->insert(&run);
+                run.listed = true;
+            }
+
+            std::lock_guard<std::mutex> guard(run.lock);
+            run.started = TracerOutput::Monotonic();
+            run.rec = rec;
+        }
+
+        run.serial.store(rec.serial, std::memory_order_relaxed);
+        run.repeats.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    TracerCoalesce::Flush();
+
+    // a message that can't be hashed starts no run
+    run.last = hashed;
+    run.hash = h;
+    return false;
+}
+
+
+//
+// is a message a repeat of the last one this thread printed?
+//
+bool TracerCoalesce::Repeat(const TracerRecord& rec, const char *format, const TracerArg *args, int count)
+{
+    uint64_t h;
+    bool hashed = Hash(rec, format, args, count, h);
+    return ::Repeat(rec, hashed, h);
+}
+
+
+//
+// the same, for a message known only by its formatted text
+//
+bool TracerCoalesce::Repeat(const TracerRecord& rec, const char *format, const char *text, int length)
+{
+    uint64_t h = Site(rec, format);
+    if (text)
+        h = Mix(h, text, length);
+    return ::Repeat(rec, text != 0, h);
+}
+
+
+//
+// write the count of this thread's run, if there is one, and end it
+//
+void TracerCoalesce::Flush()
+{
+    run.last = false;
+    if (run.repeats.load(std::memory_order_relaxed) == 0)
+        return;
+
+    std::lock_guard<std::mutex> guard(run.lock);
+    Count(run);
+}
@@ -0,0 +1,90 @@
+#ifndef __TRACERCOALESCE_H
+#define __TRACERCOALESCE_H
+
+#include "TracerRecord.h"
+
+struct TracerArg;
+
+//
+//    TracerCoalesce
+//
+//    Collapses runs of repeated messages, such as those from a retry or poll
+//    loop.  A message is a repeat when the one before it on the same thread
+//    came from the same call site, with the same arguments.  The first of a
+//    run is printed as usual, the repeats are only counted, and once the run
+//    ends a single line gives the count:
+//
+//        Tracer: [812][Net, 10] Waiting for connection on port 8080
+//        Tracer: [4711][Net, 10] last message repeated 3898 times
+//        Tracer: [4712][Net, 5] Connected
+//
+//    The count line carries the serial of the last repeat.  A site is a
+//    format string, group and level, as for statistics mode, and a message
+//    is compared by a hash of the site and the argument values, so the
+//    repeats are never formatted.  A message whose arguments come as a
+//    va_list, such as one from the C trace() or from Python, can't be taken
+//    apart that way, so it is formatted, and compared by a hash of its
+//    text; one longer than TRACER_COALESCE_TEXT characters is never taken
+//    for a repeat.
+//
+//    A run ends when its thread prints anything else, including the -exit-
+//    line of a Tracer or the start of a Chrome span, when the thread exits,
+//    or at exit, and the count is written ahead of whatever ended it.  A
+//    timer thread also writes the count of any run that has gone on for the
+//    window, so a thread that repeats itself for a long time still shows it,
+//    and one that goes quiet after a burst of repeats doesn't hold the count
+//    back.
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACECOALESCE=TRUE        collapse repeats, writing the count of a
+//                                  run at least every TRACER_COALESCE_WINDOW
+//                                  milliseconds
+//        TRACECOALESCE=250         ... at least every 250 milliseconds
+//
+//    Each thread keeps its own run, so counting a repeat takes no lock; a
+//    lock of the thread's own is taken only to start a run and to write its
+//    count, so the timer never writes a count twice.  Only
+//    printed messages are collapsed; the flight recorder still keeps every
+//    one.  In the Chrome format the start of a span is never collapsed, as
+//    its end would be left without it.
+//
+
+#define TRACER_COALESCE_WINDOW  1000    // milliseconds, by default
+#define TRACER_COALESCE_TEXT    1024    // longest formatted message compared
+
+
+class TracerCoalesce
+{
+    static bool running;        // true once Start() is called
+
+public:
+
+    // collapse repeats, writing the count of a run at least every 'window'
+    // milliseconds
+    static void Start(int window);
+
+    // is collapsing on?
+    static bool Running()
+    {
+        return running;
+    }
+
+    // is a message about to be printed a repeat of the last one printed by
+    // this thread?  If so it is counted, and should not be printed.  If not,
+    // the count of any run it ends is written first
+    static bool Repeat(const TracerRecord& rec, const char *format, const TracerArg *args, int count);
+
+    // the same, for a message known only by its formatted 'text', or that
+    // can't be compared, if 'text' is 0
+    static bool Repeat(const TracerRecord& rec, const char *format, const char *text, int length);
+
+    // write the count of this thread's run now, if there is one, and end
+    // the run.  Called before this thread prints anything that doesn't go
+    // through Repeat()
+    static void Flush();
+};
+
+
+#endif   // __TRACERCOALESCE_H
@@ -0,0 +1,208 @@
+
+#include "TracerControl.h"
+#include "Tracer.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <chrono>
+
+
+//
+// watcher state
+//
+static std::string                  path;
+static int                          interval    = TRACER_CONTROL_POLL;
+static struct timespec              modified;   // of the file when last loaded
+static off_t                        size        = -1;
+static std::atomic<bool>            hangup(false);
+static std::atomic<bool>            stopping(false);
+static std::thread                 *watcher     = 0;
+static bool                         registered  = false;
+static bool                         caught      = false;    // SIGHUP handler installed
+static struct sigaction             previous;   // the SIGHUP handler before ours
+
+
+//
+// start the watcher thread
+//
+void TracerControl::Start(const char *aPath, int poll)
+{
+    if (watcher || !aPath)
+        return;
+
+    path = aPath;
+    interval = (poll > 0) ? poll : TRACER_CONTROL_POLL;
+    Load();
+
+    // the handler only sets a flag; the watcher thread does the reload.
+    // It stays installed after Stop(), so it is only installed once
+    if (!caught)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = Hangup;
+        action.sa_flags = SA_RESTART | SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGHUP, &action, &previous);
+        caught = true;
+    }
+
+    stopping.store(false);
+    watcher = new std::thread(Watcher);
+
+    if (!registered)
+    {
+        registered = true;
+        atexit(Stop);
+    }
+}
+
+
+//
+// stop the watcher thread
+//
+void TracerControl::Stop()
+{
+    if (!watcher)
+        return;
+
+    stopping.store(true);
+    watcher->join();
+    delete watcher;
+    watcher = 0;
+}
+
+
+//
+// SIGHUP handler.  Only async signal safe work is allowed here.  Passes the
+// signal on to the program's own handler, if it had one; the default action
+// would end the process, so it is not taken
+//
+void TracerControl::Hangup(int signal, siginfo_t *info, void *context)
+{
+    hangup.store(true, std::memory_order_relaxed);
+
+    if (previous.sa_flags & SA_SIGINFO)
+        previous.sa_sigaction(signal, info, context);
+    else if ( (previous.sa_handler != SIG_DFL) && (previous.sa_handler != SIG_IGN) )
+        previous.sa_handler(signal);
+}
+
+
+//
+// watcher thread.  Wakes every 100ms for a SIGHUP, and checks the file
+// every 'interval' milliseconds
+//
+void TracerControl::Watcher()
+{
+    const int tick = 100;
+    int waited = 0;
+
+    while (!stopping.load())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(tick));
+        waited += tick;
+
+        if (hangup.exchange(false))
+        {
+            Load();
+            waited = 0;
+        }
+        else if (waited >= interval)
+        {
+            waited = 0;
+
+            struct stat st;
+            if ( (stat(path.c_str(), &st) == 0) &&
+                 ((st.st_mtim.tv_sec != modified.tv_sec) || (st.st_mtim.tv_nsec != modified.tv_nsec) || (st.st_size != size)) )
+                Load();
+        }
+    }
+}
+
+
+//
+// copy the value of a NAME=value line into 'value', without trailing
+// white space.  Returns false if the line is not for 'name'
+//
+static bool Setting(const char *line, const char *name, char *value, int valuesize)
+{
+    int length = (int)strlen(name);
+    if ( (0 != strncmp(line, name, length)) || (line[length] != '=') )
+        return false;
+
+    const char *start = line + length + 1;
+    const char *end = start + strlen(start);
+    while ( (end > start) && ((end[-1] == ' ') || (end[-1] == '\t') || (end[-1] == '\r')) )
+        --end;
+
+    length = (int)(end - start);
+    if (length >= valuesize)
+        length = valuesize - 1;
+    memcpy(value, start, length);
+    value[length] = 0;
+    return true;
+}
+
+
+//
+// read the control file, and install its settings
+//
+bool TracerControl::Load()
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(file, &st) == 0)
+    {
+        modified = st.st_mtim;
+        size = st.st_size;
+    }
+
+    char text[TRACER_CONTROL_SIZE];
+    int length = 0;
+    int n;
+    while ( (length < (int)sizeof(text) - 1) && ((n = (int)read(file, text + length, sizeof(text) - 1 - length)) > 0) )
+        length += n;
+    close(file);
+    text[length] = 0;
+
+    // defaults are the same as for missing environment variables
+    char groups[TRACER_CONTROL_SIZE] = "";
+    char value[64];
+    int level = 0;
+    bool only = false;
+
+    char *save = 0;
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(0, "\n", &save))
+    {
+        while ( (*line == ' ') || (*line == '\t') )
+            ++line;
+
+        if (Setting(line, "TRACEGROUP", groups, sizeof(groups)))
+            continue;
+        if (Setting(line, "TRACELEVEL", value, sizeof(value)))
+            level = atoi(value);
+        else if (Setting(line, "TRACEONLY", value, sizeof(value)))
+            only = Tracer::EnvTrue(value);
+    }
+
+    Tracer::Apply(groups, level, only);
+
+    char notice[TRACER_CONTROL_SIZE + 64];
+    snprintf(notice, sizeof(notice), "TRACEGROUP=%s TRACELEVEL=%d TRACEONLY=%s", groups, level, only ? "TRUE" : "FALSE");
+    TracerOutput::Notice("control", notice);
+    return true;
+}
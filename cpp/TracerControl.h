@@ -0,0 +1,64 @@
+#ifndef __TRACERCONTROL_H
+#define __TRACERCONTROL_H
+
+#include <signal.h>
+
+//
+//    TracerControl
+//
+//    Optional live reconfiguration for Tracer.  A control file holds the
+//    same settings as the environment, one per line:
+//
+//        # turn on the database groups while we look at this
+//        TRACEGROUP=Db:20,DbPool
+//        TRACELEVEL=5
+//        TRACEONLY=FALSE
+//
+//    It is read when the Tracer environment is first checked, replacing the
+//    TRACEGROUP, TRACELEVEL and TRACEONLY variables, and read again whenever
+//    it changes, or when the process gets a SIGHUP.  A setting missing from
+//    the file takes its default, just as for a missing environment variable.
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACECONTROL=/path/file   the control file to watch
+//        TRACECONTROLPOLL=1000     how often to check it for changes, in
+//                                  milliseconds
+//
+//    The file is watched by a background thread, which also does the work
+//    for a SIGHUP, since the signal handler itself only sets a flag.  New
+//    settings are installed by Tracer::Configure(), which programs may also
+//    call directly.  SIGHUP is only caught when TRACECONTROL is set, and a
+//    handler the program installed before that is still called, from
+//    Tracer's, after the flag is set.  One installed later replaces
+//    Tracer's, and should call it in turn.
+//
+//    The watcher thread uses std::thread, so link with -pthread.
+//
+
+#define TRACER_CONTROL_POLL     1000    // default milliseconds between checks
+#define TRACER_CONTROL_SIZE     4096    // longest control file read
+
+
+class TracerControl
+{
+    static void Watcher();
+    static void Hangup(int signal, siginfo_t *info, void *context);
+
+    // read the control file, and install its settings
+    static bool Load();
+
+public:
+
+    // load the control file at 'path', then start the watcher thread,
+    // checking the file every 'poll' milliseconds.  Does nothing if already
+    // running
+    static void Start(const char *path, int poll);
+
+    // stop the watcher thread.  Called automatically at exit
+    static void Stop();
+};
+
+
+#endif   // __TRACERCONTROL_H
@@ -0,0 +1,547 @@
+
+#include "TracerFormat.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include <charconv>
+
+
+//
+// append text, as much as fits
+//
+void TracerBuffer::Append(const char *text, int n)
+{
+    if (n <= 0)
+        return;
+
+    if (length < size)
+        memcpy(data + length, text, (n < size - length) ? n : size - length);
+    length += n;
+}
+
+
+void TracerBuffer::Append(const char *text)
+{
+    Append(text, (int)strlen(text));
+}
+
+
+//
+// append 'n' copies of a character
+//
+void TracerBuffer::Fill(char c, int n)
+{
+    if (n <= 0)
+        return;
+
+    if (length < size)
+        memset(data + length, c, (n < size - length) ? n : size - length);
+    length += n;
+}
+
+
+//
+// pad the text written since 'start' out to 'width'.  For right alignment
+// the text is moved along, keeping whatever part of it still fits
+//
+void TracerBuffer::Pad(int start, int width, bool left)
+{
+    int n = length - start;
+    int pad = width - n;
+    if (pad <= 0)
+        return;
+
+    if (left)
+    {
+        Fill(' ', pad);
+        return;
+    }
+
+    // move the visible part of the text right by 'pad', from the end
+    int end = (start + width < size) ? start + width : size;
+    for (int i = end - 1; i >= start + pad; i--)
+        data[i] = data[i - pad];
+    for (int i = start; (i < start + pad) && (i < size); i++)
+        data[i] = ' ';
+    length += pad;
+}
+
+
+//
+// one parsed conversion specification
+//
+struct Spec
+{
+    bool left;                  // '-' flag
+    bool plus;                  // '+' flag
+    bool space;                 // ' ' flag
+    bool alt;                   // '#' flag
+    bool zero;                  // '0' flag
+    int width;
+    int precision;              // -1 if not given
+    int size;                   // bytes given by the length modifier, 0 if none
+    char conversion;
+};
+
+
+//
+// write a number made up of a prefix (sign, 0x), leading zeros and digits,
+// padded out to the field width
+//
+static void Number(TracerBuffer& out, const Spec& spec, const char *prefix, int zeros,
+                   const char *digits, int ndigits, bool zeropad)
+{
+    int prefixlength = (int)strlen(prefix);
+    int pad = spec.width - prefixlength - zeros - ndigits;
+
+    if ( (pad > 0) && !spec.left && !(zeropad && spec.zero) )
+        out.Fill(' ', pad);
+    out.Append(prefix, prefixlength);
+    if ( (pad > 0) && !spec.left && zeropad && spec.zero )
+        out.Fill('0', pad);
+    out.Fill('0', zeros);
+    out.Append(digits, ndigits);
+    if ( (pad > 0) && spec.left )
+        out.Fill(' ', pad);
+}
+
+
+//
+// the value of an integer argument, cut to 'size' bytes
+//
+static unsigned long long Unsigned(long long value, int size)
+{
+    switch (size)
+    {
+    case 1:     return (unsigned char)value;
+    case 2:     return (unsigned short)value;
+    case 4:     return (unsigned int)value;
+    default:    return (unsigned long long)value;
+    }
+}
+
+static long long Signed(long long value, int size)
+{
+    switch (size)
+    {
+    case 1:     return (signed char)value;
+    case 2:     return (short)value;
+    case 4:     return (int)value;
+    default:    return value;
+    }
+}
+
+
+//
+// %d %i %u %o %x %X and %c
+//
+static void Integer(TracerBuffer& out, const Spec& spec, const TracerArg& arg)
+{
+    int size = spec.size ? spec.size : arg.size;
+
+    if (spec.conversion == 'c')
+    {
+        char c = (char)arg.i;
+        int start = out.Length();
+        out.Put(c);
+        out.Pad(start, spec.width, spec.left);
+        return;
+    }
+
+    bool negative = false;
+    unsigned long long magnitude;
+    int base = 10;
+
+    // as for printf, the value is taken as signed or unsigned according to
+    // the conversion, at the size of the argument or of the length modifier
+    if ( (spec.conversion == 'd') || (spec.conversion == 'i') )
+    {
+        long long v = Signed(arg.i, size);
+        negative = (v < 0);
+        magnitude = negative ? 0 - (unsigned long long)v : (unsigned long long)v;
+    }
+    else
+    {
+        magnitude = Unsigned(arg.i, size);
+        if (spec.conversion == 'o')
+            base = 8;
+        else if (spec.conversion != 'u')
+            base = 16;
+    }
+
+    char digits[32];
+    int ndigits = 0;
+    if ( (magnitude != 0) || (spec.precision != 0) )
+        ndigits = (int)(std::to_chars(digits, digits + sizeof(digits), magnitude, base).ptr - digits);
+    if (spec.conversion == 'X')
+    {
+        for (int i = 0; i < ndigits; i++)
+            digits[i] = (char)toupper((unsigned char)digits[i]);
+    }
+
+    int zeros = (spec.precision > ndigits) ? spec.precision - ndigits : 0;
+
+    char prefix[4] = "";
+    int n = 0;
+    if (negative)
+        prefix[n++] = '-';
+    else if ( ((spec.conversion == 'd') || (spec.conversion == 'i')) && (spec.plus || spec.space) )
+        prefix[n++] = spec.plus ? '+' : ' ';
+
+    if (spec.alt)
+    {
+        if ( (spec.conversion == 'o') && (zeros == 0) && ((ndigits == 0) || (digits[0] != '0')) )
+            zeros = 1;
+        else if ( ((spec.conversion == 'x') || (spec.conversion == 'X')) && (magnitude != 0) )
+        {
+            prefix[n++] = '0';
+            prefix[n++] = spec.conversion;
+        }
+    }
+    prefix[n] = 0;
+
+    // a precision turns off zero padding, as for printf
+    Number(out, spec, prefix, zeros, digits, ndigits, spec.precision < 0);
+}
+
+
+//
+// format a floating point value with snprintf, for the cases to_chars does
+// not cover
+//
+static void Printf(TracerBuffer& out, const Spec& spec, const TracerArg& arg)
+{
+    char format[32];
+    int n = 0;
+    format[n++] = '%';
+    if (spec.left)  format[n++] = '-';
+    if (spec.plus)  format[n++] = '+';
+    if (spec.space) format[n++] = ' ';
+    if (spec.alt)   format[n++] = '#';
+    if (spec.zero)  format[n++] = '0';
+    n += snprintf(format + n, sizeof(format) - n, "%d", spec.width);
+    if (spec.precision >= 0)
+        n += snprintf(format + n, sizeof(format) - n, ".%d", spec.precision);
+    if (arg.type == TRACER_VALUE_LONGDOUBLE)
+        format[n++] = 'L';
+    format[n++] = spec.conversion;
+    format[n] = 0;
+
+    char small[128];
+    int length = (arg.type == TRACER_VALUE_LONGDOUBLE) ? snprintf(small, sizeof(small), format, *arg.ld)
+                                                       : snprintf(small, sizeof(small), format, arg.d);
+    if (length < (int)sizeof(small))
+    {
+        out.Append(small, length);
+        return;
+    }
+
+    char *text = new char[length + 1];
+    if (arg.type == TRACER_VALUE_LONGDOUBLE)
+        snprintf(text, length + 1, format, *arg.ld);
+    else
+        snprintf(text, length + 1, format, arg.d);
+    out.Append(text, length);
+    delete[] text;
+}
+
+
+//
+// %f %F %e %E %g %G %a %A
+//
+static void Float(TracerBuffer& out, const Spec& spec, const TracerArg& arg)
+{
+    // the alternate forms are rare enough to leave to printf
+    if (spec.alt)
+    {
+        Printf(out, spec, arg);
+        return;
+    }
+
+    bool longdouble = (arg.type == TRACER_VALUE_LONGDOUBLE);
+    long double value = longdouble ? *arg.ld : (long double)arg.d;
+    bool negative = signbit(value);
+    if (negative)
+        value = -value;
+
+    std::chars_format style = std::chars_format::general;
+    char lower = (char)tolower((unsigned char)spec.conversion);
+    if (lower == 'f')
+        style = std::chars_format::fixed;
+    else if (lower == 'e')
+        style = std::chars_format::scientific;
+    else if (lower == 'a')
+        style = std::chars_format::hex;
+
+    char digits[128];
+    std::to_chars_result result;
+    if ( (style == std::chars_format::hex) && (spec.precision < 0) )
+        result = longdouble ? std::to_chars(digits, digits + sizeof(digits), value, style)
+                            : std::to_chars(digits, digits + sizeof(digits), (double)value, style);
+    else
+    {
+        int precision = (spec.precision < 0) ? 6 : spec.precision;
+        result = longdouble ? std::to_chars(digits, digits + sizeof(digits), value, style, precision)
+                            : std::to_chars(digits, digits + sizeof(digits), (double)value, style, precision);
+    }
+
+    // very large fixed point values don't fit; printf copes with those
+    if (result.ec != std::errc())
+    {
+        Printf(out, spec, arg);
+        return;
+    }
+
+    int ndigits = (int)(result.ptr - digits);
+    if (isupper((unsigned char)spec.conversion))
+    {
+        for (int i = 0; i < ndigits; i++)
+            digits[i] = (char)toupper((unsigned char)digits[i]);
+    }
+
+    char prefix[4] = "";
+    int n = 0;
+    if (negative)
+        prefix[n++] = '-';
+    else if (spec.plus || spec.space)
+        prefix[n++] = spec.plus ? '+' : ' ';
+    if ( (lower == 'a') && isfinite(value) )
+    {
+        prefix[n++] = '0';
+        prefix[n++] = (spec.conversion == 'A') ? 'X' : 'x';
+    }
+    prefix[n] = 0;
+
+    // infinities and NaNs are padded with spaces, not zeros
+    Number(out, spec, prefix, 0, digits, ndigits, isfinite(value));
+}
+
+
+//
+// %s
+//
+static void String(TracerBuffer& out, const Spec& spec, const TracerArg& arg)
+{
+    int start = out.Length();
+
+    if (arg.type == TRACER_VALUE_USER)
+    {
+        arg.append(out, arg.p);
+        if (spec.precision >= 0)
+            out.Truncate(start + spec.precision);
+    }
+    else
+    {
+        const char *s = arg.s ? arg.s : "(null)";
+        int n;
+        if ( arg.s && (arg.size >= 0) )
+            n = arg.size;
+        else if (spec.precision >= 0)
+            n = (int)strnlen(s, spec.precision);
+        else
+            n = (int)strlen(s);
+
+        if ( (spec.precision >= 0) && (n > spec.precision) )
+            n = spec.precision;
+        out.Append(s, n);
+    }
+
+    out.Pad(start, spec.width, spec.left);
+}
+
+
+//
+// %p
+//
+static void Pointer(TracerBuffer& out, const Spec& spec, const TracerArg& arg)
+{
+    int start = out.Length();
+
+    if (!arg.p)
+        out.Append("(nil)");
+    else
+    {
+        char digits[32];
+        int ndigits = (int)(std::to_chars(digits, digits + sizeof(digits), (uintptr_t)arg.p, 16).ptr - digits);
+        out.Append("0x", 2);
+        out.Append(digits, ndigits);
+    }
+
+    out.Pad(start, spec.width, spec.left);
+}
+
+
+//
+// format one argument.  An argument that doesn't suit the conversion is
+// formatted the natural way for its own type instead
+//
+static void Value(TracerBuffer& out, Spec spec, const TracerArg& arg)
+{
+    char natural;
+    switch (arg.type)
+    {
+    case TRACER_VALUE_INT:          natural = 'd'; break;
+    case TRACER_VALUE_UINT:         natural = 'u'; break;
+    case TRACER_VALUE_DOUBLE:
+    case TRACER_VALUE_LONGDOUBLE:   natural = 'g'; break;
+    case TRACER_VALUE_POINTER:      natural = 'p'; break;
+    default:                        natural = 's'; break;
+    }
+
+    switch (spec.conversion)
+    {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+        if ( (natural == 'd') || (natural == 'u') )
+            return Integer(out, spec, arg);
+        break;
+
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        if (natural == 'g')
+            return Float(out, spec, arg);
+        break;
+
+    case 's':
+        if (natural == 's')
+            return String(out, spec, arg);
+        break;
+
+    case 'p':
+        if ( (natural == 'p') || (arg.type == TRACER_VALUE_STRING) )
+            return Pointer(out, spec, arg);
+        break;
+    }
+
+    spec.conversion = natural;
+    spec.size = 0;
+    spec.precision = -1;
+    Value(out, spec, arg);
+}
+
+
+//
+// format a message from a format string and its captured arguments,
+// followed by any fields
+//
+void TracerFormat::Format(TracerBuffer& out, const char *format, const TracerArg *args, int count)
+{
+    int arguments = Arguments(args, count);
+    Message(out, format, args, arguments);
+
+    for (int n = arguments; n < count; n++)
+    {
+        if (!args[n].key)
+            continue;
+
+        out.Put(' ');
+        out.Append(args[n].key);
+        out.Put('=');
+        Field(out, args[n]);
+    }
+}
+
+
+//
+// format the value of a field
+//
+void TracerFormat::Field(TracerBuffer& out, const TracerArg& arg)
+{
+    Spec spec = { false, false, false, false, false, 0, -1, 0, 0 };
+    Value(out, spec, arg);
+}
+
+
+//
+// format a message alone
+//
+void TracerFormat::Message(TracerBuffer& out, const char *format, const TracerArg *args, int count)
+{
+    int next = 0;
+    const char *p = format;
+
+    while (*p)
+    {
+        // copy the text up to the next conversion in one go
+        const char *percent = strchr(p, '%');
+        if (!percent)
+        {
+            out.Append(p);
+            return;
+        }
+        out.Append(p, (int)(percent - p));
+
+        const char *start = percent;
+        p = percent + 1;
+        if (*p == '%')
+        {
+            out.Put('%');
+            ++p;
+            continue;
+        }
+
+        Spec spec = { false, false, false, false, false, 0, -1, 0, 0 };
+        for ( ; ; ++p)
+        {
+            if (*p == '-')          spec.left = true;
+            else if (*p == '+')     spec.plus = true;
+            else if (*p == ' ')     spec.space = true;
+            else if (*p == '#')     spec.alt = true;
+            else if (*p == '0')     spec.zero = true;
+            else if (*p == '\'')    ;
+            else                    break;
+        }
+
+        if (*p == '*')
+        {
+            spec.width = (next < count) ? (int)args[next++].i : 0;
+            if (spec.width < 0)
+            {
+                spec.left = true;
+                spec.width = -spec.width;
+            }
+            ++p;
+        }
+        while ( (*p >= '0') && (*p <= '9') )
+            spec.width = spec.width * 10 + (*p++ - '0');
+
+        if (*p == '.')
+        {
+            spec.precision = 0;
+            if (*++p == '*')
+            {
+                spec.precision = (next < count) ? (int)args[next++].i : -1;
+                if (spec.precision < 0)
+                    spec.precision = -1;
+                ++p;
+            }
+            while ( (*p >= '0') && (*p <= '9') )
+                spec.precision = spec.precision * 10 + (*p++ - '0');
+        }
+
+        for ( ; ; ++p)
+        {
+            if (*p == 'h')          spec.size = (spec.size == 2) ? 1 : 2;
+            else if (*p == 'l')     spec.size = 8;
+            else if ( (*p == 'j') || (*p == 'z') || (*p == 't') || (*p == 'q') )
+                                    spec.size = 8;
+            else if (*p == 'L')     ;
+            else                    break;
+        }
+
+        spec.conversion = *p;
+        if ( !*p || !strchr("diuoxXcfFeEgGaAsp", *p) || (next >= count) )
+        {
+            // copy anything unexpected, or without an argument, through as is
+            out.Append(start, (int)(p - start) + (*p ? 1 : 0));
+            if (*p)
+                ++p;
+            continue;
+        }
+        ++p;
+
+        Value(out, spec, args[next++]);
+    }
+}
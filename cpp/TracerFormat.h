@@ -0,0 +1,431 @@
+#ifndef __TRACERFORMAT_H
+#define __TRACERFORMAT_H
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+//
+//    TracerFormat
+//
+//    Type safe formatting for the Tracer template overloads.  The format
+//    strings are the familiar printf ones, but the arguments keep their C++
+//    types: each is captured as a TracerArg, and formatted according to what
+//    it really is, so a mismatched argument can never crash the program.
+//    Numbers are formatted with std::to_chars, which does not consult the
+//    locale, into the caller's stack buffer.
+//
+//    When the format string is a literal, the TRACER() family of macros also
+//    checks it against the argument types at compile time:
+//
+//        %d %i %u %o %x %X %c    integer, bool or enum
+//        %f %F %e %E %g %G %a %A floating point
+//        %s                      char *, std::string, std::string_view, or a
+//                                type with a TracerAppend() overload
+//        %p                      any pointer
+//
+//    Length modifiers are accepted but not needed, since the size of each
+//    argument is known.  %n is not supported.
+//
+//    Other types are formatted with %s by a TracerAppend() overload, found
+//    by argument dependent lookup, which writes to a TracerBuffer:
+//
+//        void TracerAppend(TracerBuffer& out, const Point& p)
+//        {
+//            out.Print("(%d, %d)", p.x, p.y);
+//        }
+//
+//        TRACER(true, "Geometry", 5, "moved to %s", point);
+//
+//    Named fields may follow the message arguments.  They are not used by
+//    the format string; the text format shows them after the message, as
+//    key=value, and the JSON lines format (see TracerJson.h) gives each its
+//    own member, keeping its type:
+//
+//        TRACER(true, "Db", 5, "query done", TracerField("rows", n),
+//               TracerField("table", name));
+//
+//        Tracer: [12][Db, 5] query done rows=42 table=users
+//
+
+//
+// possible values for TracerArg::type
+//
+#define TRACER_VALUE_INT        0       // signed integer, bool or enum
+#define TRACER_VALUE_UINT       1       // unsigned integer
+#define TRACER_VALUE_DOUBLE     2       // float or double
+#define TRACER_VALUE_LONGDOUBLE 3       // long double
+#define TRACER_VALUE_POINTER    4       // any other pointer
+#define TRACER_VALUE_STRING     5       // char string
+#define TRACER_VALUE_USER       6       // formatted by TracerAppend()
+
+
+class TracerBuffer;
+
+
+//
+// one captured argument
+//
+struct TracerArg
+{
+    int type;                   // TRACER_VALUE_xxx
+    int size;                   // bytes in an integer, or length of a string,
+                                // -1 if it is null terminated
+    union
+    {
+        long long i;
+        double d;
+        const long double *ld;  // the value lives as long as the call
+        const void *p;
+        const char *s;
+    };
+    void (*append)(TracerBuffer& out, const void *value);   // for TRACER_VALUE_USER
+    const char *key;            // name of a field, 0 for a message argument
+};
+
+
+//
+// output for TracerFormat and for TracerAppend() overloads.  Writes as much
+// as fits in the buffer, but keeps counting, so Length() is the length the
+// full text needs
+//
+class TracerBuffer
+{
+    char *data;
+    int size;
+    int length;
+
+public:
+
+    TracerBuffer(char *buffer, int buffersize)
+        : data(buffer), size(buffersize), length(0)
+    {
+    }
+
+    void Put(char c)
+    {
+        if (length < size)
+            data[length] = c;
+        ++length;
+    }
+
+    void Append(const char *text, int n);
+    void Append(const char *text);
+    void Fill(char c, int n);
+
+    // length of the text so far, whether or not it all fit
+    int Length() const
+    {
+        return length;
+    }
+
+    // cut the text back to 'n' characters
+    void Truncate(int n)
+    {
+        if (n < length)
+            length = n;
+    }
+
+    // pad the text written since 'start' with spaces, out to 'width'
+    void Pad(int start, int width, bool left);
+
+    // append formatted text
+    template <typename... Args>
+    void Print(const char *format, const Args&... args);
+};
+
+
+//
+// a named field, captured by reference.  Passed to the Tracer after the
+// message arguments, and only lives as long as the call
+//
+template <typename T>
+struct TracerField
+{
+    const char *key;
+    const T& value;
+
+    TracerField(const char *aKey, const T& aValue)
+        : key(aKey), value(aValue)
+    {
+    }
+};
+
+template <typename T>
+struct TracerIsField : std::false_type {};
+
+template <typename T>
+struct TracerIsField<TracerField<T>> : std::true_type {};
+
+
+//
+// does a type have a TracerAppend() overload?
+//
+template <typename T, typename = void>
+struct TracerHasAppend : std::false_type {};
+
+template <typename T>
+struct TracerHasAppend<T, std::void_t<decltype(TracerAppend(std::declval<TracerBuffer&>(), std::declval<const T&>()))>>
+    : std::true_type {};
+
+
+//
+// the kind of conversion an argument type may be used with: 'i' integer,
+// 'f' floating point, 's' string, 'p' pointer, 'u' user type, 'k' a named
+// field, or 0 for a type that can't be formatted
+//
+template <typename T>
+constexpr char TracerKind()
+{
+    typedef typename std::decay<T>::type D;
+
+    if constexpr (TracerIsField<D>::value)
+        return 'k';
+    else if constexpr (std::is_integral<D>::value || std::is_enum<D>::value)
+        return 'i';
+    else if constexpr (std::is_floating_point<D>::value)
+        return 'f';
+    else if constexpr (std::is_same<D, char *>::value || std::is_same<D, const char *>::value ||
+                       std::is_same<D, std::string>::value || std::is_same<D, std::string_view>::value)
+        return 's';
+    else if constexpr (std::is_pointer<D>::value || std::is_same<D, std::nullptr_t>::value)
+        return 'p';
+    else if constexpr (TracerHasAppend<D>::value)
+        return 'u';
+    else
+        return 0;
+}
+
+
+//
+// call a TracerAppend() overload through a plain function pointer
+//
+template <typename T>
+void TracerAppendValue(TracerBuffer& out, const void *value)
+{
+    TracerAppend(out, *static_cast<const T *>(value));
+}
+
+
+//
+// capture one argument
+//
+template <typename T>
+inline TracerArg TracerMakeArg(const T& value)
+{
+    typedef typename std::decay<T>::type D;
+    constexpr char kind = TracerKind<T>();
+    static_assert(kind != 0, "Tracer can't format this type; give it a TracerAppend() overload");
+
+    TracerArg arg;
+    arg.size = -1;
+    arg.append = 0;
+    arg.key = 0;
+
+    if constexpr (kind == 'i')
+    {
+        typedef typename std::conditional<std::is_enum<D>::value, std::underlying_type<D>, std::common_type<D>>::type::type I;
+        arg.type = std::is_signed<I>::value ? TRACER_VALUE_INT : TRACER_VALUE_UINT;
+        arg.size = std::is_same<I, bool>::value ? (int)sizeof(int) : (int)sizeof(I);
+        arg.i = (long long)(I)value;
+    }
+    else if constexpr (std::is_same<D, long double>::value)
+    {
+        arg.type = TRACER_VALUE_LONGDOUBLE;
+        arg.ld = &value;
+    }
+    else if constexpr (kind == 'f')
+    {
+        arg.type = TRACER_VALUE_DOUBLE;
+        arg.d = value;
+    }
+    else if constexpr (std::is_same<D, std::string>::value || std::is_same<D, std::string_view>::value)
+    {
+        arg.type = TRACER_VALUE_STRING;
+        arg.s = value.data();
+        arg.size = (int)value.size();
+    }
+    else if constexpr (kind == 's')
+    {
+        arg.type = TRACER_VALUE_STRING;
+        arg.s = value;
+    }
+    else if constexpr (kind == 'p')
+    {
+        arg.type = TRACER_VALUE_POINTER;
+        arg.p = (const void *)value;
+    }
+    else
+    {
+        arg.type = TRACER_VALUE_USER;
+        arg.p = &value;
+        arg.append = TracerAppendValue<D>;
+    }
+
+    return arg;
+}
+
+
+//
+// capture a named field, as its value with the name attached
+//
+template <typename T>
+inline TracerArg TracerMakeArg(const TracerField<T>& field)
+{
+    static_assert(TracerKind<T>() != 0, "Tracer can't format this field type; give it a TracerAppend() overload");
+
+    TracerArg arg = TracerMakeArg(field.value);
+    arg.key = field.key;
+    return arg;
+}
+
+
+class TracerFormat
+{
+public:
+
+    // format a message from a format string and its captured arguments,
+    // followed by any fields, as key=value
+    static void Format(TracerBuffer& out, const char *format, const TracerArg *args, int count);
+
+    // format the message alone
+    static void Message(TracerBuffer& out, const char *format, const TracerArg *args, int count);
+
+    // format the value of a field, in the natural way for its type
+    static void Field(TracerBuffer& out, const TracerArg& arg);
+
+    // number of message arguments, those before the first field
+    static int Arguments(const TracerArg *args, int count)
+    {
+        int n = 0;
+        while ( (n < count) && !args[n].key )
+            ++n;
+        return n;
+    }
+
+    // does a format string match the kinds of its arguments, as returned
+    // by TracerKind()?  Any fields must come last.  Usable at compile time
+    static constexpr bool Check(const char *format, const char *kinds, int count)
+    {
+        int next = 0;
+
+        int fields = 0;
+        while ( (fields < count) && (kinds[fields] != 'k') )
+            ++fields;
+        for (int i = fields; i < count; i++)
+        {
+            if (kinds[i] != 'k')
+                return false;
+        }
+        count = fields;
+
+        for (const char *p = format; *p; )
+        {
+            if (*p++ != '%')
+                continue;
+
+            if (*p == '%')
+            {
+                ++p;
+                continue;
+            }
+
+            // flags
+            while ( (*p == '-') || (*p == '+') || (*p == ' ') || (*p == '#') || (*p == '0') || (*p == '\'') )
+                ++p;
+
+            // width and precision, either of which may take an int argument
+            if (*p == '*')
+            {
+                if ( (next >= count) || (kinds[next++] != 'i') )
+                    return false;
+                ++p;
+            }
+            while ( (*p >= '0') && (*p <= '9') )
+                ++p;
+
+            if (*p == '.')
+            {
+                if (*++p == '*')
+                {
+                    if ( (next >= count) || (kinds[next++] != 'i') )
+                        return false;
+                    ++p;
+                }
+                while ( (*p >= '0') && (*p <= '9') )
+                    ++p;
+            }
+
+            // length modifiers
+            while ( (*p == 'h') || (*p == 'l') || (*p == 'L') || (*p == 'j') || (*p == 'z') || (*p == 't') || (*p == 'q') )
+                ++p;
+
+            char conversion = *p;
+            if (!conversion)
+                return false;
+            ++p;
+
+            if (next >= count)
+                return false;
+            char kind = kinds[next++];
+
+            switch (conversion)
+            {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                if (kind != 'i')
+                    return false;
+                break;
+
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                if (kind != 'f')
+                    return false;
+                break;
+
+            case 's':
+                if ( (kind != 's') && (kind != 'u') )
+                    return false;
+                break;
+
+            case 'p':
+                if ( (kind != 'p') && (kind != 's') )
+                    return false;
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        return next == count;
+    }
+};
+
+
+//
+// the argument types of a call, for checking its format at compile time
+//
+template <typename... Args>
+struct TracerTypes
+{
+    static constexpr bool Check(const char *format)
+    {
+        constexpr char kinds[] = { TracerKind<Args>()..., 0 };
+        return TracerFormat::Check(format, kinds, (int)sizeof...(Args));
+    }
+};
+
+// never called; only used to name the argument types in decltype()
+template <typename... Args>
+TracerTypes<Args...> TracerFormatTypes(const char *format, const Args&... args);
+
+
+template <typename... Args>
+void TracerBuffer::Print(const char *format, const Args&... args)
+{
+    TracerArg list[] = { TracerMakeArg(args)..., TracerArg() };
+    TracerFormat::Format(*this, format, list, (int)sizeof...(Args));
+}
+
+
+#endif   // __TRACERFORMAT_H
@@ -0,0 +1,234 @@
+
+#include "TracerGroups.h"
+#include "TracerShared.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <mutex>
+#include <set>
+#include <string>
+
+
+//
+// init static variables
+//
+TracerGroups::Entry     TracerGroups::entries[TRACER_MAX_GROUPS + 1];
+std::atomic<unsigned short> TracerGroups::slots[TRACER_GROUP_SLOTS];
+std::atomic<int>        TracerGroups::count(0);
+bool                    TracerGroups::allflag   = false;
+int                     TracerGroups::alllevel  = 0;
+
+// serializes adding groups and parsing TRACEGROUP
+static std::mutex       tablelock;
+
+// names of groups that didn't fit in the table, with the lock held.  Never
+// destroyed, so a Tracer may point to one until the very end
+static std::set<std::string>   *kept   = new std::set<std::string>;
+static bool                     full   = false;     // noticed yet?
+
+
+//
+// FNV-1a hash of the first 'length' characters of 'name'
+//
+unsigned TracerGroups::Hash(const char *name, int length)
+{
+    unsigned h = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+//
+// find the ID for the first 'length' characters of 'name', optionally
+// adding a new entry if it isn't there.  Returns 0 if not found.  An entry
+// is filled in before its slot is published, so the search needs no lock
+//
+int TracerGroups::Lookup(const char *name, int length, bool add)
+{
+    unsigned h = Hash(name, length);
+    unsigned slot = h & (TRACER_GROUP_SLOTS - 1);
+
+    // linear probe until we find the name, or an empty slot
+    unsigned short id;
+    while ( (id = slots[slot].load(std::memory_order_acquire)) )
+    {
+        Entry& e = entries[id];
+        if ( (e.hash == h) && (0 == strncmp(e.name, name, length)) && (e.name[length] == 0) )
+            return id;
+
+        slot = (slot + 1) & (TRACER_GROUP_SLOTS - 1);
+    }
+
+    if (!add)
+        return 0;
+
+    // not there, so add it.  Another thread may have added the same name
+    // since the search above, so search again while holding the lock
+    std::lock_guard<std::mutex> guard(tablelock);
+    return Add(name, length, h);
+}
+
+
+//
+// add a group to the table, with the table lock held.  Returns the ID of
+// the group, which may already be there
+//
+int TracerGroups::Add(const char *name, int length, unsigned h)
+{
+    unsigned slot = h & (TRACER_GROUP_SLOTS - 1);
+
+    unsigned short id;
+    while ( (id = slots[slot].load(std::memory_order_relaxed)) )
+    {
+        Entry& e = entries[id];
+        if ( (e.hash == h) && (0 == strncmp(e.name, name, length)) && (e.name[length] == 0) )
+            return id;
+
+        slot = (slot + 1) & (TRACER_GROUP_SLOTS - 1);
+    }
+
+    // a group that doesn't fit shares ID 0, which only ALL enables
+    if (count.load(std::memory_order_relaxed) >= TRACER_MAX_GROUPS)
+    {
+        if (!full)
+        {
+            full = true;
+            char text[96];
+            snprintf(text, sizeof(text), "more than %d groups; the rest are enabled only by ALL", TRACER_MAX_GROUPS);
+            TracerOutput::Notice("groups", text);
+        }
+        return 0;
+    }
+
+    // intern a private copy of the name
+    char *copy = new char[length + 1];
+    memcpy(copy, name, length);
+    copy[length] = 0;
+
+    id = (unsigned short)(count.load(std::memory_order_relaxed) + 1);
+    Entry& e = entries[id];
+    e.name = copy;
+    e.hash = h;
+    e.listed = false;
+    Settle(e);
+
+    count.store(id, std::memory_order_release);
+    slots[slot].store(id, std::memory_order_release);
+    return id;
+}
+
+
+//
+// work out whether an entry is enabled, and what level it is compared
+// against, from its own settings and the ALL settings
+//
+void TracerGroups::Settle(Entry& e)
+{
+    e.setting.store(TRACER_GROUP_SETTING(e.listed || allflag, e.listed ? e.listlevel : alllevel), std::memory_order_relaxed);
+
+    // and for tracerctl, if the control segment is published
+    TracerShared::Group((int)(&e - entries), e.name, e.listed || allflag, e.listed ? e.listlevel : alllevel);
+}
+
+
+//
+// tokenize the TRACEGROUP string.  Entries are separated by commas, and each
+// entry is a group name, optionally followed by a colon and a level.  The
+// new settings are worked out before any entry is changed, so a group that
+// stays enabled is never seen as disabled along the way
+//
+void TracerGroups::Parse(const char *grpenv, int tracelevel)
+{
+    std::lock_guard<std::mutex> guard(tablelock);
+
+    // clear any previous settings
+    allflag = false;
+    alllevel = tracelevel;
+    for (int id = 1; id <= count; id++)
+        entries[id].listed = false;
+
+    const char *p = grpenv;
+    while (p && *p)
+    {
+        // find the end of this entry, and the colon, if any
+        const char *end = p;
+        const char *colon = 0;
+        while (*end && (*end != ','))
+        {
+            if (*end == ':')
+                colon = end;
+            ++end;
+        }
+
+        // trim white space from around the name
+        const char *name = p;
+        const char *nameend = colon ? colon : end;
+        while ( (name < nameend) && ((*name == ' ') || (*name == '\t')) )
+            ++name;
+        while ( (nameend > name) && ((nameend[-1] == ' ') || (nameend[-1] == '\t')) )
+            --nameend;
+
+        int length = (int)(nameend - name);
+        int level = colon ? atoi(colon + 1) : tracelevel;
+
+        if ( (length == 3) && (0 == strncmp(name, "ALL", 3)) )
+        {
+            allflag = true;
+            alllevel = level;
+        }
+        else if (length > 0)
+        {
+            int id = Add(name, length, Hash(name, length));
+            if (id)
+            {
+                entries[id].listed = true;
+                entries[id].listlevel = level;
+            }
+        }
+
+        p = *end ? end + 1 : end;
+    }
+
+    // now that ALL is known, settle every entry, and the one for groups
+    // that didn't fit
+    for (int id = 0; id <= count; id++)
+        Settle(entries[id]);
+}
+
+
+//
+// return the ID for a group name, adding it to the table if needed
+//
+int TracerGroups::Intern(const char *aGroup)
+{
+    if (!aGroup)
+        return 0;
+
+    return Lookup(aGroup, (int)strlen(aGroup), true);
+}
+
+
+//
+// name for a group ID
+//
+const char *TracerGroups::Name(int id)
+{
+    return ( (id > 0) && (id <= count.load(std::memory_order_acquire)) ) ? entries[id].name : "";
+}
+
+
+//
+// keep a copy of a group name that didn't fit in the table
+//
+const char *TracerGroups::Keep(const char *aGroup)
+{
+    std::lock_guard<std::mutex> guard(tablelock);
+    return kept->insert(aGroup).first->c_str();
+}
@@ -0,0 +1,101 @@
+#ifndef __TRACERGROUPS_H
+#define __TRACERGROUPS_H
+
+//
+//    TracerGroups
+//
+//    The interned group registry shared by all Tracer instances.  The
+//    TRACEGROUP environment variable is tokenized once into this table, and
+//    every group name seen by a Tracer is given a small integer ID the first
+//    time it is looked up.  After that, deciding whether a group is enabled,
+//    and at what level, is a single array index.
+//
+//    Group names are matched exactly, so TRACEGROUP=DbPool does not turn on
+//    group "Db".  Entries in TRACEGROUP may carry their own level, which
+//    overrides TRACELEVEL for that group only:
+//
+//        export TRACEGROUP=Foo:10,Bar:3,Baz
+//        export TRACELEVEL=5
+//
+//    prints group Foo up to level 10, Bar up to level 3, and Baz up to level 5.
+//    ALL may also carry a level, which then applies to every group not listed
+//    by name.
+//
+//    Lookups take no lock.  Adding a group, which happens once per name, and
+//    parsing TRACEGROUP are serialized by a mutex.  TRACEGROUP may be parsed
+//    again at any time, by Tracer::Configure(); each group's enabled flag
+//    and threshold are packed into one atomic word, so threads checking them
+//    are never stalled, and see either the old settings or the new ones.
+//
+//    The table holds TRACER_MAX_GROUPS names.  Any group after that gets ID
+//    0, which stands for every group that didn't fit: it is enabled only by
+//    ALL, at the ALL level, and a notice is given the first time.  Such a
+//    group has no name in the binary format.
+//
+
+#include <atomic>
+
+
+#define TRACER_MAX_GROUPS   1023        // most distinct group names
+#define TRACER_GROUP_SLOTS  4096        // hash slots, a power of 2, at least 2x TRACER_MAX_GROUPS
+
+// a group's settings, in one word: whether it is enabled, as it is listed
+// or TRACEGROUP contains ALL, and the level it is compared against
+#define TRACER_GROUP_SETTING(enabled, threshold)    (((unsigned long long)((enabled) ? 1 : 0) << 32) | (unsigned)(threshold))
+
+
+class TracerGroups
+{
+    struct Entry
+    {
+        const char *name;       // interned copy of the group name
+        unsigned hash;          // hash of the name
+        bool listed;            // named in TRACEGROUP
+        int listlevel;          // level given in TRACEGROUP, if listed
+        std::atomic<unsigned long long> setting;    // TRACER_GROUP_SETTING()
+    };
+
+    static Entry entries[TRACER_MAX_GROUPS + 1];                // indexed by group ID, 0 for groups
+                                                                // that didn't fit
+    static std::atomic<unsigned short> slots[TRACER_GROUP_SLOTS];// hash slot -> group ID, 0 if empty
+    static std::atomic<int> count;                              // number of groups interned
+
+    static bool allflag;        // TRACEGROUP contains ALL
+    static int alllevel;        // level for groups enabled only by ALL
+
+    static unsigned Hash(const char *name, int length);
+    static int Lookup(const char *name, int length, bool add);
+    static int Add(const char *name, int length, unsigned h);
+    static void Settle(Entry& e);
+
+public:
+
+    // tokenize a TRACEGROUP string into the table.  Any previous settings
+    // are cleared, but group IDs already handed out stay valid
+    static void Parse(const char *grpenv, int tracelevel);
+
+    // return the ID for a group name, adding it to the table if needed.
+    // Returns 0 if the name is null, or if the table is full
+    static int Intern(const char *aGroup);
+
+    // name for a group ID.  "" for ID 0
+    static const char *Name(int id);
+
+    // a copy of a group name that didn't fit in the table, kept for the
+    // life of the process.  Takes the table lock
+    static const char *Keep(const char *aGroup);
+
+    // does a level in this group compare favorably to its threshold?
+    static bool Enabled(int id, int aLevel, bool onlyflag)
+    {
+        unsigned long long setting = entries[id].setting.load(std::memory_order_relaxed);
+        if (!(setting >> 32))
+            return false;
+
+        int threshold = (int)(unsigned)setting;
+        return (onlyflag && (aLevel == threshold)) || (!onlyflag && (aLevel <= threshold));
+    }
+};
+
+
+#endif   // __TRACERGROUPS_H
@@ -0,0 +1,336 @@
+
+#include "TracerJson.h"
+#include "TracerFormat.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <charconv>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+//
+// room kept at the end of a line, when writing the message, for the members
+// after it and the closing brace and newline
+//
+#define LINE_TAIL       96
+
+
+//
+// the calling thread's buffers, for the message and for the line.  The
+// message buffer is also used for field values, once the message is copied
+//
+static thread_local char text[TRACER_JSON_TEXT];
+static thread_local char line[TRACER_JSON_LINE];
+
+
+//
+// escape one character that needs it.  Returns the length written, or 0
+// if it doesn't fit
+//
+static int EscapeOne(unsigned char c, char *buffer, int size)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    if ( (c == '"') || (c == '\\') || (c == '\n') || (c == '\t') )
+    {
+        if (size < 2)
+            return 0;
+        buffer[0] = '\\';
+        buffer[1] = (c == '\n') ? 'n' : (c == '\t') ? 't' : (char)c;
+        return 2;
+    }
+
+    if (size < 6)
+        return 0;
+    memcpy(buffer, "\\u00", 4);
+    buffer[4] = hex[c >> 4];
+    buffer[5] = hex[c & 0xf];
+    return 6;
+}
+
+
+//
+// copy a string as the body of a JSON string.  Runs of characters that need
+// no escape, which is nearly all of them, are found and copied 16 at a time
+//
+int TracerJson::Escape(const char *text, int length, char *buffer, int size)
+{
+    int used = 0;
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+
+    while ( (i + 16 <= length) && (used + 16 <= size) )
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+
+        // a byte is special if it is a quote, a backslash, or at most 0x1f,
+        // which is when the unsigned minimum of it and 0x1f is itself
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        int mask = _mm_movemask_epi8(special);
+        if (!mask)
+        {
+            _mm_storeu_si128((__m128i *)(buffer + used), chunk);
+            used += 16;
+            i += 16;
+            continue;
+        }
+
+        int clean = __builtin_ctz(mask);
+        memcpy(buffer + used, text + i, clean);
+        used += clean;
+        i += clean;
+
+        int n = EscapeOne((unsigned char)text[i], buffer + used, size - used);
+        if (!n)
+            return used;
+        used += n;
+        ++i;
+    }
+#endif
+
+    for ( ; i < length; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+
+        if ( (c >= 0x20) && (c != '"') && (c != '\\') )
+        {
+            if (used + 1 > size)
+                break;
+            buffer[used++] = (char)c;
+        }
+        else
+        {
+            int n = EscapeOne(c, buffer + used, size - used);
+            if (!n)
+                break;
+            used += n;
+        }
+    }
+
+    return used;
+}
+
+
+//
+// a line being built.  Writes stop at 'limit', which is moved out towards
+// the end of the buffer once the message is written; a write that doesn't
+// fit sets 'full' and writes nothing
+//
+struct Writer
+{
+    char *data;
+    int size;
+    int limit;
+    int length;
+    bool full;
+
+    void Raw(const char *s, int n)
+    {
+        if (length + n > limit)
+        {
+            full = true;
+            return;
+        }
+        memcpy(data + length, s, n);
+        length += n;
+    }
+
+    void Raw(const char *s)
+    {
+        Raw(s, (int)strlen(s));
+    }
+
+    // a JSON string, truncated if need be.  The closing quote always fits
+    void String(const char *s, int n)
+    {
+        Raw("\"", 1);
+        if (full)
+            return;
+        length += TracerJson::Escape(s, n, data + length, limit - length - 1);
+        data[length++] = '"';
+    }
+
+    template <typename T>
+    void Number(T value)
+    {
+        char digits[32];
+        int n = (int)(std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+        Raw(digits, n);
+    }
+
+    // ,"key":
+    void Key(const char *key)
+    {
+        Raw(",", 1);
+        String(key, (int)strlen(key));
+        Raw(":", 1);
+    }
+};
+
+
+//
+// the members every record has, up to and including the message
+//
+static void Head(Writer& out, const TracerRecord& rec)
+{
+    out.Raw("{\"serial\":");
+    out.Number(rec.serial);
+    out.Raw(",\"group\":");
+    out.String(rec.group, (int)strlen(rec.group));
+    out.Raw(",\"level\":");
+    out.Number(rec.level);
+    out.Raw(",\"timestamp\":");
+    out.Number(rec.timestamp);
+    out.Raw(",\"thread\":");
+    out.Number(rec.thread);
+    out.Raw(",\"msg\":");
+    out.String(rec.text ? rec.text : "", rec.length);
+
+    // the rest may use the room kept at the end, all but the closing brace
+    out.limit = out.size - 2;
+
+    if (rec.suppressed)
+    {
+        out.Key("suppressed");
+        out.Number(rec.suppressed);
+    }
+    if ( (rec.kind == TRACER_RECORD_EXIT) && (rec.elapsed >= 0) )
+    {
+        out.Key("elapsed_ns");
+        out.Number(rec.elapsed);
+    }
+}
+
+
+//
+// the value of one field
+//
+static void Value(Writer& out, const TracerArg& arg)
+{
+    switch (arg.type)
+    {
+    case TRACER_VALUE_INT:
+        out.Number(arg.i);
+        return;
+
+    case TRACER_VALUE_UINT:
+        out.Number((unsigned long long)arg.i);
+        return;
+
+    case TRACER_VALUE_DOUBLE:
+    case TRACER_VALUE_LONGDOUBLE:
+    {
+        double d = (arg.type == TRACER_VALUE_DOUBLE) ? arg.d : (double)*arg.ld;
+        if (isfinite(d))
+            out.Number(d);
+        else
+            out.Raw("null");
+        return;
+    }
+
+    case TRACER_VALUE_STRING:
+        if (!arg.s)
+            out.Raw("null");
+        else
+            out.String(arg.s, (arg.size >= 0) ? arg.size : (int)strlen(arg.s));
+        return;
+
+    case TRACER_VALUE_POINTER:
+        if (!arg.p)
+        {
+            out.Raw("null");
+            return;
+        }
+        break;
+    }
+
+    // pointers and user types are formatted as text first
+    TracerBuffer value(text, sizeof(text));
+    TracerFormat::Field(value, arg);
+    out.String(text, (value.Length() < (int)sizeof(text)) ? value.Length() : (int)sizeof(text));
+}
+
+
+//
+// close a line
+//
+static int Tail(Writer& out)
+{
+    out.limit = out.size;
+    out.full = false;
+    out.Raw("}\n", 2);
+    return out.length;
+}
+
+
+//
+// format a record whose message is already formatted
+//
+int TracerJson::Format(const TracerRecord& rec, char *buffer, int size)
+{
+    if (size < 2 * LINE_TAIL)
+        return 0;
+
+    Writer out = { buffer, size, size - LINE_TAIL, 0, false };
+    Head(out, rec);
+    return Tail(out);
+}
+
+
+//
+// format a message record, with its fields, into the thread's buffer
+//
+int TracerJson::Message(TracerRecord& rec, const char *format, const TracerArg *args, int count, const char *& result)
+{
+    int arguments = TracerFormat::Arguments(args, count);
+
+    TracerBuffer message(text, sizeof(text));
+    TracerFormat::Message(message, format, args, arguments);
+    rec.text = text;
+    rec.length = (message.Length() < (int)sizeof(text)) ? message.Length() : (int)sizeof(text);
+
+    Writer out = { line, (int)sizeof(line), (int)sizeof(line) - LINE_TAIL, 0, false };
+    Head(out, rec);
+
+    // a field that doesn't fit is left off, along with those after it
+    for (int n = arguments; (n < count) && !out.full; n++)
+    {
+        if (!args[n].key)
+            continue;
+
+        int start = out.length;
+        out.Key(args[n].key);
+        Value(out, args[n]);
+        if (out.full)
+            out.length = start;
+    }
+
+    result = line;
+    return Tail(out);
+}
+
+
+//
+// format a message record from a va_list into the thread's buffer
+//
+int TracerJson::Message(TracerRecord& rec, const char *format, va_list arg_list, const char *& result)
+{
+    int length = vsnprintf(text, sizeof(text), format, arg_list);
+    if (length < 0)
+        length = 0;
+    rec.text = text;
+    rec.length = (length < (int)sizeof(text)) ? length : (int)sizeof(text) - 1;
+
+    result = line;
+    return Format(rec, line, sizeof(line));
+}
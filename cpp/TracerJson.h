@@ -0,0 +1,59 @@
+#ifndef __TRACERJSON_H
+#define __TRACERJSON_H
+
+#include "TracerRecord.h"
+
+#include <stdarg.h>
+
+struct TracerArg;
+
+//
+//    TracerJson
+//
+//    The JSON lines format, selected with TRACEFORMAT=JSON.  Each record is
+//    one JSON object on a line of its own, so a log pipeline can read it
+//    without parsing the text prefix:
+//
+//        {"serial":12,"group":"Db","level":5,"timestamp":1692812345120339123,"thread":4711,"msg":"query done","rows":42,"table":"users"}
+//
+//    The timestamp is in nanoseconds since the epoch.  An exit record has the
+//    same message as its text line, and in timing mode an "elapsed_ns"
+//    member.  A record with suppressed calls has a "suppressed" member.
+//    Fields passed with TracerField() (see TracerFormat.h) follow as members
+//    of their own, numbers as JSON numbers, and everything else as strings.
+//
+//    A record is built in a buffer belonging to the calling thread, so no
+//    memory is allocated for it.  Messages longer than TRACER_JSON_TEXT
+//    characters are truncated, and fields that don't fit in TRACER_JSON_LINE
+//    are left off.  Strings are escaped 16 bytes at a time with SSE2, where
+//    it is available.
+//
+
+#define TRACER_JSON_LINE        16384   // longest line
+#define TRACER_JSON_TEXT        4096    // longest message
+
+
+class TracerJson
+{
+public:
+
+    // format a record, whose message is already formatted, as a JSON line
+    // with a trailing newline.  Returns the line length
+    static int Format(const TracerRecord& rec, char *buffer, int size);
+
+    // format a message record from 'format' and its captured arguments,
+    // including any fields, into the calling thread's buffer.  Sets 'line'
+    // to the buffer and returns the line length
+    static int Message(TracerRecord& rec, const char *format, const TracerArg *args, int count, const char *& line);
+
+    // the same, from a va_list
+    static int Message(TracerRecord& rec, const char *format, va_list arg_list, const char *& line);
+
+    // copy a string into 'buffer' as the body of a JSON string, escaping as
+    // needed.  Stops short rather than split an escape.  Returns the length
+    // written
+    static int Escape(const char *text, int length, char *buffer, int size);
+};
+
+
+#endif   // __TRACERJSON_H
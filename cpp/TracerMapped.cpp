@@ -0,0 +1,286 @@
+
+#include "TracerMapped.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+//
+// init static variables
+//
+std::atomic<bool>   TracerMapped::running(false);
+
+
+//
+// settings
+//
+static std::string          base;                   // TRACEFILE
+static std::string          preface;                // written at the start of each segment
+static int                  mode        = TRACER_FORMAT_TEXT;
+static int                  keep        = TRACER_MAPPED_KEEP;
+static long long            capacity    = 0;
+
+//
+// one mapped segment.  A writer reserves room for its record by moving
+// 'reserved' along, and counts itself in 'writers' while it copies the
+// record in, so the segment isn't unmapped under it
+//
+struct Segment
+{
+    int fd;
+    TracerMappedHeader *header;
+    char *records;
+    std::atomic<long long> reserved;    // bytes handed out, which may pass the capacity
+    std::atomic<int> writers;           // threads inside the segment
+};
+
+//
+// the segment being written, one of two that take turns, so a writer that
+// still holds the one before can always look at it.  'writelock' is only
+// taken to start, rotate and close segments
+//
+static std::mutex               writelock;
+static Segment                  segments[2];
+static std::atomic<Segment *>   current(nullptr);
+static int                      sequence    = 0;
+
+
+//
+// is a setting TRUE, as Tracer reads it?
+//
+static bool True(const char *value)
+{
+    return (0 == strcmp(value, "TRUE")) || (0 == strcmp(value, "true")) || (0 == strcmp(value, "True"));
+}
+
+
+//
+// does TRACEMAP ask for a mapping?
+//
+bool TracerMapped::Requested(const char *setting)
+{
+    return isdigit((unsigned char)setting[0]) || True(setting);
+}
+
+
+//
+// create and map a new segment.  Its blocks are allocated up front, so that
+// a full disk shows up here, rather than as a SIGBUS when a record is copied
+// in
+//
+static bool Begin(Segment& segment)
+{
+    int fd = open(base.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    void *mapped = MAP_FAILED;
+    if (posix_fallocate(fd, 0, TRACER_MAPPED_HEADER + capacity) == 0)
+        mapped = mmap(0, TRACER_MAPPED_HEADER + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (mapped == MAP_FAILED)
+    {
+        close(fd);
+        unlink(base.c_str());
+        return false;
+    }
+
+    // the file starts out zeroed, so only the fields that aren't zero need
+    // filling in, and the magic number last
+    TracerMappedHeader *header = (TracerMappedHeader *)mapped;
+    header->version = TRACER_MAPPED_VERSION;
+    header->format = mode;
+    header->pid = (int)getpid();
+    header->sequence = sequence++;
+    header->capacity = capacity;
+    header->created = TracerOutput::Now();
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, TRACER_MAPPED_MAGIC, sizeof(header->magic));
+
+    long long used = (long long)preface.length();
+    memcpy((char *)mapped + TRACER_MAPPED_HEADER, preface.data(), used);
+    header->committed.store(used, std::memory_order_release);
+
+    // writers may use the segment once it is current
+    segment.fd = fd;
+    segment.header = header;
+    segment.records = (char *)mapped + TRACER_MAPPED_HEADER;
+    segment.reserved.store(used, std::memory_order_relaxed);
+    current.store(&segment);
+    return true;
+}
+
+
+//
+// finish with a segment no more room can be reserved in, once the writers
+// still copying into it are done, trimming the file to what was written
+//
+static void Finish(Segment& segment)
+{
+    while (segment.writers.load() > 0)
+        std::this_thread::yield();
+
+    TracerMappedHeader *header = segment.header;
+    long long used = header->committed.load(std::memory_order_acquire);
+    header->closed.store(1, std::memory_order_release);
+    munmap(header, TRACER_MAPPED_HEADER + capacity);
+
+    // if the file can't be trimmed, the segment is still readable, it just
+    // keeps its full size.  ftruncate() is declared warn_unused_result, which
+    // a (void) cast of the call doesn't quiet
+    int trimmed = ftruncate(segment.fd, TRACER_MAPPED_HEADER + used);
+    (void)trimmed;
+    close(segment.fd);
+
+    segment.fd = -1;
+    segment.header = 0;
+    segment.records = 0;
+}
+
+
+//
+// start writing TRACEFILE through a mapping
+//
+bool TracerMapped::Start(const char *path, const char *setting, int format, const char *preamble)
+{
+    if (Running())
+        return true;
+
+    if ( !Requested(setting) || (format == TRACER_FORMAT_BINARY) )
+        return false;
+
+    long long megabytes = TRACER_MAPPED_SIZE;
+    if (isdigit((unsigned char)setting[0]))
+    {
+        megabytes = atoll(setting);
+        const char *comma = strchr(setting, ',');
+        if (comma)
+            keep = atoi(comma + 1);
+    }
+
+    if (megabytes < TRACER_MAPPED_MINIMUM)
+        megabytes = TRACER_MAPPED_MINIMUM;
+    if (keep < 1)
+        keep = 1;
+
+    base = path;
+    preface = preamble;
+    mode = format;
+    capacity = (megabytes << 20) - TRACER_MAPPED_HEADER;
+
+    std::lock_guard<std::mutex> guard(writelock);
+
+    Shift();
+    if (!Begin(segments[0]))
+    {
+        TracerOutput::Notice("mapped", "cannot map TRACEFILE, writing it directly");
+        return false;
+    }
+
+    running.store(true);
+    atexit(Close);
+    return true;
+}
+
+
+//
+// rename the segments along, dropping the oldest
+//
+void TracerMapped::Shift()
+{
+    for (int n = keep - 1; n >= 1; n--)
+    {
+        std::string from = (n == 1) ? base : base + "." + std::to_string(n - 1);
+        std::string to = base + "." + std::to_string(n);
+        rename(from.c_str(), to.c_str());
+    }
+}
+
+
+//
+// append one or more records
+//
+bool TracerMapped::Write(const char *data, int length)
+{
+    long long room = capacity - (long long)preface.length();
+    if (length > room)
+        length = (int)room;
+
+    for (;;)
+    {
+        Segment *segment = current.load();
+        if (!segment)
+            return false;
+
+        // count ourselves in, then make sure the segment wasn't retired
+        // meanwhile, as Finish() may not have seen us
+        segment->writers.fetch_add(1);
+        if (current.load() != segment)
+        {
+            segment->writers.fetch_sub(1);
+            continue;
+        }
+
+        long long start = segment->reserved.fetch_add(length);
+        if (start + length <= capacity)
+        {
+            memcpy(segment->records + start, data, length);
+
+            // 'committed' only ever covers whole records, so wait for the
+            // writers of any records ahead of this one to finish copying
+            std::atomic<long long>& committed = segment->header->committed;
+            while (committed.load(std::memory_order_acquire) != start)
+                std::this_thread::yield();
+            committed.store(start + length, std::memory_order_release);
+
+            segment->writers.fetch_sub(1, std::memory_order_release);
+            return true;
+        }
+        segment->writers.fetch_sub(1, std::memory_order_release);
+
+        // the segment is full.  The first writer to find it so starts the
+        // next one, and the others wait for it, then try again.  By then
+        // 'segment' may be current again, in a new lap, with room
+        std::lock_guard<std::mutex> guard(writelock);
+        if ( (current.load() != segment) || (segment->reserved.load() <= capacity) )
+            continue;
+
+        // every reservation from here on fails, so 'segment' can stay
+        // current while the writers still in it finish
+        Finish(*segment);
+        Shift();
+        if (!Begin(segments[segment == &segments[0]]))
+        {
+            current.store(nullptr);
+            break;
+        }
+    }
+
+    running.store(false);
+    TracerOutput::Notice("mapped", "cannot map a new TRACEFILE segment, writing to stderr");
+    return false;
+}
+
+
+//
+// trim the last segment at exit.  Anything written after that goes to
+// stderr
+//
+void TracerMapped::Close()
+{
+    std::lock_guard<std::mutex> guard(writelock);
+    Segment *segment = current.exchange(nullptr);
+    if (segment)
+        Finish(*segment);
+    running.store(false);
+}
@@ -0,0 +1,98 @@
+#ifndef __TRACERMAPPED_H
+#define __TRACERMAPPED_H
+
+#include <atomic>
+
+//
+//    TracerMapped
+//
+//    Writes TRACEFILE through a memory mapping, in preallocated segments of
+//    a fixed size, instead of with a write() per record.  Writing a record
+//    reserves its room with an atomic add, then is a memcpy() into the
+//    mapping and a store of the new length, once any records ahead of it
+//    are in; threads only take a lock to start a new segment.  Once a
+//    segment is full it is trimmed to what was written and renamed, and a
+//    new one started, keeping at most a given number of segments, so disk
+//    use is bounded:
+//
+//        trace.out       the segment being written
+//        trace.out.1     the one before, and so on
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACEFILE=trace.out       the file to write
+//        TRACEMAP=TRUE             write it through a mapping, in segments of
+//                                  TRACER_MAPPED_SIZE megabytes, keeping
+//                                  TRACER_MAPPED_KEEP of them
+//        TRACEMAP=64,8             in segments of 64 megabytes, keeping 8
+//
+//    Only the text, Chrome and JSON lines formats can be mapped, since each
+//    segment must be readable without the ones before it.  A Chrome trace
+//    starts a new JSON array in each segment.
+//
+//    Each segment starts with a TracerMappedHeader, TRACER_MAPPED_HEADER
+//    bytes long, followed by the records.  'committed' counts the bytes of
+//    whole records written, and is updated after each record is copied in,
+//    so if the process dies, the page cache still holds a segment whose
+//    header says how much of it to read.  tracer-decode prints the records
+//    of a segment, whether it was finished with or not.  Segments left by an
+//    earlier run are kept, and renamed along with the new ones.
+//
+//    Only one process may write a given TRACEFILE this way.
+//
+
+#define TRACER_MAPPED_MAGIC     "TRACERM1"
+#define TRACER_MAPPED_VERSION   1
+#define TRACER_MAPPED_HEADER    4096        // bytes before the records, a page
+#define TRACER_MAPPED_SIZE      64          // megabytes in a segment, by default
+#define TRACER_MAPPED_KEEP      8           // segments kept, by default
+#define TRACER_MAPPED_MINIMUM   1           // fewest megabytes in a segment
+
+
+struct TracerMappedHeader
+{
+    char magic[8];                          // TRACER_MAPPED_MAGIC
+    int version;                            // TRACER_MAPPED_VERSION
+    int format;                             // TRACER_FORMAT_xxx of the records
+    int pid;                                // of the writing process
+    int sequence;                           // segments this process wrote before this one
+    long long capacity;                     // bytes of records the segment has room for
+    long long created;                      // nanoseconds since the epoch
+    std::atomic<long long> committed;       // bytes of whole records written
+    std::atomic<int> closed;                // set once the segment is trimmed and finished with
+};
+
+
+class TracerMapped
+{
+    static std::atomic<bool> running;       // true while TRACEFILE is mapped
+
+    static void Shift();
+    static void Close();
+
+public:
+
+    // does the TRACEMAP 'setting' ask for a mapping?
+    static bool Requested(const char *setting);
+
+    // write 'path' through a mapping, as set by TRACEMAP, in the given
+    // TRACER_FORMAT_xxx, which can't be binary.  'preamble' is written at
+    // the start of every segment.  Returns false, with a notice if it was
+    // asked for, if the file can't be mapped
+    static bool Start(const char *path, const char *setting, int format, const char *preamble);
+
+    // is TRACEFILE mapped?
+    static bool Running()
+    {
+        return running.load(std::memory_order_relaxed);
+    }
+
+    // append already formatted output.  A record longer than a whole
+    // segment is truncated.  Returns false if the file is no longer mapped,
+    // so the output should go to stderr
+    static bool Write(const char *data, int length);
+};
+
+
+#endif   // __TRACERMAPPED_H
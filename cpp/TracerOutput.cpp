@@ -0,0 +1,483 @@
+
+#include "TracerOutput.h"
+#include "TracerBinary.h"
+#include "TracerAsync.h"
+#include "TracerFormat.h"
+#include "TracerJson.h"
+#include "TracerSocket.h"
+#include "TracerMapped.h"
+#include "TracerArchive.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+
+//
+// init static variables
+//
+int         TracerOutput::mode      = TRACER_FORMAT_TEXT;
+int         TracerOutput::fd        = 2;
+bool        TracerOutput::threads   = false;
+
+// process ID for Chrome trace events
+static int  pid                     = 0;
+
+
+//
+// select the output format and destination
+//
+void TracerOutput::Open(const char *path, int format, bool showthreads, const char *mapping)
+{
+    mode = format;
+    threads = showthreads;
+
+    if (mode == TRACER_FORMAT_CHROME)
+        pid = (int)getpid();
+
+    // a mapped file starts every segment with the Chrome array itself.  The
+    // binary log can't be mapped, since a segment couldn't be read alone
+    bool unmappable = path && mapping && TracerMapped::Requested(mapping) && (mode == TRACER_FORMAT_BINARY);
+    if ( path && mapping && TracerMapped::Start(path, mapping, format, (mode == TRACER_FORMAT_CHROME) ? "[\n" : "") )
+        return;
+
+    if (path)
+    {
+        int file = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (file >= 0)
+            fd = file;
+        else
+            fprintf(stderr, "Tracer: cannot open TRACEFILE %s, using stderr\n", path);
+    }
+
+    if (mode == TRACER_FORMAT_BINARY)
+        Write(TRACER_BINARY_MAGIC, 8);
+    else if (mode == TRACER_FORMAT_CHROME)
+        Write("[\n", 2);
+
+    if (unmappable)
+        Notice("mapped", "TRACEMAP can't map the binary format, writing TRACEFILE directly");
+}
+
+
+//
+// output one message record
+//
+void TracerOutput::Message(TracerRecord& rec, const char *format, va_list arg_list)
+{
+    if ( (mode != TRACER_FORMAT_TEXT) || TracerSocket::Running() || TracerArchive::Running() )
+        rec.timestamp = Now();
+
+    if (mode == TRACER_FORMAT_BINARY)
+    {
+        TracerBinary::Message(rec, format, arg_list);
+        return;
+    }
+
+    // a JSON line is built in the thread's own buffer, then sent whole,
+    // unless the writer thread can build it from the record
+    if (mode == TRACER_FORMAT_JSON)
+    {
+        if (TracerAsync::Push(rec, format, arg_list))
+            return;
+
+        const char *line;
+        int length = TracerJson::Message(rec, format, arg_list, line);
+        Send(line, length, rec.timestamp);
+        return;
+    }
+
+    // in asynchronous mode, the message is formatted straight into the ring
+    if (TracerAsync::Push(rec, format, arg_list))
+        return;
+
+    // most messages fit on the stack, but the text format has no length limit
+    char text[512];
+    va_list arg_copy;
+    va_copy(arg_copy, arg_list);
+
+    int length = vsnprintf(text, sizeof(text), format, arg_list);
+    if (length < 0)
+        length = 0;
+
+    char *buffer = text;
+    if (length >= (int)sizeof(text))
+    {
+        buffer = new char[length + 1];
+        vsnprintf(buffer, length + 1, format, arg_copy);
+    }
+    va_end(arg_copy);
+
+    rec.text = buffer;
+    rec.length = length;
+    Archive(rec);
+
+    if (buffer != text)
+        delete[] buffer;
+}
+
+
+//
+// output one message record, from captured arguments
+//
+void TracerOutput::Message(TracerRecord& rec, const char *format, const TracerArg *args, int count)
+{
+    if ( (mode != TRACER_FORMAT_TEXT) || TracerSocket::Running() || TracerArchive::Running() )
+        rec.timestamp = Now();
+
+    if (mode == TRACER_FORMAT_BINARY)
+    {
+        TracerBinary::Message(rec, format, args, count);
+        return;
+    }
+
+    // fields become members of their own in the JSON line, so only a
+    // message without them is left to the writer thread
+    if (mode == TRACER_FORMAT_JSON)
+    {
+        if ( (TracerFormat::Arguments(args, count) == count) && TracerAsync::Push(rec, format, args, count) )
+            return;
+
+        const char *line;
+        int length = TracerJson::Message(rec, format, args, count, line);
+        Send(line, length, rec.timestamp);
+        return;
+    }
+
+    if (TracerAsync::Push(rec, format, args, count))
+        return;
+
+    // as for the printf version, most messages fit on the stack
+    char text[512];
+    TracerBuffer out(text, sizeof(text));
+    TracerFormat::Format(out, format, args, count);
+
+    char *buffer = text;
+    int length = out.Length();
+    if (length > (int)sizeof(text))
+    {
+        buffer = new char[length];
+        TracerBuffer all(buffer, length);
+        TracerFormat::Format(all, format, args, count);
+    }
+
+    rec.text = buffer;
+    rec.length = length;
+    Archive(rec);
+
+    if (buffer != text)
+        delete[] buffer;
+}
+
+
+//
+// output one exit record
+//
+void TracerOutput::Exit(TracerRecord& rec)
+{
+    if ( (mode != TRACER_FORMAT_TEXT) || TracerSocket::Running() || TracerArchive::Running() )
+        rec.timestamp = Now();
+
+    if (mode == TRACER_FORMAT_BINARY)
+    {
+        TracerBinary::Exit(rec);
+        return;
+    }
+
+    // in timing mode, the exit line carries the lifetime of the Tracer
+    char text[64];
+    if (rec.elapsed >= 0)
+    {
+        rec.text = text;
+        rec.length = snprintf(text, sizeof(text), "-exit- %lld ns", rec.elapsed);
+    }
+    else
+    {
+        rec.text = "-exit-";
+        rec.length = 6;
+    }
+
+    if (!TracerAsync::Push(rec))
+        Archive(rec);
+}
+
+
+//
+// output the start of a span with no message
+//
+void TracerOutput::Begin(TracerRecord& rec)
+{
+    if (mode != TRACER_FORMAT_CHROME)
+        return;
+
+    rec.timestamp = Now();
+    if (!TracerAsync::Push(rec))
+        Write(rec);
+}
+
+
+//
+// output a notice from the Tracer machinery itself.  In the binary log,
+// notices are text entries with group ID 0
+//
+void TracerOutput::Notice(const char *source, const char *text)
+{
+    char line[256];
+
+    if (mode != TRACER_FORMAT_TEXT)
+    {
+        char message[128];
+        int length = snprintf(message, sizeof(message), "[%s] %s", source, text);
+
+        TracerRecord rec = { TRACER_RECORD_MESSAGE, 0, 0, 0, Thread(), Now(), source, message, 0, 0, -1, 0 };
+        rec.length = (length < (int)sizeof(message)) ? length : (int)sizeof(message) - 1;
+
+        if (mode == TRACER_FORMAT_BINARY)
+            Write(line, TracerBinary::Text(rec, line, sizeof(line)));
+        else
+            Write(rec);
+        return;
+    }
+
+    int length = snprintf(line, sizeof(line), "Tracer: [%s] %s\n", source, text);
+    Write(line, (length < (int)sizeof(line)) ? length : (int)sizeof(line) - 1);
+}
+
+
+//
+// nanoseconds since the epoch
+//
+long long TracerOutput::Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+//
+// nanoseconds from the monotonic clock, for measuring intervals
+//
+long long TracerOutput::Monotonic()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+//
+// ID of the calling thread.  Looked up once per thread
+//
+int TracerOutput::Thread()
+{
+    static thread_local int id = 0;
+    if (!id)
+        id = (int)syscall(SYS_gettid);
+    return id;
+}
+
+
+//
+// room kept at the end of a Chrome trace event for everything after the
+// name and category, so that a truncated event is still valid JSON
+//
+#define EVENT_TAIL      192
+
+
+//
+// format a record as one Chrome trace event, with a trailing comma and
+// newline.  Timestamps are in microseconds
+//
+static int FormatEvent(const TracerRecord& rec, char *buffer, int size)
+{
+    if (size < 2 * EVENT_TAIL)
+        return 0;
+
+    int length = 0;
+    const char *phase = "i";
+    if (rec.kind == TRACER_RECORD_EXIT)
+        phase = "E";
+    else if (rec.kind == TRACER_RECORD_BEGIN)
+        phase = "B";
+
+    // exit events only close the innermost open span, so need no name
+    if (rec.kind != TRACER_RECORD_EXIT)
+    {
+        memcpy(buffer, "{\"name\":\"", 9);
+        length = 9;
+
+        // a span with no ctor message is named by its group
+        if ( (rec.kind == TRACER_RECORD_BEGIN) && (rec.length == 0) )
+            length += TracerJson::Escape(rec.group, (int)strlen(rec.group), buffer + length, size - length - 2 * EVENT_TAIL);
+        else
+            length += TracerJson::Escape(rec.text, rec.length, buffer + length, size - length - 2 * EVENT_TAIL);
+
+        memcpy(buffer + length, "\",", 2);
+        length += 2;
+    }
+    else
+        buffer[length++] = '{';
+
+    memcpy(buffer + length, "\"cat\":\"", 7);
+    length += 7;
+    length += TracerJson::Escape(rec.group, (int)strlen(rec.group), buffer + length, size - length - EVENT_TAIL);
+
+    length += snprintf(buffer + length, size - length,
+                       "\",\"ph\":\"%s\",%s\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d,\"args\":{\"serial\":%d,\"level\":%d",
+                       phase, (rec.kind == TRACER_RECORD_MESSAGE) ? "\"s\":\"t\"," : "",
+                       rec.timestamp / 1000, rec.timestamp % 1000, pid, rec.thread, rec.serial, rec.level);
+    if (rec.suppressed)
+        length += snprintf(buffer + length, size - length, ",\"suppressed\":%d", rec.suppressed);
+
+    memcpy(buffer + length, "}},\n", 4);
+    return length + 4;
+}
+
+
+//
+// format a record as a Tracer line, with a trailing newline.  In timing
+// mode the message is indented by the nesting depth of its Tracer
+//
+int TracerOutput::Format(const TracerRecord& rec, char *buffer, int size)
+{
+    if (mode == TRACER_FORMAT_CHROME)
+        return FormatEvent(rec, buffer, size);
+    if (mode == TRACER_FORMAT_JSON)
+        return TracerJson::Format(rec, buffer, size);
+
+    int length;
+    if (threads)
+        length = snprintf(buffer, size, "Tracer: [%d][%s, %d][%d] ", rec.serial, rec.group, rec.level, rec.thread);
+    else
+        length = snprintf(buffer, size, "Tracer: [%d][%s, %d] ", rec.serial, rec.group, rec.level);
+    if (length >= size - 1)
+        length = size - 2;
+
+    for (int i = 0; (i < rec.depth) && (length < size - 3); i++)
+    {
+        buffer[length++] = ' ';
+        buffer[length++] = ' ';
+    }
+
+    // copy as much of the message as fits, leaving room for the newline,
+    // and for the count of suppressed calls, if any
+    char count[32];
+    int countlength = rec.suppressed ? snprintf(count, sizeof(count), " (%d suppressed)", rec.suppressed) : 0;
+
+    int textlength = rec.length;
+    if (textlength > size - 1 - countlength - length)
+        textlength = size - 1 - countlength - length;
+    if (textlength < 0)
+        textlength = 0;
+
+    memcpy(buffer + length, rec.text, textlength);
+    length += textlength;
+    if (countlength && (length + countlength < size))
+    {
+        memcpy(buffer + length, count, countlength);
+        length += countlength;
+    }
+    buffer[length++] = '\n';
+
+    return length;
+}
+
+
+//
+// format and write one record.  The whole line goes out in one write(), so
+// lines are not broken up by other output to the same stream
+//
+void TracerOutput::Write(const TracerRecord& rec)
+{
+    char line[1024];
+
+    // most lines fit on the stack, but the text format has no length limit
+    int size = rec.length + 160 + (int)strlen(rec.group) + 2 * rec.depth;
+    if (mode == TRACER_FORMAT_CHROME)
+        size = 6 * (rec.length + 2 * (int)strlen(rec.group)) + 2 * EVENT_TAIL;
+    else if (mode == TRACER_FORMAT_JSON)
+        size = 6 * (rec.length + (int)strlen(rec.group)) + 256;
+    char *buffer = (size <= (int)sizeof(line)) ? line : new char[size];
+
+    Write(buffer, Format(rec, buffer, size));
+
+    if (buffer != line)
+        delete[] buffer;
+}
+
+
+//
+// add a text record to the archive, if records go there, otherwise write it
+//
+void TracerOutput::Archive(const TracerRecord& rec)
+{
+    if (TracerArchive::Running())
+        TracerArchive::Add(rec);
+    else
+        Write(rec);
+}
+
+
+//
+// write already formatted output
+//
+void TracerOutput::Write(const char *data, int length)
+{
+    if ( TracerMapped::Running() && TracerMapped::Write(data, length) )
+        return;
+
+    while (length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        data += n;
+        length -= (int)n;
+    }
+}
+
+
+//
+// write already formatted output, through the ring if it is running
+//
+void TracerOutput::Send(const char *data, int length, long long timestamp)
+{
+    if (TracerAsync::Push(data, length, timestamp))
+        return;
+
+    // it may still go to tracerd
+    if ( !TracerSocket::Running() || !TracerSocket::Send(timestamp, data, length) )
+        Write(data, length);
+}
+
+
+//
+// send a line from outside the Tracer classes through the ring.  Lines that
+// go anywhere else, or in another format, have no order to keep with it
+//
+bool TracerOutput::Relay(const char *data, int length)
+{
+    if ( !TracerAsync::Running() || (mode != TRACER_FORMAT_TEXT) || (fd != 2) || TracerSocket::Running() )
+        return false;
+
+    Send(data, length, Now());
+    return true;
+}
+
+
+extern "C" int tracer_send_line(const char *data, int length)
+{
+    return TracerOutput::Relay(data, length) ? 1 : 0;
+}
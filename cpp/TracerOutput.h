@@ -0,0 +1,141 @@
+#ifndef __TRACEROUTPUT_H
+#define __TRACEROUTPUT_H
+
+#include "TracerRecord.h"
+
+#include <stdarg.h>
+
+struct TracerArg;
+
+//
+//    TracerOutput
+//
+//    The output path shared by all Tracer instances.  Records are written
+//    either as the familiar text lines
+//
+//        Tracer: [serial][group, level] message
+//
+//    or in the binary log format (see TracerBinary.h), or as Chrome Trace
+//    Event JSON, or as JSON lines (see TracerJson.h), to stderr, to a
+//    file, or to the tracerd aggregator (see TracerSocket.h), and either
+//    directly or through the TracerAsync ring.
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACEFORMAT=TEXT          text lines.  This is the default
+//        TRACEFORMAT=BINARY        binary log, to be read with tracer-decode
+//        TRACEFORMAT=CHROME        Chrome Trace Event JSON, for chrome://tracing
+//                                  or the Perfetto UI
+//        TRACEFORMAT=JSON          one JSON object per line, for log pipelines
+//        TRACEFILE=trace.out       write to a file, instead of stderr
+//        TRACEMAP=TRUE             write TRACEFILE through a memory mapping, in
+//                                  rotating segments (see TracerMapped.h)
+//        TRACEARCHIVE=trace.tza    write records to a compressed archive, in
+//                                  place of all of these (see TracerArchive.h)
+//        TRACETHREAD=TRUE          show the thread ID in each text line:
+//
+//            Tracer: [serial][group, level][thread] message
+//
+//    Every record is written with a single write(), in append mode when
+//    writing to a file, so lines from different threads, or from different
+//    processes sharing the file, never interleave.  A mapped file is written
+//    by one process only, with each record copied in whole.
+//
+//    In the Chrome format each Tracer is a span: a "B" event when it is
+//    constructed, named by the ctor message, or by the group if the ctor
+//    prints nothing, and an "E" event when it is destroyed.  Print() calls
+//    are thread scoped instant events.  The group is the event category, and
+//    the serial and level are args.  Events are streamed one per line as a
+//    JSON array whose closing ']' is left off, as the Trace Event format
+//    allows, so memory use does not grow with the size of the capture.
+//
+
+#define TRACER_FORMAT_TEXT      0
+#define TRACER_FORMAT_BINARY    1
+#define TRACER_FORMAT_CHROME    2
+#define TRACER_FORMAT_JSON      3
+
+
+class TracerOutput
+{
+    static int mode;            // TRACER_FORMAT_xxx
+    static int fd;              // where the output goes, stderr by default
+    static bool threads;        // show thread IDs in text lines
+
+public:
+
+    // select the output format, a file to write to, or 0 for stderr, and
+    // whether text lines show thread IDs.  'mapping' is TRACEMAP, if set, to
+    // write the file through a mapping (see TracerMapped.h)
+    static void Open(const char *path, int format, bool showthreads, const char *mapping);
+
+    // the current TRACER_FORMAT_xxx
+    static int Mode()
+    {
+        return mode;
+    }
+
+    // output one message record, formatting the message from 'format' and
+    // 'arg_list' as the output format requires
+    static void Message(TracerRecord& rec, const char *format, va_list arg_list);
+
+    // output one message record, formatting the message from 'format' and
+    // arguments captured by the Tracer templates
+    static void Message(TracerRecord& rec, const char *format, const TracerArg *args, int count);
+
+    // output one exit record
+    static void Exit(TracerRecord& rec);
+
+    // output the start of a span that has no message.  Only the Chrome
+    // format records these
+    static void Begin(TracerRecord& rec);
+
+    // output a notice from the Tracer machinery itself, such as a count of
+    // dropped records
+    static void Notice(const char *source, const char *text);
+
+    // nanoseconds since the epoch
+    static long long Now();
+
+    // nanoseconds from the monotonic clock, for measuring intervals
+    static long long Monotonic();
+
+    // ID of the calling thread
+    static int Thread();
+
+    // format a record as a text line, a Chrome trace event or a JSON line,
+    // with a trailing newline, into 'buffer'.  The message is truncated if
+    // the line would not fit.  Returns the line length
+    static int Format(const TracerRecord& rec, char *buffer, int size);
+
+    // format and write one record as a text line
+    static void Write(const TracerRecord& rec);
+
+    // the same, or add it to the archive, if TRACEARCHIVE is set (see
+    // TracerArchive.h)
+    static void Archive(const TracerRecord& rec);
+
+    // write already formatted output, with a single write()
+    static void Write(const char *data, int length);
+
+    // write already formatted output, through the TracerAsync ring if it
+    // is running.  'timestamp' is the time of its record, if it has one.
+    // Output too long for even a run of slots is written directly, ahead of
+    // any records still in the ring
+    static void Send(const char *data, int length, long long timestamp = 0);
+
+    // send a text line formatted elsewhere, such as by the C trace(),
+    // through the TracerAsync ring, if text output to stderr is going
+    // through it, so that it keeps its place among Tracer lines.  Returns
+    // false, with nothing written, otherwise
+    static bool Relay(const char *data, int length);
+};
+
+
+// the same, for the C trace(), which finds it through a weak reference
+// when the Tracer classes are linked into the program
+extern "C" int tracer_send_line(const char *data, int length);
+
+
+#endif   // __TRACEROUTPUT_H
@@ -0,0 +1,338 @@
+
+#include "TracerProfile.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+//
+// init static variables
+//
+bool        TracerProfile::running  = false;
+
+// settings
+static std::string  folded(TRACER_PROFILE_FILE);
+static int          top     = TRACER_PROFILE_TOP;
+
+
+//
+// one path of nested Tracers.  Nodes are kept in a vector, and refer to
+// each other by index, so a child always comes after its parent.  Node 0
+// is the root, which stands for no open Tracer
+//
+struct ProfileNode
+{
+    const char *format;         // the site's ctor format string
+    const char *group;          // interned or literal, so the pointer stays valid
+    int groupid;
+    int level;
+
+    int parent;
+    int child;                  // first child, or 0
+    int sibling;                // next child of the parent, or 0
+
+    unsigned long long calls;   // Tracers closed on this path
+    long long total;            // nanoseconds, inclusive
+    long long nested;           // nanoseconds of that in child frames
+};
+
+
+//
+// the call tree of a thread, or the merged tree of the process
+//
+struct ProfileTree
+{
+    std::vector<ProfileNode> nodes;
+    int open;                   // the innermost open frame
+
+    ProfileTree()
+        : nodes(1, ProfileNode()), open(0)
+    {
+    }
+};
+
+
+//
+// the merged tree of the threads that have exited.  Never destroyed, so a
+// thread exiting late in the life of the process can still merge into it
+//
+static std::mutex       mergelock;
+static ProfileTree     *merged = new ProfileTree;
+
+
+//
+// the child of a node for a site, added if it is new
+//
+static int Child(ProfileTree& tree, int parent, const char *format, const char *group, int groupid, int level)
+{
+    int last = 0;
+    for (int n = tree.nodes[parent].child; n; n = tree.nodes[n].sibling)
+    {
+        const ProfileNode& node = tree.nodes[n];
+        if ( (node.format == format) && (node.groupid == groupid) && (node.level == level) )
+            return n;
+        last = n;
+    }
+
+    ProfileNode node = ProfileNode();
+    node.format = format;
+    node.group = group;
+    node.groupid = groupid;
+    node.level = level;
+    node.parent = parent;
+
+    int n = (int)tree.nodes.size();
+    tree.nodes.push_back(node);
+    if (last)
+        tree.nodes[last].sibling = n;
+    else
+        tree.nodes[parent].child = n;
+    return n;
+}
+
+
+//
+// add the counts of one tree into another, path by path
+//
+static void Merge(const ProfileTree& from, ProfileTree& into)
+{
+    std::vector<int> map(from.nodes.size(), 0);
+    for (size_t i = 1; i < from.nodes.size(); i++)
+    {
+        const ProfileNode& node = from.nodes[i];
+        int n = Child(into, map[node.parent], node.format, node.group, node.groupid, node.level);
+        map[i] = n;
+
+        into.nodes[n].calls += node.calls;
+        into.nodes[n].total += node.total;
+        into.nodes[n].nested += node.nested;
+    }
+}
+
+
+//
+// a thread's tree, merged into the process tree when the thread exits
+//
+struct ThreadProfile
+{
+    ProfileTree tree;
+
+    ~ThreadProfile()
+    {
+        std::lock_guard<std::mutex> guard(mergelock);
+        Merge(tree, *merged);
+    }
+};
+
+static thread_local ThreadProfile profile;
+
+
+static void ReportAtExit();
+
+
+//
+// turn on profiler mode
+//
+void TracerProfile::Start(const char *path, int sites)
+{
+    if (running)
+        return;
+
+    if (path)
+        folded = path;
+    if (sites > 0)
+        top = sites;
+
+    running = true;
+    atexit(ReportAtExit);
+}
+
+
+//
+// open a frame
+//
+int TracerProfile::Enter(const char *format, const char *group, int groupid, int level)
+{
+    ProfileTree& tree = profile.tree;
+    tree.open = Child(tree, tree.open, format, group, groupid, level);
+    return tree.open;
+}
+
+
+//
+// close a frame.  A Tracer destroyed out of order still closes its own
+// frame, and reopens its parent
+//
+void TracerProfile::Exit(int frame, long long elapsed)
+{
+    ProfileTree& tree = profile.tree;
+    if (frame >= (int)tree.nodes.size())
+        return;
+
+    ProfileNode& node = tree.nodes[frame];
+    ++node.calls;
+    node.total += elapsed;
+    tree.nodes[node.parent].nested += elapsed;
+    tree.open = node.parent;
+}
+
+
+//
+// write one line of the table.  In the text format it goes with the rest
+// of the output, otherwise to stderr
+//
+static void Row(const char *line, int length)
+{
+    if (TracerOutput::Mode() == TRACER_FORMAT_TEXT)
+    {
+        TracerOutput::Write(line, length);
+        return;
+    }
+
+    while (length > 0)
+    {
+        ssize_t n = write(2, line, length);
+        if (n <= 0)
+            return;
+        line += n;
+        length -= (int)n;
+    }
+}
+
+
+//
+// the name of a frame in a folded stack.  ';' separates frames, and a line
+// holds one path, so neither may appear in a name
+//
+static std::string Frame(const ProfileNode& node)
+{
+    std::string name = std::string(node.group) + ":" + (node.format ? node.format : "");
+    for (char& c : name)
+    {
+        if (c == ';')
+            c = ',';
+        else if ( (c == '\n') || (c == '\r') )
+            c = ' ';
+    }
+    return name;
+}
+
+
+//
+// the totals for one site, over every path it appears on
+//
+struct ProfileSite
+{
+    const ProfileNode *node;
+    unsigned long long calls;
+    long long self;
+    long long total;
+};
+
+
+//
+// write the folded stacks and the table for a tree
+//
+static void Write(const ProfileTree& tree)
+{
+    // the folded stacks.  A parent comes before its children, so each path
+    // is its parent's path and one more frame
+    std::vector<std::string> paths(tree.nodes.size());
+    FILE *fp = fopen(folded.c_str(), "w");
+    if (!fp)
+        TracerOutput::Notice("profile", "cannot write the folded stacks to TRACEPROFILE");
+
+    std::map<std::tuple<const char *, int, int>, ProfileSite> sites;
+    for (size_t i = 1; i < tree.nodes.size(); i++)
+    {
+        const ProfileNode& node = tree.nodes[i];
+        long long self = node.total - node.nested;
+
+        paths[i] = (node.parent ? paths[node.parent] + ";" : std::string()) + Frame(node);
+        if ( fp && (self > 0) )
+            fprintf(fp, "%s %lld\n", paths[i].c_str(), self);
+
+        // a site nested in itself has its time counted at the outermost
+        // frame only
+        bool recursive = false;
+        for (int n = node.parent; n && !recursive; n = tree.nodes[n].parent)
+        {
+            const ProfileNode& outer = tree.nodes[n];
+            recursive = (outer.format == node.format) && (outer.groupid == node.groupid) && (outer.level == node.level);
+        }
+
+        ProfileSite& site = sites[std::make_tuple(node.format, node.groupid, node.level)];
+        site.node = &node;
+        site.calls += node.calls;
+        site.self += (self > 0) ? self : 0;
+        if (!recursive)
+            site.total += node.total;
+    }
+
+    if (fp)
+        fclose(fp);
+
+    // the table of the sites with the most self time
+    std::vector<ProfileSite> ranked;
+    for (auto& entry : sites)
+        ranked.push_back(entry.second);
+    std::sort(ranked.begin(), ranked.end(), [](const ProfileSite& a, const ProfileSite& b)
+    {
+        return a.self > b.self;
+    });
+    if ((int)ranked.size() > top)
+        ranked.resize(top);
+
+    char line[512];
+    int length = snprintf(line, sizeof(line), "Tracer: [profile] %-16s %5s %10s %12s %12s  %s\n",
+                          "group", "level", "calls", "self ms", "total ms", "site");
+    Row(line, length);
+
+    for (const ProfileSite& site : ranked)
+    {
+        length = snprintf(line, sizeof(line), "Tracer: [profile] %-16s %5d %10llu %12.3f %12.3f  %.120s\n",
+                          site.node->group, site.node->level, site.calls, site.self / 1e6, site.total / 1e6,
+                          site.node->format ? site.node->format : "");
+        Row(line, (length < (int)sizeof(line)) ? length : (int)sizeof(line) - 1);
+    }
+}
+
+
+//
+// write the profile of the threads that have exited and the calling thread
+//
+void TracerProfile::Report()
+{
+    if (!running)
+        return;
+
+    ProfileTree tree;
+    {
+        std::lock_guard<std::mutex> guard(mergelock);
+        tree = *merged;
+    }
+    Merge(profile.tree, tree);
+    Write(tree);
+}
+
+
+//
+// write the profile at exit.  The exiting thread's tree has been merged
+// already, as its thread_local storage is destroyed before atexit() handlers
+// run
+//
+static void ReportAtExit()
+{
+    std::lock_guard<std::mutex> guard(mergelock);
+    Write(*merged);
+}
@@ -0,0 +1,83 @@
+#ifndef __TRACERPROFILE_H
+#define __TRACERPROFILE_H
+
+//
+//    TracerProfile
+//
+//    Profiler mode.  Instead of printing, every enabled Tracer becomes a
+//    frame in a call tree, from its construction to its destruction, so the
+//    scoped Tracers already in the code make up a profile of it.  Each thread
+//    keeps a stack of its open Tracers, and a tree of every path of nested
+//    Tracers it has seen, with the number of times each path was entered,
+//    its inclusive time, and the part of that spent in no nested Tracer,
+//    its self time.  A frame is a site: a ctor format string, group and
+//    level, as for statistics mode.
+//
+//    At exit the trees of all threads are merged, and written two ways.
+//    The paths go to a file as folded stacks, one line per path, with its
+//    self time in nanoseconds, for flamegraph.pl, speedscope, inferno and
+//    the like:
+//
+//        Db:Handle request;Db:Query %d on %s 7301264
+//        Db:Handle request;Db:Query %d on %s;Net:Send %d bytes 1981207
+//
+//    and a table of the sites with the most self time goes to the usual
+//    output, as for statistics mode:
+//
+//        Tracer: [profile] group    level      calls     self ms    total ms  site
+//        Tracer: [profile] Db          10      12000       7.301       9.282  Query %d on %s
+//
+//    A site's total time leaves out the time it spent nested in itself, so
+//    recursion isn't counted twice.  The program may also write the profile
+//    at any time with Tracer::ReportProfile().
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACEPROFILE=TRUE         turn on profiler mode, writing the folded
+//                                  stacks to TRACER_PROFILE_FILE
+//        TRACEPROFILE=path         ... to the given file
+//        TRACEPROFILETOP=20        sites in the table
+//
+//    The tree of a thread is its own, so a Tracer enters and leaves it with
+//    no lock and no atomic operation; entering costs a walk of the children
+//    of the open frame, and leaving a clock read.  A thread's tree is merged
+//    into the process tree when the thread exits, so the profile leaves out
+//    threads still running at exit, other than the one exiting.  Tracers
+//    must be destroyed on the thread that made them, as scopes are.  If
+//    statistics mode is on too, it takes precedence.
+//
+
+#define TRACER_PROFILE_FILE     "tracer.folded"
+#define TRACER_PROFILE_TOP      20      // sites in the table, by default
+
+
+class TracerProfile
+{
+    static bool running;        // true once Start() is called
+
+public:
+
+    // turn on profiler mode, with the folded stacks written to 'path', and
+    // 'top' sites in the table, at exit
+    static void Start(const char *path, int top);
+
+    // is profiler mode on?
+    static bool Running()
+    {
+        return running;
+    }
+
+    // open a frame for a site, nested in the thread's open frame.  Returns
+    // the frame, never 0
+    static int Enter(const char *format, const char *group, int groupid, int level);
+
+    // close a frame 'elapsed' nanoseconds after it was opened
+    static void Exit(int frame, long long elapsed);
+
+    // write the folded stacks and the table now
+    static void Report();
+};
+
+
+#endif   // __TRACERPROFILE_H
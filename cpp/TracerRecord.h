@@ -0,0 +1,42 @@
+#ifndef __TRACERRECORD_H
+#define __TRACERRECORD_H
+
+//
+//    TracerRecord
+//
+//    One Tracer output record, as handed from a Tracer to the output path.
+//    The group and text pointers are only valid for the duration of the call
+//    they are passed to; anything that keeps a record must copy them.
+//
+
+//
+// possible values for TracerRecord::kind
+//
+#define TRACER_RECORD_MESSAGE   0       // from Print()
+#define TRACER_RECORD_EXIT      1       // the -exit- line from the dtor
+#define TRACER_RECORD_BEGIN     2       // from the ctor.  May have no text,
+                                        // when only the start of the span is
+                                        // recorded
+
+
+struct TracerRecord
+{
+    int kind;                   // TRACER_RECORD_xxx
+    int serial;                 // serial number of the Tracer
+    int groupid;                // TracerGroups ID of the group
+    int level;                  // trace level of the Tracer
+    int thread;                 // ID of the thread that made the record
+    long long timestamp;        // nanoseconds since the epoch, if the output needs it
+    const char *group;          // group name
+    const char *text;           // formatted message, not null terminated
+    int length;                 // length of text
+    int depth;                  // nesting depth of the Tracer, in timing mode
+    long long elapsed;          // for exit records in timing mode, nanoseconds
+                                // since the Tracer was constructed, otherwise -1
+    int suppressed;             // limited Print() calls suppressed since the last
+                                // one printed, or for exit records, over the life
+                                // of the Tracer
+};
+
+
+#endif   // __TRACERRECORD_H
@@ -0,0 +1,868 @@
+
+#include "TracerRecorder.h"
+#include "TracerOutput.h"
+#include "TracerFormat.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+//
+// the content of one record
+//
+struct Entry
+{
+    int kind;                   // TRACER_RECORD_xxx
+    int serial;
+    int level;
+    int thread;
+    int depth;
+    int suppressed;
+    int length;
+    long long timestamp;        // nanoseconds since the epoch
+    long long elapsed;          // for exit records in timing mode, otherwise -1
+    const char *group;          // interned or literal, so the pointer stays valid
+    char text[TRACER_RECORDER_TEXT];
+};
+
+
+//
+// one ring slot.  'sequence' is a sequence lock: for the record numbered n
+// in its ring, 2n+1 while the record is being written, and 2n+2 once it is
+// complete, so a dump can tell a whole record from a torn or stale one
+//
+struct Slot
+{
+    std::atomic<unsigned long> sequence;
+    Entry entry;
+};
+
+static_assert(sizeof(Slot) <= TRACER_RECORDER_SLOT, "TRACER_RECORDER_TEXT too large for TRACER_RECORDER_SLOT");
+
+
+//
+// a reader's place in one ring.  Dump() and Capture() each have their own,
+// so a crash dump can be written while a capture is
+//
+struct Reader
+{
+    unsigned long cursor;                   // next record to read
+    unsigned long end;                      // records written when the reading began
+    bool held;                              // 'entry' holds record 'cursor'
+    Entry entry;
+};
+
+#define READ_DUMP       0
+#define READ_CAPTURE    1
+
+
+//
+// the ring of one thread.  Only the owning thread writes to it.  Rings are
+// never freed, so a dump may walk the list at any time
+//
+struct Ring
+{
+    std::atomic<int> owner;                 // thread ID of the owner, 0 if free
+    std::atomic<unsigned long> next;        // number of records written
+    Ring *link;                             // next ring in the list
+    Slot *slots;
+    Reader readers[2];                      // READ_DUMP and READ_CAPTURE
+};
+
+
+//
+// init static variables
+//
+bool        TracerRecorder::running     = false;
+int         TracerRecorder::threshold   = 0;
+
+
+//
+// recorder state
+//
+static std::atomic<Ring *>          rings(0);
+static unsigned long                mask        = 0;
+static char                         path[256];  // dump file, or empty for stderr
+static std::atomic<bool>            dumping(false);
+static struct sigaction             previous[2];    // for SIGSEGV and SIGABRT
+
+
+//
+// trigger state.  The trigger is armed until a record matches it, then
+// fired while the records after it are counted down, then written out
+//
+#define TRIGGER_OFF         0
+#define TRIGGER_ARMED       1
+#define TRIGGER_FIRING      2       // the matching thread is noting the trigger
+#define TRIGGER_FIRED       3
+#define TRIGGER_WRITING     4
+
+static std::atomic<int>             phase(TRIGGER_OFF);
+static std::atomic<long>            remaining(0);       // records still to come after the trigger
+static char                         triggergroup[64];   // empty if there is no trigger
+static int                          triggerlevel    = 0;
+static char                         triggerprefix[TRACER_RECORDER_TEXT];
+static int                          prefixlength    = 0;
+static int                          before          = 0;
+static int                          after           = 0;
+static int                          triggerserial   = 0;
+static long long                    triggertime     = 0;
+static long long                    captured        = 0;    // time of the newest record captured
+
+//
+// capture thread state.  A window is written by a thread of its own, so
+// the traced thread that completes it doesn't wait for the write
+//
+static std::mutex                   capturelock;
+static std::condition_variable      wakeup;
+static bool                         stopping        = false;
+static std::thread                 *capturer        = 0;
+
+
+//
+// gives a thread's ring back when the thread exits
+//
+struct Owner
+{
+    Ring *ring;
+    char *stack;                            // alternate signal stack, if installed here
+
+    ~Owner()
+    {
+        if (ring)
+            ring->owner.store(0, std::memory_order_release);
+
+        // the stack is only freed once it is no longer in use
+        if (stack)
+        {
+            stack_t current;
+            if ( (sigaltstack(0, &current) == 0) && (current.ss_sp == stack) )
+            {
+                stack_t off;
+                memset(&off, 0, sizeof(off));
+                off.ss_flags = SS_DISABLE;
+                if (sigaltstack(&off, 0) == 0)
+                    delete[] stack;
+            }
+        }
+    }
+};
+
+static thread_local Owner owner = { 0, 0 };
+
+
+//
+// give the calling thread an alternate signal stack, so the crash handler
+// can run after a stack overflow.  A thread that already has one, from the
+// program or from here, keeps it
+//
+static void AlternateStack()
+{
+    if (owner.stack)
+        return;
+
+    stack_t current;
+    if ( (sigaltstack(0, &current) != 0) || !(current.ss_flags & SS_DISABLE) )
+        return;
+
+    stack_t stack;
+    memset(&stack, 0, sizeof(stack));
+    stack.ss_sp = new char[TRACER_RECORDER_STACK];
+    stack.ss_size = TRACER_RECORDER_STACK;
+    if (sigaltstack(&stack, 0) == 0)
+        owner.stack = (char *)stack.ss_sp;
+    else
+        delete[] (char *)stack.ss_sp;
+}
+
+
+static void Capturer();
+static void CaptureAtExit();
+
+
+//
+// dump at exit
+//
+static void DumpAtExit()
+{
+    TracerRecorder::Dump("exit");
+}
+
+
+//
+// arm the trigger: group:level[:prefix]
+//
+void TracerRecorder::Trigger(const char *setting, int aBefore, int aAfter)
+{
+    const char *colon = strchr(setting, ':');
+    int length = colon ? (int)(colon - setting) : (int)strlen(setting);
+    if ( (length == 0) || (length >= (int)sizeof(triggergroup)) )
+    {
+        TracerOutput::Notice("recorder", "TRACETRIGGER needs a group, as group:level[:prefix]");
+        return;
+    }
+    memcpy(triggergroup, setting, length);
+    triggergroup[length] = 0;
+
+    // with no level, any level triggers
+    triggerlevel = colon ? atoi(colon + 1) : INT_MAX;
+
+    const char *prefix = colon ? strchr(colon + 1, ':') : 0;
+    prefixlength = 0;
+    if (prefix)
+    {
+        strncpy(triggerprefix, prefix + 1, sizeof(triggerprefix) - 1);
+        triggerprefix[sizeof(triggerprefix) - 1] = 0;
+        prefixlength = (int)strlen(triggerprefix);
+    }
+
+    before = (aBefore > 0) ? aBefore : 1;
+    after = (aAfter > 0) ? aAfter : 0;
+}
+
+
+//
+// start recording
+//
+void TracerRecorder::Start(int level, unsigned slots, const char *aPath, bool dumpatexit)
+{
+    if (running)
+        return;
+
+    // a whole capture window from one thread must fit in its ring
+    if ( triggergroup[0] && (slots < (unsigned)(before + after)) )
+        slots = before + after;
+
+    unsigned long size = 2;
+    while (size < slots)
+        size <<= 1;
+    mask = size - 1;
+
+    // the path is copied now, since the crash handler can't allocate
+    path[0] = 0;
+    if (aPath)
+    {
+        strncpy(path, aPath, sizeof(path) - 1);
+        path[sizeof(path) - 1] = 0;
+    }
+
+    threshold = level;
+
+    // SA_ONSTACK takes effect on threads with an alternate stack: this one,
+    // and each thread as it starts recording
+    AlternateStack();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Crash;
+    action.sa_flags = SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous[0]);
+    sigaction(SIGABRT, &action, &previous[1]);
+
+    if (dumpatexit)
+        atexit(DumpAtExit);
+
+    if (triggergroup[0])
+    {
+        phase.store(TRIGGER_ARMED, std::memory_order_release);
+        capturer = new std::thread(Capturer);
+        atexit(CaptureAtExit);
+    }
+
+    running = true;
+}
+
+
+//
+// SIGSEGV and SIGABRT handler.  Dump, then put back the handler that was
+// there before, and let it have the signal.  The signal is blocked while
+// this runs, so it is delivered again as soon as this returns
+//
+void TracerRecorder::Crash(int signal)
+{
+    Dump((signal == SIGSEGV) ? "SIGSEGV" : "SIGABRT");
+
+    sigaction(signal, &previous[(signal == SIGSEGV) ? 0 : 1], 0);
+    raise(signal);
+}
+
+
+//
+// the calling thread's ring.  Takes over the ring of a thread that has
+// exited, if there is one, or else makes a new one
+//
+static Ring *Mine()
+{
+    if (owner.ring)
+        return owner.ring;
+
+    AlternateStack();
+    int self = TracerOutput::Thread();
+
+    for (Ring *r = rings.load(std::memory_order_acquire); r; r = r->link)
+    {
+        int expected = 0;
+        if ( (r->owner.load(std::memory_order_relaxed) == 0) &&
+             r->owner.compare_exchange_strong(expected, self, std::memory_order_acquire) )
+        {
+            owner.ring = r;
+            return r;
+        }
+    }
+
+    Ring *r = new Ring;
+    r->owner.store(self, std::memory_order_relaxed);
+    r->next.store(0, std::memory_order_relaxed);
+    r->slots = new Slot[mask + 1];
+    for (unsigned long i = 0; i <= mask; i++)
+        r->slots[i].sequence.store(0, std::memory_order_relaxed);
+    for (Reader& reader : r->readers)
+    {
+        reader.cursor = 0;
+        reader.end = 0;
+        reader.held = false;
+    }
+
+    r->link = rings.load(std::memory_order_relaxed);
+    while (!rings.compare_exchange_weak(r->link, r, std::memory_order_release, std::memory_order_relaxed))
+        ;
+
+    owner.ring = r;
+    return r;
+}
+
+
+//
+// start writing the next record of the calling thread's ring, filling in
+// everything but the text
+//
+static Slot *Claim(const TracerRecord& rec, Ring *& ring, unsigned long& n)
+{
+    ring = Mine();
+    n = ring->next.load(std::memory_order_relaxed);
+
+    Slot *slot = &ring->slots[n & mask];
+    slot->sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Entry& entry = slot->entry;
+    entry.kind = rec.kind;
+    entry.serial = rec.serial;
+    entry.level = rec.level;
+    entry.thread = rec.thread;
+    entry.depth = rec.depth;
+    entry.suppressed = rec.suppressed;
+    entry.length = 0;
+    entry.timestamp = TracerOutput::Now();
+    entry.elapsed = rec.elapsed;
+    entry.group = rec.group;
+    return slot;
+}
+
+
+//
+// does a record match the trigger?
+//
+static bool Matches(const Entry& entry)
+{
+    return (entry.kind != TRACER_RECORD_EXIT) && (entry.level <= triggerlevel) &&
+           ( (0 == strcmp(triggergroup, "ALL")) || (0 == strcmp(triggergroup, entry.group)) ) &&
+           (entry.length >= prefixlength) && (0 == memcmp(entry.text, triggerprefix, prefixlength));
+}
+
+
+//
+// hand a window that is ready to the capture thread
+//
+static void Wake()
+{
+    std::lock_guard<std::mutex> guard(capturelock);
+    wakeup.notify_one();
+}
+
+
+//
+// fire the trigger on a matching record, or count down the records after
+// it, handing the capture over once the last of them is recorded
+//
+static void Watch(const Entry& entry)
+{
+    int state = phase.load(std::memory_order_acquire);
+
+    if ( (state == TRIGGER_ARMED) && Matches(entry) )
+    {
+        if (!phase.compare_exchange_strong(state, TRIGGER_FIRING, std::memory_order_acquire))
+            return;
+
+        triggerserial = entry.serial;
+        triggertime = entry.timestamp;
+        remaining.store(after, std::memory_order_relaxed);
+
+        if (after == 0)
+        {
+            phase.store(TRIGGER_WRITING, std::memory_order_release);
+            Wake();
+        }
+        else
+            phase.store(TRIGGER_FIRED, std::memory_order_release);
+    }
+    else if ( (state == TRIGGER_FIRED) && (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) )
+    {
+        if (phase.compare_exchange_strong(state, TRIGGER_WRITING, std::memory_order_acquire))
+            Wake();
+    }
+}
+
+
+//
+// finish writing a record
+//
+static void Publish(Ring *ring, Slot *slot, unsigned long n)
+{
+    slot->sequence.store(2 * n + 2, std::memory_order_release);
+    ring->next.store(n + 1, std::memory_order_release);
+
+    if (phase.load(std::memory_order_relaxed) != TRIGGER_OFF)
+        Watch(slot->entry);
+}
+
+
+//
+// record a message, formatted from a va_list
+//
+void TracerRecorder::Record(const TracerRecord& rec, const char *format, va_list arg_list)
+{
+    Ring *ring;
+    unsigned long n;
+    Slot *slot = Claim(rec, ring, n);
+
+    int length = vsnprintf(slot->entry.text, TRACER_RECORDER_TEXT, format, arg_list);
+    if (length < 0)
+        length = 0;
+    slot->entry.length = (length < TRACER_RECORDER_TEXT) ? length : TRACER_RECORDER_TEXT - 1;
+
+    Publish(ring, slot, n);
+}
+
+
+//
+// record a message, formatted from captured arguments
+//
+void TracerRecorder::Record(const TracerRecord& rec, const char *format, const TracerArg *args, int count)
+{
+    Ring *ring;
+    unsigned long n;
+    Slot *slot = Claim(rec, ring, n);
+
+    TracerBuffer out(slot->entry.text, TRACER_RECORDER_TEXT);
+    TracerFormat::Format(out, format, args, count);
+    slot->entry.length = (out.Length() < TRACER_RECORDER_TEXT) ? out.Length() : TRACER_RECORDER_TEXT;
+
+    Publish(ring, slot, n);
+}
+
+
+//
+// record an exit record
+//
+void TracerRecorder::Record(const TracerRecord& rec)
+{
+    Ring *ring;
+    unsigned long n;
+    Slot *slot = Claim(rec, ring, n);
+    Publish(ring, slot, n);
+}
+
+
+//
+// read the record at a reader's cursor into its 'entry', skipping any that
+// are being written, or have already been overwritten.  Returns false when
+// there are no more
+//
+static bool Load(Ring *ring, Reader& reader)
+{
+    for ( ; reader.cursor < reader.end; reader.cursor++)
+    {
+        const Slot& slot = ring->slots[reader.cursor & mask];
+        unsigned long expected = 2 * reader.cursor + 2;
+
+        if (slot.sequence.load(std::memory_order_acquire) != expected)
+            continue;
+        memcpy(&reader.entry, &slot.entry, sizeof(Entry));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != expected)
+            continue;
+
+        reader.held = true;
+        return true;
+    }
+
+    reader.held = false;
+    return false;
+}
+
+
+//
+// a line being built by Dump().  Only async signal safe work is allowed,
+// so there is no snprintf
+//
+struct Line
+{
+    char data[TRACER_RECORDER_TEXT + 256];
+    int length;
+
+    // leaves room for the newline
+    void Append(const char *text, int n)
+    {
+        if (n > (int)sizeof(data) - 1 - length)
+            n = (int)sizeof(data) - 1 - length;
+        memcpy(data + length, text, n);
+        length += n;
+    }
+
+    void Append(const char *text)
+    {
+        Append(text, (int)strlen(text));
+    }
+
+    // a number, zero padded to 'width' digits
+    void Number(long long value, int width = 0)
+    {
+        char digits[24];
+        int n = 0;
+        bool negative = (value < 0);
+        unsigned long long v = negative ? 0 - (unsigned long long)value : (unsigned long long)value;
+
+        do
+        {
+            digits[sizeof(digits) - 1 - n++] = (char)('0' + v % 10);
+            v /= 10;
+        } while ( (v != 0) || (n < width) );
+
+        if (negative)
+            digits[sizeof(digits) - 1 - n++] = '-';
+        Append(digits + sizeof(digits) - n, n);
+    }
+};
+
+
+//
+// format one record as a line, with its newline
+//
+static void Describe(Line& line, const Entry& entry)
+{
+    line.length = 0;
+    line.Append("Tracer: ");
+    line.Number(entry.timestamp / 1000000000LL);
+    line.Append(".");
+    line.Number((entry.timestamp % 1000000000LL) / 1000, 6);
+    line.Append(" [");
+    line.Number(entry.serial);
+    line.Append("][");
+    line.Append(entry.group);
+    line.Append(", ");
+    line.Number(entry.level);
+    line.Append("][");
+    line.Number(entry.thread);
+    line.Append("] ");
+    for (int i = 0; i < entry.depth; i++)
+        line.Append("  ", 2);
+
+    if (entry.kind == TRACER_RECORD_EXIT)
+    {
+        line.Append("-exit-");
+        if (entry.elapsed >= 0)
+        {
+            line.Append(" ");
+            line.Number(entry.elapsed);
+            line.Append(" ns");
+        }
+    }
+    else
+        line.Append(entry.text, entry.length);
+
+    if (entry.suppressed)
+    {
+        line.Append(" (");
+        line.Number(entry.suppressed);
+        line.Append(" suppressed)");
+    }
+    line.data[line.length++] = '\n';
+}
+
+
+//
+// write all of 'data' with write(), which is async signal safe
+//
+static void WriteAll(int fd, const char *data, int length)
+{
+    while (length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        data += n;
+        length -= (int)n;
+    }
+}
+
+
+//
+// open the file dumps go to, or stderr
+//
+static int Open()
+{
+    int fd = 2;
+    if (path[0])
+    {
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+            fd = 2;
+    }
+    return fd;
+}
+
+
+//
+// start reading every ring from its oldest record, up to the records
+// written by now, as the given READ_xxx reader
+//
+static void Rewind(Ring *first, int which)
+{
+    for (Ring *r = first; r; r = r->link)
+    {
+        Reader& reader = r->readers[which];
+        reader.end = r->next.load(std::memory_order_acquire);
+        reader.cursor = (reader.end > mask + 1) ? reader.end - (mask + 1) : 0;
+        Load(r, reader);
+    }
+}
+
+
+//
+// the ring whose reader holds the oldest record, or 0 if none hold any
+//
+static Ring *Oldest(Ring *first, int which)
+{
+    Ring *oldest = 0;
+    for (Ring *r = first; r; r = r->link)
+    {
+        const Reader& reader = r->readers[which];
+        if ( reader.held && (!oldest || (reader.entry.timestamp < oldest->readers[which].entry.timestamp)) )
+            oldest = r;
+    }
+    return oldest;
+}
+
+
+//
+// write every thread's records, merged in time order
+//
+void TracerRecorder::Dump(const char *reason)
+{
+    if ( !running || dumping.exchange(true) )
+        return;
+
+    int fd = Open();
+
+    Line line;
+    line.length = 0;
+    line.Append("Tracer: [recorder] dump on ");
+    line.Append(reason);
+    line.Append("\n");
+    WriteAll(fd, line.data, line.length);
+
+    // rings made after this are left out
+    Ring *first = rings.load(std::memory_order_acquire);
+    Rewind(first, READ_DUMP);
+
+    long long count = 0;
+    for (;;)
+    {
+        Ring *oldest = Oldest(first, READ_DUMP);
+        if (!oldest)
+            break;
+
+        Reader& reader = oldest->readers[READ_DUMP];
+        Describe(line, reader.entry);
+        WriteAll(fd, line.data, line.length);
+        ++count;
+
+        reader.cursor++;
+        Load(oldest, reader);
+    }
+
+    line.length = 0;
+    line.Append("Tracer: [recorder] end of dump, ");
+    line.Number(count);
+    line.Append(" records\n");
+    WriteAll(fd, line.data, line.length);
+
+    if (fd != 2)
+        close(fd);
+    dumping.store(false);
+}
+
+
+//
+// write the capture window around the trigger: up to 'before' records to
+// it, and 'after' records after it, merged in time order, then re-arm.
+// Called by the capture thread, or at exit, once the trigger has moved to
+// TRIGGER_WRITING
+//
+static void Capture()
+{
+    // count the records up to the trigger, less any an earlier capture
+    // wrote, to know how many of the oldest to leave out
+    Ring *first = rings.load(std::memory_order_acquire);
+    Rewind(first, READ_CAPTURE);
+
+    long long leading = 0;
+    for (Ring *r = first; r; r = r->link)
+    {
+        Reader& reader = r->readers[READ_CAPTURE];
+        while (reader.held)
+        {
+            if ( (reader.entry.timestamp > captured) && (reader.entry.timestamp <= triggertime) )
+                ++leading;
+            reader.cursor++;
+            Load(r, reader);
+        }
+    }
+    long long skip = leading - before;
+
+    int fd = Open();
+
+    Line line;
+    line.length = 0;
+    line.Append("Tracer: [recorder] capture on trigger, serial ");
+    line.Number(triggerserial);
+    line.Append("\n");
+    WriteAll(fd, line.data, line.length);
+
+    long long upto = 0;
+    long long later = 0;
+    long long newest = captured;
+
+    Rewind(first, READ_CAPTURE);
+    for (;;)
+    {
+        Ring *oldest = Oldest(first, READ_CAPTURE);
+        if (!oldest)
+            break;
+
+        Reader& reader = oldest->readers[READ_CAPTURE];
+        const Entry& entry = reader.entry;
+        if ( (entry.timestamp > triggertime) && (later >= after) )
+            break;
+
+        // records an earlier capture wrote are left out
+        bool write = false;
+        if (entry.timestamp <= captured)
+            write = false;
+        else if (entry.timestamp <= triggertime)
+        {
+            if (skip > 0)
+                --skip;
+            else
+            {
+                write = true;
+                ++upto;
+            }
+        }
+        else
+        {
+            write = true;
+            ++later;
+        }
+
+        if (write)
+        {
+            Describe(line, entry);
+            WriteAll(fd, line.data, line.length);
+            if (entry.timestamp > newest)
+                newest = entry.timestamp;
+        }
+
+        reader.cursor++;
+        Load(oldest, reader);
+    }
+
+    line.length = 0;
+    line.Append("Tracer: [recorder] end of capture, ");
+    line.Number(upto);
+    line.Append(" records to the trigger, ");
+    line.Number(later);
+    line.Append(" after\n");
+    WriteAll(fd, line.data, line.length);
+
+    if (fd != 2)
+        close(fd);
+
+    captured = newest;
+    phase.store(TRIGGER_ARMED, std::memory_order_release);
+}
+
+
+//
+// capture thread.  Writes each window it is handed, until stopped
+//
+static void Capturer()
+{
+    std::unique_lock<std::mutex> sleeping(capturelock);
+    for (;;)
+    {
+        wakeup.wait(sleeping, [] { return stopping || (phase.load(std::memory_order_acquire) == TRIGGER_WRITING); });
+
+        if (phase.load(std::memory_order_acquire) == TRIGGER_WRITING)
+        {
+            sleeping.unlock();
+            Capture();
+            sleeping.lock();
+        }
+        else
+            break;
+    }
+}
+
+
+//
+// stop the capture thread at exit, once it has written any window it was
+// handed, and write a window still open
+//
+static void CaptureAtExit()
+{
+    {
+        std::lock_guard<std::mutex> guard(capturelock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+
+    if (capturer)
+    {
+        capturer->join();
+        delete capturer;
+        capturer = 0;
+    }
+
+    int state = TRIGGER_FIRED;
+    if (phase.compare_exchange_strong(state, TRIGGER_WRITING, std::memory_order_acquire))
+        Capture();
+}
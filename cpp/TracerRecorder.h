@@ -0,0 +1,134 @@
+#ifndef __TRACERRECORDER_H
+#define __TRACERRECORDER_H
+
+#include "TracerRecord.h"
+
+#include <stdarg.h>
+
+//
+//    TracerRecorder
+//
+//    An in-memory flight recorder.  Records whose level is at or below the
+//    recorder level are kept in a fixed size ring for each thread, whatever
+//    their group, and whether or not they are also printed.  Nothing is
+//    written during a normal run; the last records of every thread are
+//    dumped, merged in time order, when
+//
+//        - the process gets a SIGSEGV or SIGABRT
+//        - the program calls Tracer::DumpRecorder()
+//        - the program exits, if TRACERECORDEXIT is TRUE
+//
+//    so a process can run with little output, and still leave behind the
+//    detail leading up to a crash:
+//
+//        Tracer: [recorder] dump on SIGSEGV
+//        Tracer: 1692812345.120339 [812][Db, 20][4711] Query 3 of 5
+//        Tracer: 1692812345.120417 [812][Db, 20][4711] -exit-
+//        Tracer: [recorder] end of dump, 2 records
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACERECORD=20            turn on the recorder, keeping records of
+//                                  level 20 and below
+//        TRACERECORDSIZE=1024      records kept per thread (rounded up to a
+//                                  power of 2)
+//        TRACERECORDFILE=path      append dumps to a file, instead of stderr
+//        TRACERECORDEXIT=TRUE      also dump at exit
+//
+//    The recorder can also be armed with a trigger, so that it captures
+//    detail only around the moments that matter, as a logic analyzer does.
+//    When a recorded message matches the trigger, the recorder waits for a
+//    given number of records more, then writes a capture window: a given
+//    number of records up to and including the trigger, and those after
+//    it, merged in time order.  It then re-arms, and a later capture leaves
+//    out records an earlier one has written:
+//
+//        Tracer: [recorder] capture on trigger, serial 815
+//        Tracer: 1692812345.120339 [812][Db, 20][4711] Query 3 of 5
+//        Tracer: 1692812345.120502 [815][Db, 1][4711] Query failed: timeout
+//        Tracer: 1692812345.120517 [816][Db, 20][4711] Retrying
+//        Tracer: [recorder] end of capture, 2 records to the trigger, 1 after
+//
+//    Controlled by
+//
+//        TRACETRIGGER=Db:1         trigger on a message of group Db, at level
+//                                  1 or below.  The group may be ALL
+//        TRACETRIGGER=Db:1:Query failed
+//                                  ... whose text starts with "Query failed"
+//        TRACETRIGGERBEFORE=256    records written up to the trigger
+//        TRACETRIGGERAFTER=256     records written after it
+//
+//    Captures go where dumps go.  TRACETRIGGER starts the recorder if
+//    TRACERECORD doesn't, keeping records of every level, and the rings are
+//    made big enough for a whole window from one thread.  A window is
+//    written by a thread the recorder starts for it, so the traced thread
+//    that completes one only hands it over.  A window still open at exit is
+//    written then.  A crash dump keeps its own place in each ring, so it is
+//    written even while a capture is.
+//
+//    A thread records into its own ring, so recording takes no lock.  The
+//    ring of a thread that exits is handed to the next new thread, and
+//    keeps its records until they are overwritten.  The crash dump uses
+//    only async signal safe calls, and skips any record a thread was in the
+//    middle of writing.  It runs on an alternate signal stack, of its own
+//    for each thread that records, so a SIGSEGV from a stack overflow is
+//    still dumped.  Once the dump is written, the signal is raised
+//    again with the handler that was installed before the recorder's.
+//    Messages longer than TRACER_RECORDER_TEXT characters are truncated.
+//
+
+#define TRACER_RECORDER_SLOTS   1024    // default records kept per thread
+#define TRACER_RECORDER_SLOT    256     // bytes per record
+#define TRACER_RECORDER_TEXT    (TRACER_RECORDER_SLOT - 64)
+#define TRACER_TRIGGER_BEFORE   256     // default records written up to a trigger
+#define TRACER_TRIGGER_AFTER    256     // default records written after it
+#define TRACER_RECORDER_STACK   65536   // bytes of alternate signal stack per thread
+
+
+struct TracerArg;
+
+
+class TracerRecorder
+{
+    static bool running;        // true once Start() is called
+    static int threshold;       // the recorder level
+
+    static void Crash(int signal);
+
+public:
+
+    // start recording records of 'level' and below, keeping 'slots' records
+    // per thread.  Dumps go to the file at 'path', or to stderr if it is 0.
+    // Installs the crash handlers, and if 'dumpatexit' is set, dumps at exit
+    static void Start(int level, unsigned slots, const char *path, bool dumpatexit);
+
+    // arm the recorder with a TRACETRIGGER 'setting', writing 'before'
+    // records up to each trigger and 'after' records after it.  Called
+    // before Start()
+    static void Trigger(const char *setting, int before, int after);
+
+    // are records of this level recorded?
+    static bool Records(int aLevel)
+    {
+        return running && (aLevel <= threshold);
+    }
+
+    // record a message, formatted from 'format' and 'arg_list'
+    static void Record(const TracerRecord& rec, const char *format, va_list arg_list);
+
+    // record a message, formatted from arguments captured by the Tracer
+    // templates
+    static void Record(const TracerRecord& rec, const char *format, const TracerArg *args, int count);
+
+    // record an exit record
+    static void Record(const TracerRecord& rec);
+
+    // write every thread's records, oldest first, giving 'reason' in the
+    // header line.  Async signal safe.  Does nothing if a dump is already
+    // being written
+    static void Dump(const char *reason);
+};
+
+
+#endif   // __TRACERRECORDER_H
@@ -0,0 +1,229 @@
+
+#include "TracerShared.h"
+#include "Tracer.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <mutex>
+#include <thread>
+
+
+//
+// init static variables
+//
+TracerSharedSegment    *TracerShared::segment   = 0;
+std::atomic<unsigned>   TracerShared::seen(0);
+
+// name of the segment, and the process that created it, for removing it at
+// exit
+static char             name[64];
+static int              creator     = 0;
+
+// serializes installing requested settings
+static std::mutex       installlock;
+
+
+//
+// copy a string into a fixed size field, truncating it if need be
+//
+static void Copy(char *field, int size, const char *text)
+{
+    int length = text ? (int)strlen(text) : 0;
+    if (length >= size)
+        length = size - 1;
+    memcpy(field, text, length);
+    field[length] = 0;
+}
+
+
+//
+// create and publish the segment
+//
+std::atomic<int> *TracerShared::Start(const char *groups, int level, bool only, int epoch)
+{
+    if (segment)
+        return &segment->epoch;
+
+    creator = (int)getpid();
+    snprintf(name, sizeof(name), TRACER_SHARED_PATH "%d", creator);
+
+    int fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return 0;
+
+    // the file is sparse, so only the pages written use memory
+    void *mapped = MAP_FAILED;
+    if (ftruncate(fd, sizeof(TracerSharedSegment)) == 0)
+        mapped = mmap(0, sizeof(TracerSharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        unlink(name);
+        return 0;
+    }
+
+    // the mapping starts out zeroed, which is a valid empty state for every
+    // member, so only the header needs filling in
+    TracerSharedSegment *s = (TracerSharedSegment *)mapped;
+    s->size = sizeof(TracerSharedSegment);
+    s->pid = (int)getpid();
+    s->epoch.store(epoch, std::memory_order_relaxed);
+    Copy(s->current.groups, sizeof(s->current.groups), groups);
+    s->current.level = level;
+    s->current.only = only;
+
+    // tracerctl only trusts a segment once its magic number is set
+    s->version = TRACER_SHARED_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    s->magic = TRACER_SHARED_MAGIC;
+
+    segment = s;
+    atexit(Remove);
+    return &s->epoch;
+}
+
+
+//
+// remove the segment at exit.  It stays mapped, since other threads may
+// still be tracing.  A forked child runs the same atexit() handlers, but
+// the segment belongs to its parent
+//
+void TracerShared::Remove()
+{
+    if ( segment && ((int)getpid() == creator) )
+        unlink(name);
+}
+
+
+//
+// install the settings tracerctl has asked for.  They are copied, then the
+// request count read again, so settings rewritten meanwhile are never used.
+// An odd count is noted as seen too, so that while tracerctl writes, or if
+// it was killed part way, Poll() goes back to a load and a compare until
+// the count moves on
+//
+void TracerShared::Install()
+{
+    std::lock_guard<std::mutex> guard(installlock);
+
+    unsigned request = segment->request.load(std::memory_order_acquire);
+    if (request == seen.load(std::memory_order_relaxed))
+        return;
+    if (request & 1)
+    {
+        seen.store(request, std::memory_order_relaxed);
+        return;
+    }
+
+    TracerSharedSettings wanted;
+    memcpy(&wanted, &segment->wanted, sizeof(wanted));
+    wanted.groups[sizeof(wanted.groups) - 1] = 0;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (segment->request.load(std::memory_order_relaxed) != request)
+        return;
+
+    seen.store(request, std::memory_order_relaxed);
+    Tracer::Apply(wanted.groups, wanted.level, wanted.only != 0);
+    segment->applied.store(request, std::memory_order_release);
+
+    char notice[TRACER_SHARED_GROUPS + 64];
+    snprintf(notice, sizeof(notice), "TRACEGROUP=%s TRACELEVEL=%d TRACEONLY=%s",
+             wanted.groups, wanted.level, wanted.only ? "TRUE" : "FALSE");
+    TracerOutput::Notice("tracerctl", notice);
+}
+
+
+//
+// publish the settings in force
+//
+void TracerShared::Settings(const char *groups, int level, bool only)
+{
+    if (!segment)
+        return;
+
+    Copy(segment->current.groups, sizeof(segment->current.groups), groups);
+    segment->current.level = level;
+    segment->current.only = only;
+}
+
+
+//
+// publish a group.  The name is written before the group count is
+// raised past it, so tracerctl never sees a group without its name
+//
+void TracerShared::Group(int id, const char *groupname, bool enabled, int threshold)
+{
+    if ( !segment || (id <= 0) || (id > TRACER_MAX_GROUPS) )
+        return;
+
+    TracerSharedGroup& g = segment->groups[id];
+    if (!g.name[0])
+        Copy(g.name, sizeof(g.name), groupname);
+    g.threshold.store(threshold, std::memory_order_relaxed);
+    g.enabled.store(enabled, std::memory_order_relaxed);
+
+    int count = segment->groupcount.load(std::memory_order_relaxed);
+    while ( (id > count) &&
+            !segment->groupcount.compare_exchange_weak(count, id, std::memory_order_release) )
+        ;
+}
+
+
+//
+// find the entry for a call site, claiming one if need be.  Sites are keyed
+// by their address, which is fixed for the life of the process
+//
+TracerSharedSite *TracerShared::Site(const void *site, const char *format, int groupid, int level)
+{
+    if (!segment)
+        return 0;
+
+    unsigned long long address = (unsigned long long)(uintptr_t)site;
+    unsigned index = (unsigned)((address * 0x9e3779b97f4a7c15ULL) >> 40) & (TRACER_SHARED_SITES - 1);
+
+    for (int probes = 0; probes < TRACER_SHARED_SITES; )
+    {
+        TracerSharedSite& entry = segment->sites[index];
+        int state = entry.state.load(std::memory_order_acquire);
+
+        if (state == TRACER_SHARED_EMPTY)
+        {
+            int expected = TRACER_SHARED_EMPTY;
+            if (!entry.state.compare_exchange_strong(expected, TRACER_SHARED_FILLING))
+                continue;
+
+            // this thread owns the entry
+            entry.address = address;
+            entry.groupid = groupid;
+            entry.level = level;
+            Copy(entry.format, sizeof(entry.format), format);
+            entry.state.store(TRACER_SHARED_READY, std::memory_order_release);
+            return &entry;
+        }
+
+        if (state == TRACER_SHARED_FILLING)
+        {
+            // another thread is filling this entry; wait for it
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (entry.address == address)
+            return &entry;
+
+        index = (index + 1) & (TRACER_SHARED_SITES - 1);
+        ++probes;
+    }
+
+    segment->sitesfull.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
@@ -0,0 +1,183 @@
+#ifndef __TRACERSHARED_H
+#define __TRACERSHARED_H
+
+#include "TracerGroups.h"
+
+#include <atomic>
+
+//
+//    TracerShared
+//
+//    A control plane in shared memory, so the tracing of a running process
+//    can be looked at and changed from the shell with tracerctl, without
+//    restarting it or setting up a control file.  The process publishes a
+//    segment at
+//
+//        /dev/shm/tracer.<pid>
+//
+//    holding its TRACEGROUP, TRACELEVEL and TRACEONLY settings, its group
+//    table with each group's enabled flag and level, and every TRACER() and
+//    TRACER_SCOPE() site it has reached, with its current decision and a
+//    count of the times it was reached while enabled:
+//
+//        tracerctl                     list the processes that can be traced
+//        tracerctl 4711                show the settings, groups and sites
+//        tracerctl 4711 on Db:20       turn a group on, optionally at a level
+//        tracerctl 4711 off Db         turn a group off
+//        tracerctl 4711 set Db,Net 5   replace TRACEGROUP, and TRACELEVEL
+//
+//    The configuration epoch that every call site checks lives in the
+//    segment.  tracerctl writes the new settings, then advances the epoch,
+//    so the next time each site is reached it finds its decision stale, and
+//    the first thread to get there installs the new settings, exactly as
+//    Tracer::Configure() would.  No thread is started, and a traced thread
+//    still checks a single word, so a disabled site costs what it always
+//    did.
+//
+//    The settings are handed over with a sequence count: tracerctl makes
+//    'request' odd while it writes, and even when done, and the process
+//    only takes settings that were read whole.  Several tracerctl commands
+//    at once are serialized by a lock word that only tracerctl takes, so a
+//    tracerctl killed part way can never stall the process.
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACESHARED=TRUE          publish the segment.  It is removed at
+//                                  exit, by the process that created
+//                                  it, not by a forked child
+//
+//    The segment is created readable and writable by its owner only.
+//
+
+#define TRACER_SHARED_MAGIC     0x54524353      // "TRCS"
+#define TRACER_SHARED_VERSION   1
+#define TRACER_SHARED_PATH      "/dev/shm/tracer."
+#define TRACER_SHARED_GROUPS    1024    // longest TRACEGROUP setting kept
+#define TRACER_SHARED_NAME      64      // longest group name kept
+#define TRACER_SHARED_SITES     4096    // call sites kept, a power of 2
+#define TRACER_SHARED_FORMAT    96      // longest site format string kept
+
+
+//
+// possible values for TracerSharedSite::state
+//
+#define TRACER_SHARED_EMPTY     0
+#define TRACER_SHARED_FILLING   1
+#define TRACER_SHARED_READY     2
+
+
+//
+// one group, as published by the process
+//
+struct TracerSharedGroup
+{
+    char name[TRACER_SHARED_NAME];
+    std::atomic<int> enabled;
+    std::atomic<int> threshold;
+};
+
+
+//
+// one call site.  Claimed by the process with a compare and swap on 'state'
+//
+struct TracerSharedSite
+{
+    std::atomic<int> state;             // TRACER_SHARED_xxx
+    unsigned long long address;         // of the TracerSite, in the process
+    int groupid;
+    int level;
+    std::atomic<int> decision;          // TRACER_SITE_xxx, in the current epoch
+    std::atomic<unsigned long long> hits;   // times reached while enabled
+    char format[TRACER_SHARED_FORMAT];
+};
+
+
+//
+// a group, level and only setting, as published or requested
+//
+struct TracerSharedSettings
+{
+    char groups[TRACER_SHARED_GROUPS];
+    int level;
+    int only;
+};
+
+
+//
+// the segment
+//
+struct TracerSharedSegment
+{
+    unsigned magic;                     // TRACER_SHARED_MAGIC
+    unsigned version;                   // TRACER_SHARED_VERSION
+    unsigned size;                      // of the segment, in bytes
+    int pid;
+
+    std::atomic<int> epoch;             // the configuration epoch, checked by every call site
+    std::atomic<unsigned> request;      // odd while tracerctl writes 'wanted'
+    std::atomic<unsigned> applied;      // the last request installed
+    std::atomic<int> lock;              // pid of the tracerctl writing, or 0
+
+    TracerSharedSettings current;       // settings in force, written by the process
+    TracerSharedSettings wanted;        // settings asked for, written by tracerctl
+
+    std::atomic<int> groupcount;        // groups published
+    std::atomic<unsigned> sitesfull;    // sites not published, the table being full
+    TracerSharedGroup groups[TRACER_MAX_GROUPS + 1];    // indexed by group ID
+    TracerSharedSite sites[TRACER_SHARED_SITES];
+};
+
+static_assert(std::atomic<int>::is_always_lock_free && std::atomic<unsigned long long>::is_always_lock_free,
+              "the shared segment needs lock-free atomics");
+
+
+class TracerShared
+{
+    static TracerSharedSegment *segment;
+    static std::atomic<unsigned> seen;  // the last request installed, or looked at
+
+    static void Install();
+    static void Remove();
+
+public:
+
+    // create and publish the segment, with the settings now in force and
+    // the epoch that call sites now check.  Returns the epoch word in the
+    // segment, for the call sites to check from now on, or 0 if the
+    // segment could not be created
+    static std::atomic<int> *Start(const char *groups, int level, bool only, int epoch);
+
+    // is the segment published?
+    static bool Running()
+    {
+        return segment != 0;
+    }
+
+    // install new settings, if tracerctl has asked for them.  Costs a load
+    // and a compare when it hasn't
+    static void Poll()
+    {
+        if ( segment && (segment->request.load(std::memory_order_acquire) != seen.load(std::memory_order_relaxed)) )
+            Install();
+    }
+
+    // publish the settings in force
+    static void Settings(const char *groups, int level, bool only);
+
+    // publish a group's name and settings
+    static void Group(int id, const char *name, bool enabled, int threshold);
+
+    // find the published entry for a call site, claiming one the first
+    // time the site is decided.  Returns 0 if the table is full
+    static TracerSharedSite *Site(const void *site, const char *format, int groupid, int level);
+
+    // count a site reached while enabled
+    static void Hit(TracerSharedSite *site)
+    {
+        site->hits.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+
+#endif   // __TRACERSHARED_H
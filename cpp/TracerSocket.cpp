@@ -0,0 +1,235 @@
+
+#include "TracerSocket.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <atomic>
+
+
+//
+// init static variables
+//
+bool        TracerSocket::running   = false;
+
+
+//
+// connection state.  The socket is never closed, since traced threads may
+// be sending on it; a datagram socket can simply be connected again
+//
+static struct sockaddr_un   address;
+static int                  sock        = -1;
+static std::atomic<bool>    connected(false);
+static bool                 reported    = false;    // connected, as last noticed
+
+//
+// the batch being built, and when to next try connecting.  Only the writer
+// thread touches these
+//
+static long long            retry       = 0;
+static long long            started     = 0;        // monotonic time the batch was started
+static char                 datagram[TRACER_SOCKET_BATCH];
+static int                  used        = sizeof(TracerSocketHeader);
+static int                  count       = 0;
+
+
+//
+// start sending to tracerd
+//
+bool TracerSocket::Start(const char *path, int format)
+{
+    if ( (format != TRACER_FORMAT_TEXT) && (format != TRACER_FORMAT_JSON) )
+    {
+        TracerOutput::Notice("socket", "TRACESOCKET needs the TEXT or JSON format, writing locally");
+        return false;
+    }
+
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        TracerOutput::Notice("socket", "TRACESOCKET path is too long, writing locally");
+        return false;
+    }
+
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        TracerOutput::Notice("socket", "cannot create a socket, writing locally");
+        return false;
+    }
+
+    // room for several batches in flight
+    int size = 4 * TRACER_SOCKET_BATCH;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    running = true;
+    Connect();
+    return true;
+}
+
+
+//
+// connect to tracerd.  A datagram socket connects at once, or not at all
+//
+bool TracerSocket::Connect()
+{
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) == 0)
+    {
+        connected.store(true, std::memory_order_relaxed);
+        if (!reported)
+        {
+            char notice[160];
+            snprintf(notice, sizeof(notice), "sending to tracerd at %s", address.sun_path);
+            TracerOutput::Notice("socket", notice);
+            reported = true;
+        }
+        return true;
+    }
+
+    connected.store(false, std::memory_order_relaxed);
+    retry = TracerOutput::Monotonic() + TRACER_SOCKET_RETRY * 1000000LL;
+
+    if (reported)
+    {
+        TracerOutput::Notice("socket", "tracerd can't be reached, writing locally");
+        reported = false;
+    }
+    return false;
+}
+
+
+//
+// add one line to the batch
+//
+void TracerSocket::Add(long long timestamp, const char *line, int length)
+{
+    if (used + TRACER_SOCKET_RECORD + length > (int)sizeof(datagram))
+        Flush();
+
+    // a line too long for any datagram stays local
+    if (used + TRACER_SOCKET_RECORD + length > (int)sizeof(datagram))
+    {
+        TracerOutput::Write(line, length);
+        return;
+    }
+
+    if (!count)
+        started = TracerOutput::Monotonic();
+
+    memcpy(datagram + used, &timestamp, 8);
+    memcpy(datagram + used + 8, &length, 4);
+    memcpy(datagram + used + TRACER_SOCKET_RECORD, line, length);
+    used += TRACER_SOCKET_RECORD + length;
+    ++count;
+}
+
+
+//
+// send the batch.  If tracerd is busy, the writer thread waits a moment for
+// it, but no longer, since the ring fills meanwhile; a batch that can't be
+// sent is written locally
+//
+void TracerSocket::Flush()
+{
+    if (!count)
+        return;
+
+    TracerSocketHeader header = { TRACER_SOCKET_MAGIC, (int)getpid(), count, 0 };
+    memcpy(datagram, &header, sizeof(header));
+
+    if ( !connected.load(std::memory_order_relaxed) && (TracerOutput::Monotonic() >= retry) )
+        Connect();
+
+    if (connected.load(std::memory_order_relaxed))
+    {
+        ssize_t n = send(sock, datagram, used, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if ( (n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) )
+        {
+            struct pollfd fds = { sock, POLLOUT, 0 };
+            if (poll(&fds, 1, TRACER_SOCKET_WAIT) > 0)
+                n = send(sock, datagram, used, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+
+        if (n == used)
+        {
+            used = sizeof(TracerSocketHeader);
+            count = 0;
+            return;
+        }
+
+        // tracerd may have gone, rather than just be busy, so connect again
+        if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != ENOBUFS) )
+            Connect();
+    }
+
+    Local();
+}
+
+
+//
+// with the ring empty, send a batch that has waited long enough.  Lines
+// trickling in are kept together, rather than sent a few at a time
+//
+void TracerSocket::Idle()
+{
+    if ( count && (TracerOutput::Monotonic() - started >= TRACER_SOCKET_LINGER * 1000000LL) )
+        Flush();
+}
+
+
+//
+// send one line, too long for the ring, straight from the calling thread
+//
+bool TracerSocket::Send(long long timestamp, const char *line, int length)
+{
+    if ( !connected.load(std::memory_order_relaxed) ||
+         ((int)sizeof(TracerSocketHeader) + TRACER_SOCKET_RECORD + length > TRACER_SOCKET_BATCH) )
+        return false;
+
+    TracerSocketHeader header = { TRACER_SOCKET_MAGIC, (int)getpid(), 1, 0 };
+    char record[TRACER_SOCKET_RECORD];
+    memcpy(record, &timestamp, 8);
+    memcpy(record + 8, &length, 4);
+
+    struct iovec parts[3] = { { &header, sizeof(header) }, { record, sizeof(record) }, { (void *)line, (size_t)length } };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = 3;
+
+    return sendmsg(sock, &message, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)(sizeof(header) + sizeof(record) + length);
+}
+
+
+//
+// write the batch to the local output.  The lines are moved together first,
+// so they go out in a single write()
+//
+void TracerSocket::Local()
+{
+    int from = sizeof(TracerSocketHeader);
+    int to = 0;
+
+    while (from < used)
+    {
+        int length;
+        memcpy(&length, datagram + from + 8, 4);
+        memmove(datagram + to, datagram + from + TRACER_SOCKET_RECORD, length);
+        from += TRACER_SOCKET_RECORD + length;
+        to += length;
+    }
+
+    TracerOutput::Write(datagram, to);
+
+    used = sizeof(TracerSocketHeader);
+    count = 0;
+}
@@ -0,0 +1,99 @@
+#ifndef __TRACERSOCKET_H
+#define __TRACERSOCKET_H
+
+//
+//    TracerSocket
+//
+//    Sends a process's Tracer output to the tracerd aggregator, over a
+//    local Unix domain socket, so that the output of many processes can be
+//    read as one log.  tracerd merges the records of every process it hears
+//    from in timestamp order, tags each with the pid of the process that
+//    wrote it, and writes them to a rotating file.
+//
+//    Records are sent in batches, as datagrams, by the TracerAsync writer
+//    thread, which is started if it isn't already; a traced thread only
+//    ever puts a record in the ring, and a long line takes a run of slots
+//    rather than waiting for the ring to drain.  A batch is sent when it is
+//    full, or when the ring has been empty for TRACER_SOCKET_LINGER
+//    milliseconds.  Every send is non-blocking: if tracerd isn't running,
+//    or is still busy after a few milliseconds, the batch is written to the
+//    local output instead, stderr or TRACEFILE, and if tracerd is gone, the
+//    connection is tried again a second later.  Only a line longer than
+//    TRACER_ASYNC_LONGEST is sent on its own, by the thread that wrote it,
+//    and still without waiting.  Notices from the Tracer machinery stay
+//    local.
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACESOCKET=/path/sock    send to tracerd at this socket
+//        TRACESOCKET=TRUE          send to tracerd at TRACER_SOCKET_PATH
+//
+//    Only the text and JSON lines formats can be sent.
+//
+//    Each datagram is a TracerSocketHeader followed by 'count' records,
+//    each an 8 byte timestamp, in nanoseconds since the epoch, a 4 byte
+//    length, and that many bytes of the formatted line, newline included.
+//    Numbers are in the byte order of the machine, which tracerd shares.
+//
+
+#define TRACER_SOCKET_PATH      "/tmp/tracerd.sock"
+#define TRACER_SOCKET_MAGIC     0x54524344      // "TRCD"
+#define TRACER_SOCKET_BATCH     65536           // largest datagram
+#define TRACER_SOCKET_RECORD    12              // bytes before each line
+#define TRACER_SOCKET_RETRY     1000            // milliseconds between connection attempts
+#define TRACER_SOCKET_WAIT      5               // most milliseconds the writer thread waits
+                                                // for a busy tracerd
+#define TRACER_SOCKET_LINGER    20              // most milliseconds a record waits in a batch
+                                                // while the ring is empty
+
+
+struct TracerSocketHeader
+{
+    unsigned magic;             // TRACER_SOCKET_MAGIC
+    int pid;                    // of the sending process
+    int count;                  // records that follow
+    int reserved;
+};
+
+
+class TracerSocket
+{
+    static bool running;        // true once Start() is called
+
+    static bool Connect();
+    static void Local();
+
+public:
+
+    // send output to tracerd at 'path', in the given TRACER_FORMAT_xxx.
+    // Returns false, with a notice, if the format can't be sent
+    static bool Start(const char *path, int format);
+
+    // is output going to tracerd?  Even when it is, records are written
+    // locally while tracerd can't be reached
+    static bool Running()
+    {
+        return running;
+    }
+
+    // add one formatted line to the batch, sending the batch first if the
+    // line won't fit.  Called by the writer thread only
+    static void Add(long long timestamp, const char *line, int length);
+
+    // send the batch, or write it locally if it can't be sent without
+    // waiting.  Called by the writer thread only
+    static void Flush();
+
+    // the ring is empty; send the batch if its oldest line has waited long
+    // enough.  Called by the writer thread only
+    static void Idle();
+
+    // send one line on its own, from any thread, without waiting.  Used for
+    // lines longer than TRACER_ASYNC_LONGEST.  Returns false if it wasn't
+    // sent
+    static bool Send(long long timestamp, const char *line, int length);
+};
+
+
+#endif   // __TRACERSOCKET_H
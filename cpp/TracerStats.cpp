@@ -0,0 +1,234 @@
+
+#include "TracerStats.h"
+#include "TracerOutput.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+//
+// possible values for TracerStat::state
+//
+#define STAT_EMPTY          0
+#define STAT_FILLING        1
+#define STAT_READY          2
+
+
+//
+// init static variables
+//
+bool        TracerStats::running    = false;
+
+
+//
+// the site table.  Slots are claimed with a compare and swap on 'state',
+// and their key never changes once they are ready, so lookups take no lock
+//
+static TracerStat               sites[TRACER_MAX_SITES];
+static std::atomic<unsigned>    full(0);        // Tracers not counted, the table being full
+
+
+//
+// turn on statistics mode
+//
+void TracerStats::Start()
+{
+    if (running)
+        return;
+
+    running = true;
+    atexit(Report);
+}
+
+
+//
+// find the counters for a site
+//
+TracerStat *TracerStats::Find(const char *format, const char *group, int groupid, int level)
+{
+    // the format is a literal, or at least the same pointer every time the
+    // site is reached, so it is hashed by address
+    uint64_t h = (uint64_t)(uintptr_t)format * 0x9e3779b97f4a7c15ULL;
+    h ^= ((uint64_t)(unsigned)groupid << 32) | (unsigned)level;
+    h *= 0xff51afd7ed558ccdULL;
+
+    unsigned index = (unsigned)(h >> 32) & (TRACER_MAX_SITES - 1);
+    for (int probes = 0; probes < TRACER_MAX_SITES; )
+    {
+        TracerStat& stat = sites[index];
+        int state = stat.state.load(std::memory_order_acquire);
+
+        if (state == STAT_EMPTY)
+        {
+            int expected = STAT_EMPTY;
+            if (!stat.state.compare_exchange_strong(expected, STAT_FILLING))
+                continue;
+
+            // this thread owns the slot
+            stat.format = format;
+            stat.group = group;
+            stat.groupid = groupid;
+            stat.level = level;
+            stat.state.store(STAT_READY, std::memory_order_release);
+            return &stat;
+        }
+
+        if (state == STAT_FILLING)
+        {
+            // another thread is filling this slot; wait for it
+            std::this_thread::yield();
+            continue;
+        }
+
+        // groups that didn't fit in the group table share ID 0, and are
+        // told apart by their kept names
+        if ( (stat.format == format) && (stat.groupid == groupid) && (stat.level == level) &&
+             (groupid || (stat.group == group)) )
+            return &stat;
+
+        index = (index + 1) & (TRACER_MAX_SITES - 1);
+        ++probes;
+    }
+
+    full.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+
+//
+// count a Tracer destroyed
+//
+void TracerStats::Exit(TracerStat *stat, long long elapsed)
+{
+    if (elapsed < 0)
+        elapsed = 0;
+
+    // bucket n holds durations of n significant bits, that is under 2^n
+    int bucket = elapsed ? 64 - __builtin_clzll((unsigned long long)elapsed) : 0;
+    if (bucket >= TRACER_STATS_BUCKETS)
+        bucket = TRACER_STATS_BUCKETS - 1;
+
+    stat->total.fetch_add((unsigned long long)elapsed, std::memory_order_relaxed);
+    stat->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    // the longest rarely changes, so only write it when it does
+    long long longest = stat->longest.load(std::memory_order_relaxed);
+    while ( (elapsed > longest) &&
+            !stat->longest.compare_exchange_weak(longest, elapsed, std::memory_order_relaxed) )
+        ;
+}
+
+
+//
+// the upper bound of the bucket holding the given fraction of durations
+//
+static unsigned long long Percentile(const TracerStat& stat, unsigned long long count, double fraction)
+{
+    unsigned long long target = (unsigned long long)(count * fraction);
+    if (target >= count)
+        target = count - 1;
+
+    unsigned long long seen = 0;
+    for (int n = 0; n < TRACER_STATS_BUCKETS; n++)
+    {
+        seen += stat.buckets[n].load(std::memory_order_relaxed);
+        if (seen > target)
+            return 1ULL << n;
+    }
+    return 0;
+}
+
+
+//
+// write one line of the report.  In the text format it goes with the rest
+// of the output, otherwise to stderr
+//
+static void Line(const char *line, int length)
+{
+    if (TracerOutput::Mode() == TRACER_FORMAT_TEXT)
+    {
+        TracerOutput::Write(line, length);
+        return;
+    }
+
+    while (length > 0)
+    {
+        ssize_t n = write(2, line, length);
+        if (n <= 0)
+            return;
+        line += n;
+        length -= (int)n;
+    }
+}
+
+
+//
+// write the summary table, sorted by total time
+//
+void TracerStats::Report()
+{
+    if (!running)
+        return;
+
+    // other threads may still be counting, so the sites are sorted by a
+    // copy of their totals, taken once, which the table then shows
+    std::vector<std::pair<unsigned long long, const TracerStat *>> used;
+    for (int i = 0; i < TRACER_MAX_SITES; i++)
+    {
+        if (sites[i].state.load(std::memory_order_acquire) == STAT_READY)
+            used.emplace_back(sites[i].total.load(std::memory_order_relaxed), &sites[i]);
+    }
+
+    std::sort(used.begin(), used.end(), [](const std::pair<unsigned long long, const TracerStat *>& a,
+                                           const std::pair<unsigned long long, const TracerStat *>& b)
+    {
+        return a.first > b.first;
+    });
+
+    char line[512];
+    int length = snprintf(line, sizeof(line), "Tracer: [stats] %-16s %5s %10s %10s %12s %11s %11s %11s %11s  %s\n",
+                          "group", "level", "hits", "messages", "total ms", "mean ns", "p50 ns", "p99 ns", "max ns", "site");
+    Line(line, length);
+
+    for (const auto& entry : used)
+    {
+        const TracerStat *stat = entry.second;
+        unsigned long long hits = stat->hits.load(std::memory_order_relaxed);
+        unsigned long long total = entry.first;
+
+        // only Tracers already destroyed have a duration
+        unsigned long long timed = 0;
+        for (int n = 0; n < TRACER_STATS_BUCKETS; n++)
+            timed += stat->buckets[n].load(std::memory_order_relaxed);
+
+        char p50[24] = "-";
+        char p99[24] = "-";
+        if (timed)
+        {
+            snprintf(p50, sizeof(p50), "<%llu", Percentile(*stat, timed, 0.50));
+            snprintf(p99, sizeof(p99), "<%llu", Percentile(*stat, timed, 0.99));
+        }
+
+        length = snprintf(line, sizeof(line), "Tracer: [stats] %-16s %5d %10llu %10llu %12.3f %11llu %11s %11s %11lld  %.120s\n",
+                          stat->group, stat->level, hits, stat->messages.load(std::memory_order_relaxed),
+                          total / 1e6, timed ? total / timed : 0, p50, p99,
+                          stat->longest.load(std::memory_order_relaxed), stat->format ? stat->format : "");
+        Line(line, (length < (int)sizeof(line)) ? length : (int)sizeof(line) - 1);
+    }
+
+    unsigned lost = full.load(std::memory_order_relaxed);
+    if (lost)
+    {
+        length = snprintf(line, sizeof(line), "Tracer: [stats] %u Tracers not counted, more than %d sites\n",
+                          lost, TRACER_MAX_SITES);
+        Line(line, length);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef __TRACERSTATS_H
+#define __TRACERSTATS_H
+
+#include <atomic>
+
+//
+//    TracerStats
+//
+//    Statistics mode.  Instead of printing a line for each message, every
+//    enabled Tracer is counted against its site: how often it was
+//    constructed, how many messages it would have printed, and how long it
+//    lived, from construction to destruction, in a histogram with one
+//    bucket per power of 2 nanoseconds.  A site is a format string, group
+//    and level, as passed to the ctor or the TRACER() macros.
+//
+//    The counters are lock-free atomics, so an event costs a table lookup
+//    when the Tracer is constructed, and a few atomic increments.  Messages
+//    are never formatted.  A summary table, sorted by total time, is
+//    written at exit, or whenever the program calls Tracer::ReportStats():
+//
+//        Tracer: [stats] group    level      hits  messages    total ms     mean ns      p50 ns      p99 ns      max ns  site
+//        Tracer: [stats] Db          20     12000     12000      36.150        3012       <4096      <16384      210331  Query %d
+//
+//    The percentiles are the upper bounds of their histogram buckets.  The
+//    table goes to the usual output in the text format, otherwise to stderr.
+//
+//    Controlled by environment variables, read along with the other TRACExx
+//    variables:
+//
+//        TRACESTATS=TRUE           turn on statistics mode
+//
+//    The flight recorder, if turned on, keeps recording as usual.
+//
+
+#define TRACER_MAX_SITES        4096    // distinct sites counted, a power of 2
+#define TRACER_STATS_BUCKETS    64      // histogram buckets, one per bit of a duration
+
+
+//
+// the counters for one site
+//
+struct TracerStat
+{
+    std::atomic<int> state;                 // claimed with a compare and swap
+    const char *format;                     // the site's ctor format string
+    const char *group;                      // interned or literal, so the pointer stays valid
+    int groupid;
+    int level;
+
+    std::atomic<unsigned long long> hits;       // Tracers constructed
+    std::atomic<unsigned long long> messages;   // messages that would have printed
+    std::atomic<unsigned long long> total;      // nanoseconds, over all Tracers
+    std::atomic<long long> longest;             // nanoseconds, longest Tracer
+    std::atomic<unsigned long long> buckets[TRACER_STATS_BUCKETS];  // durations; bucket
+                                                // n counts those under 2^n ns
+};
+
+
+class TracerStats
+{
+    static bool running;        // true once Start() is called
+
+public:
+
+    // turn on statistics mode, with a report at exit
+    static void Start();
+
+    // is statistics mode on?
+    static bool Running()
+    {
+        return running;
+    }
+
+    // find the counters for a site, claiming them the first time the site is
+    // seen.  Returns 0 if the table is full
+    static TracerStat *Find(const char *format, const char *group, int groupid, int level);
+
+    // count a Tracer constructed, a message, and a Tracer destroyed after
+    // 'elapsed' nanoseconds
+    static void Hit(TracerStat *stat)
+    {
+        stat->hits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void Message(TracerStat *stat)
+    {
+        stat->messages.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void Exit(TracerStat *stat, long long elapsed);
+
+    // write the summary table
+    static void Report();
+};
+
+
+#endif   // __TRACERSTATS_H
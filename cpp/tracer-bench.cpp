@@ -0,0 +1,268 @@
+//
+//    tracer-bench
+//
+//    Measures the cost of a Tracer call, in nanoseconds, on the paths that
+//    matter in production, and writes the results to stdout as JSON so that
+//    runs can be compared from one version to the next:
+//
+//        disabled_site       TRACER() site whose group is not enabled
+//        group_filtered      Tracer ctor whose group is not enabled
+//        level_filtered      Tracer ctor whose group is enabled, but whose
+//                            level is too high
+//        enabled             TRACER() site that prints, to /dev/null
+//        exit                TRACER_SCOPE() with one Print(), so the dtor
+//                            prints its -exit- line
+//        contended           the enabled case on 1, 4 and 16 threads at once
+//        eager_args          Tracer ctor whose group is not enabled, with an
+//                            expensive argument, which is evaluated anyway
+//        lazy_args           TRACER() site whose group is not enabled, with
+//                            the same argument
+//        lazy_print          TRACER_PRINT() on a disabled TRACER_SCOPE(),
+//                            with the same argument
+//
+//    The argument cases also report how many times the argument was
+//    evaluated, which for the lazy cases should be 0.
+//
+//    Each case is run with TRACEGROUP lists of several lengths, set with
+//    Tracer::Configure(), to show how the cost scales with the list.
+//
+//        tracer-bench [iterations]
+//
+//    Output goes to /dev/null unless TRACEFILE is set.  The other TRACExx
+//    variables, such as TRACEASYNC and TRACEFORMAT, are honoured as usual,
+//    so the output paths can be compared too.
+//
+//    Build with
+//
+//        g++ -std=c++17 -O2 -Wall -Wextra -Werror -pthread -o tracer-bench tracer-bench.cpp Tracer*.cpp
+//
+//    It and the Tracer sources build without warnings at that level.
+//
+
+#include "Tracer.h"
+#include "TracerAsync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//
+// nanoseconds from the monotonic clock
+//
+static long long Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+//
+// a TRACEGROUP list of 'count' groups, ending with "Bench", the group the
+// enabled cases use
+//
+static std::string GroupList(int count)
+{
+    std::string list;
+    char name[32];
+
+    for (int i = 1; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "Group%04d,", i);
+        list += name;
+    }
+    return list + "Bench";
+}
+
+
+//
+// the cases.  Each runs 'iterations' calls, and returns the elapsed time
+//
+static long long DisabledSite(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+        TRACER(true, "Other", 5, "Iteration %d", i);
+    return Now() - start;
+}
+
+static long long GroupFiltered(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+        Tracer(true, (char *)"Other", 5, (char *)"Iteration %d", i);
+    return Now() - start;
+}
+
+static long long LevelFiltered(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+        Tracer(true, (char *)"Bench", 10, (char *)"Iteration %d", i);
+    return Now() - start;
+}
+
+static long long Enabled(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+        TRACER(true, "Bench", 5, "Iteration %d", i);
+    return Now() - start;
+}
+
+static long long Exit(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        TRACER_SCOPE(tt, true, "Bench", 5, "Scope %d", i);
+        tt.Print(true, (char *)"Iteration %d", i);
+    }
+    return Now() - start;
+}
+
+
+//
+// an argument that is costly to compute, counting how often it is
+//
+static long long evaluations = 0;
+
+static std::string __attribute__((noinline)) ExpensiveDump(int i)
+{
+    ++evaluations;
+
+    std::string dump;
+    for (int n = 0; n < 64; n++)
+        dump += std::to_string(i + n);
+    return dump;
+}
+
+static long long EagerArgs(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+        Tracer(true, "Other", 5, "Dump %s", ExpensiveDump(i).c_str());
+    return Now() - start;
+}
+
+static long long LazyArgs(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+        TRACER(true, "Other", 5, "Dump %s", ExpensiveDump(i));
+    return Now() - start;
+}
+
+static long long LazyPrint(int iterations)
+{
+    long long start = Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        TRACER_SCOPE(tt, true, "Other", 5, "Scope %d", i);
+        TRACER_PRINT(tt, true, "Dump %s", ExpensiveDump(i));
+    }
+    return Now() - start;
+}
+
+
+//
+// the enabled case on several threads at once.  Returns the wall time
+//
+static long long Contended(int iterations, int threads)
+{
+    std::vector<std::thread> workers;
+
+    long long start = Now();
+    for (int t = 0; t < threads; t++)
+        workers.push_back(std::thread(Enabled, iterations));
+    for (int t = 0; t < threads; t++)
+        workers[t].join();
+    return Now() - start;
+}
+
+
+//
+// write one result as a JSON object.  'evaluated' is given for the argument
+// cases only
+//
+static void Report(bool& first, const char *name, const std::string& groups, int count,
+                   int threads, int iterations, long long elapsed, long long evaluated = -1)
+{
+    double calls = (double)iterations * threads;
+
+    printf("%s\n    { \"case\": \"%s\", \"groups\": %d, \"grouplength\": %d, \"threads\": %d, "
+           "\"calls\": %.0f, \"ns_per_call\": %.2f, \"calls_per_sec\": %.0f",
+           first ? "" : ",", name, count, (int)groups.length(), threads,
+           calls, (double)elapsed * threads / calls, calls * 1e9 / (double)elapsed);
+    if (evaluated >= 0)
+        printf(", \"evaluations\": %lld", evaluated);
+    printf(" }");
+    first = false;
+}
+
+
+//
+// run one of the argument cases, counting the evaluations
+//
+static void ReportArgs(bool& first, const char *name, const std::string& groups, int count,
+                       int iterations, long long (*run)(int))
+{
+    evaluations = 0;
+    long long elapsed = run(iterations);
+    Report(first, name, groups, count, 1, iterations, elapsed, evaluations);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 1000000;
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "usage: tracer-bench [iterations]\n");
+        return 1;
+    }
+
+    // enabled output goes nowhere, unless asked otherwise
+    setenv("TRACEFILE", "/dev/null", 0);
+
+    static const int counts[] = { 1, 16, 256 };
+    static const int threads[] = { 1, 4, 16 };
+    bool first = true;
+
+    printf("{\n  \"benchmark\": \"tracer-bench\",\n  \"iterations\": %d,\n  \"results\": [", iterations);
+
+    for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++)
+    {
+        std::string groups = GroupList(counts[c]);
+        Tracer::Configure(groups.c_str(), 5, false);
+
+        // warm up, so that call sites and group IDs are settled
+        DisabledSite(1);
+        GroupFiltered(1);
+        Enabled(1);
+
+        Report(first, "disabled_site", groups, counts[c], 1, iterations, DisabledSite(iterations));
+        Report(first, "group_filtered", groups, counts[c], 1, iterations, GroupFiltered(iterations));
+        Report(first, "level_filtered", groups, counts[c], 1, iterations, LevelFiltered(iterations));
+        Report(first, "enabled", groups, counts[c], 1, iterations, Enabled(iterations));
+        Report(first, "exit", groups, counts[c], 1, iterations, Exit(iterations));
+
+        for (int t = 0; t < (int)(sizeof(threads) / sizeof(threads[0])); t++)
+            Report(first, "contended", groups, counts[c], threads[t], iterations, Contended(iterations, threads[t]));
+
+        ReportArgs(first, "eager_args", groups, counts[c], iterations, EagerArgs);
+        ReportArgs(first, "lazy_args", groups, counts[c], iterations, LazyArgs);
+        ReportArgs(first, "lazy_print", groups, counts[c], iterations, LazyPrint);
+
+        // in asynchronous mode, don't let one case's backlog spill into the next
+        TracerAsync::Flush();
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,174 @@
+//
+//    tracer-coalesce-test
+//
+//    Checks that runs of repeated messages are collapsed, and that a run
+//    ends, and its count is written, when it should be:
+//
+//        run         repeats of a message, then another one.  The first
+//                    is printed, then the count, then the other message
+//        exit        the same message from a TRACER() site with
+//                    TRACETIME=ALL, so an -exit- line comes between each
+//                    pair.  Nothing is collapsed
+//        idle        repeats of a message, then nothing.  The timer writes
+//                    the count once the window has passed
+//        printf      repeats of a message with printf style arguments,
+//                    compared by their formatted text, then another one
+//
+//    Each case runs in a child process with its own TRACExx variables, as
+//    they are only read once, and writes to a file of its own, which it
+//    then reads back.  Exits with 0 if every case passes.
+//
+//        tracer-coalesce-test
+//
+//    Build with
+//
+//        g++ -std=c++17 -O2 -pthread -o tracer-coalesce-test tracer-coalesce-test.cpp Tracer*.cpp
+//
+
+#include "Tracer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+
+//
+// the lines of the output file
+//
+static std::string Output(const char *path)
+{
+    std::string text;
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return text;
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+        text += line;
+    fclose(fp);
+    return text;
+}
+
+
+//
+// times 'what' appears in 'text'
+//
+static int Count(const std::string& text, const char *what)
+{
+    int n = 0;
+    for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1))
+        ++n;
+    return n;
+}
+
+
+static void Waiting()
+{
+    TRACER(true, "Net", 5, "waiting");
+}
+
+
+// the arguments come as a va_list
+static void Polling(const char *what)
+{
+    Tracer tracer(true, "Net", 5, "polling %s", what);
+}
+
+
+//
+// the cases, each run in its own process.  Each returns true if it passes
+//
+static bool Run(const char *path)
+{
+    for (int i = 0; i < 5; i++)
+        Waiting();
+    TRACER(true, "Net", 5, "connected");
+
+    std::string text = Output(path);
+    size_t repeated = text.find("last message repeated 4 times");
+    return (Count(text, "waiting") == 1) && (repeated != std::string::npos) &&
+           (repeated < text.find("connected"));
+}
+
+
+static bool Exit(const char *path)
+{
+    for (int i = 0; i < 5; i++)
+        Waiting();
+
+    std::string text = Output(path);
+    return (Count(text, "waiting") == 5) && (Count(text, "-exit-") == 5) && (Count(text, "repeated") == 0);
+}
+
+
+static bool Idle(const char *path)
+{
+    for (int i = 0; i < 5; i++)
+        Waiting();
+
+    // the window is 100ms
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::string text = Output(path);
+    return (Count(text, "waiting") == 1) && (Count(text, "last message repeated 4 times") == 1);
+}
+
+
+static bool Printf(const char *path)
+{
+    for (int i = 0; i < 5; i++)
+        Polling("db");
+    Polling("cache");
+
+    std::string text = Output(path);
+    size_t repeated = text.find("last message repeated 4 times");
+    return (Count(text, "polling db") == 1) && (repeated != std::string::npos) &&
+           (repeated < text.find("polling cache"));
+}
+
+
+//
+// run one case in a child process, with the given TRACETIME
+//
+static bool Case(const char *name, bool (*test)(const char *), const char *timing, const char *window)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/tracer-coalesce-%d-%s", (int)getpid(), name);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setenv("TRACEGROUP", "Net", 1);
+        setenv("TRACELEVEL", "10", 1);
+        setenv("TRACEFILE", path, 1);
+        setenv("TRACECOALESCE", window, 1);
+        if (timing)
+            setenv("TRACETIME", timing, 1);
+        _exit(test(path) ? 0 : 1);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    bool passed = WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+    printf("%-8s %s\n", name, passed ? "ok" : "FAILED");
+    if (!passed)
+        printf("%s", Output(path).c_str());
+
+    unlink(path);
+    return passed;
+}
+
+
+int main()
+{
+    bool passed = Case("run", Run, 0, "TRUE");
+    passed = Case("exit", Exit, "ALL", "TRUE") && passed;
+    passed = Case("idle", Idle, 0, "100") && passed;
+    passed = Case("printf", Printf, 0, "TRUE") && passed;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+//
+//    tracer-decode
+//
+//    Rebuilds the familiar Tracer text lines from a binary trace log written
+//    with TRACEFORMAT=BINARY (see TracerBinary.h), and writes them to stdout.
+//
+//        tracer-decode [-t] [-T] trace.bin ...
+//
+//    The -t option prefixes each line with the time the record was written,
+//    and the -T option shows the ID of the thread that wrote it, as
+//    TRACETHREAD=TRUE does for text output.
+//
+//    It also prints the records of a segment written with TRACEMAP (see
+//    TracerMapped.h), up to the length its header says was committed, so a
+//    segment left by a process that died can still be read.  Those records
+//    are already formatted, so -t and -T don't apply.
+//
+//    Build with
+//
+//        g++ -std=c++17 -o tracer-decode tracer-decode.cpp TracerArgs.cpp TracerFormat.cpp
+//
+
+#include "TracerBinary.h"
+#include "TracerArgs.h"
+#include "TracerMapped.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+
+
+//
+// group names and format strings, by ID
+//
+static std::map<int, std::string> groups;
+static std::map<int, std::string> formats;
+
+
+//
+// counts of suppressed calls waiting for the next line of a Tracer, by serial
+//
+static std::map<int, int> suppressed;
+
+
+//
+// read the next entry from the log.  Returns false at the end of the file
+//
+static bool ReadEntry(FILE *fp, char& type, char *payload, int& length)
+{
+    unsigned char header[TRACER_ENTRY_HEADER];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header))
+        return false;
+
+    unsigned short n;
+    memcpy(&n, header + 2, 2);
+
+    type = (char)header[0];
+    length = n;
+    return fread(payload, 1, length, fp) == (size_t)length;
+}
+
+
+//
+// print the timestamp prefix for -t
+//
+static void PrintTime(long long timestamp)
+{
+    time_t seconds = (time_t)(timestamp / 1000000000LL);
+    struct tm tm;
+    char text[32];
+
+    localtime_r(&seconds, &tm);
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%09lld ", text, timestamp % 1000000000LL);
+}
+
+
+//
+// print the committed records of a mapped segment
+//
+static bool Dump(FILE *fp, const char *path)
+{
+    TracerMappedHeader header;
+    rewind(fp);
+    if ( (fread(&header, 1, sizeof(header), fp) != sizeof(header)) || (header.version != TRACER_MAPPED_VERSION) )
+    {
+        fprintf(stderr, "tracer-decode: %s is not a segment this tracer-decode understands\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    long long committed = header.committed.load(std::memory_order_relaxed);
+    if (committed > header.capacity)
+        committed = header.capacity;
+
+    fseek(fp, TRACER_MAPPED_HEADER, SEEK_SET);
+
+    static char data[0x10000];
+    while (committed > 0)
+    {
+        size_t n = fread(data, 1, (committed < (long long)sizeof(data)) ? (size_t)committed : sizeof(data), fp);
+        if (n == 0)
+            break;
+        fwrite(data, 1, n, stdout);
+        committed -= (long long)n;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+
+//
+// decode one file.  The first pass collects the group and format
+// definitions, which may come after the first entry that uses them, and
+// the second pass prints the records
+//
+static bool Decode(const char *path, bool times, bool threads)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "tracer-decode: cannot open %s\n", path);
+        return false;
+    }
+
+    char magic[8];
+    bool read = (fread(magic, 1, 8, fp) == 8);
+    if ( read && (0 == memcmp(magic, TRACER_MAPPED_MAGIC, 8)) )
+        return Dump(fp, path);
+
+    if ( !read || (0 != memcmp(magic, TRACER_BINARY_MAGIC, 8)) )
+    {
+        fprintf(stderr, "tracer-decode: %s is not a binary trace log\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    static char payload[0x10000];
+    static char message[0x10000];
+    char type;
+    int length;
+
+    while (ReadEntry(fp, type, payload, length))
+    {
+        if ( ((type == TRACER_ENTRY_GROUP) || (type == TRACER_ENTRY_FORMAT)) && (length >= 4) )
+        {
+            int id;
+            memcpy(&id, payload, 4);
+            std::string name(payload + 4, length - 4);
+
+            if (type == TRACER_ENTRY_GROUP)
+                groups[id] = name;
+            else
+                formats[id] = name;
+        }
+    }
+
+    fseek(fp, 8, SEEK_SET);
+    while (ReadEntry(fp, type, payload, length))
+    {
+        // skip past the format ID of a message, to the common fields
+        int offset = (type == TRACER_ENTRY_MESSAGE) ? 4 : 0;
+        if ( (type != TRACER_ENTRY_MESSAGE) && (type != TRACER_ENTRY_TEXT) && (type != TRACER_ENTRY_EXIT) && (type != TRACER_ENTRY_SUPPRESSED) )
+            continue;
+        if (length < offset + TRACER_BINARY_COMMON)
+            continue;
+
+        int serial, groupid, level, thread, depth;
+        long long timestamp;
+        memcpy(&serial, payload + offset, 4);
+        memcpy(&groupid, payload + offset + 4, 4);
+        memcpy(&level, payload + offset + 8, 4);
+        memcpy(&thread, payload + offset + 12, 4);
+        memcpy(&timestamp, payload + offset + 16, 8);
+        memcpy(&depth, payload + offset + 24, 4);
+
+        const char *data = payload + offset + TRACER_BINARY_COMMON;
+        int datalength = length - offset - TRACER_BINARY_COMMON;
+
+        // a count of suppressed calls is shown on the line that follows it
+        if (type == TRACER_ENTRY_SUPPRESSED)
+        {
+            if (datalength >= 4)
+                memcpy(&suppressed[serial], data, 4);
+            continue;
+        }
+
+        char count[32] = "";
+        std::map<int, int>::iterator pending = suppressed.find(serial);
+        if (pending != suppressed.end())
+        {
+            snprintf(count, sizeof(count), " (%d suppressed)", pending->second);
+            suppressed.erase(pending);
+        }
+
+        if (times)
+            PrintTime(timestamp);
+
+        // notices from the Tracer machinery have no group
+        if ( (type == TRACER_ENTRY_TEXT) && (groupid == 0) )
+        {
+            printf("Tracer: %.*s\n", datalength, data);
+            continue;
+        }
+
+        if (threads)
+            printf("Tracer: [%d][%s, %d][%d] ", serial, groups[groupid].c_str(), level, thread);
+        else
+            printf("Tracer: [%d][%s, %d] ", serial, groups[groupid].c_str(), level);
+
+        // in timing mode, nested scopes are indented
+        for (int i = 0; i < depth; i++)
+            printf("  ");
+
+        if (type == TRACER_ENTRY_EXIT)
+        {
+            long long elapsed;
+            if (datalength >= 8)
+            {
+                memcpy(&elapsed, data, 8);
+                printf("-exit- %lld ns%s\n", elapsed, count);
+            }
+            else
+                printf("-exit-%s\n", count);
+        }
+        else if (type == TRACER_ENTRY_TEXT)
+        {
+            printf("%.*s%s\n", datalength, data, count);
+        }
+        else
+        {
+            int formatid;
+            memcpy(&formatid, payload, 4);
+
+            std::map<int, std::string>::iterator it = formats.find(formatid);
+            if (it == formats.end())
+            {
+                printf("<unknown format %d>\n", formatid);
+                continue;
+            }
+
+            TracerArgs::Format(it->second.c_str(), data, datalength, message, sizeof(message));
+            printf("%s%s\n", message, count);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    bool times = false;
+    bool threads = false;
+    bool ok = true;
+    int first = 1;
+
+    for ( ; (first < argc) && (argv[first][0] == '-'); first++)
+    {
+        if (0 == strcmp(argv[first], "-t"))
+            times = true;
+        else if (0 == strcmp(argv[first], "-T"))
+            threads = true;
+        else
+            break;
+    }
+
+    if (first >= argc)
+    {
+        fprintf(stderr, "usage: tracer-decode [-t] [-T] trace.bin ...\n");
+        return 2;
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        groups.clear();
+        formats.clear();
+        if (!Decode(argv[i], times, threads))
+            ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+#    tracer-floor-check
+#
+#    Checks that call sites outside the compile time floor leave nothing in
+#    the object file: no TracerSite, no TracerLimit, and none of their
+#    message strings, while the sites inside the floor are kept.  A small
+#    source with sites on both sides of the floor is compiled at each
+#    optimisation level, since the stripping must not depend on the
+#    optimiser, and the object file is searched with nm and strings.
+#
+#        tracer-floor-check.sh [compiler]
+#
+#    Run from the cpp directory.  The compiler defaults to $CXX, or g++.
+#    Exits with 0 if every check passes.
+#
+
+CXX=${1:-${CXX:-g++}}
+DIR=$(mktemp -d /tmp/tracer-floor.XXXXXX)
+trap 'rm -rf "$DIR"' EXIT
+
+cat > "$DIR/floor.cpp" <<'EOF'
+#include "Tracer.h"
+
+int Expensive();
+
+void Sites(int n)
+{
+    // outside the floor, by level and by group
+    TRACER(true, "Net", 9, "stripped by level %d", Expensive());
+    TRACER(true, "Ui", 1, "stripped by group %d", n);
+    TRACER_SCOPE(gone, true, "Net", 9, "stripped scope %d", n);
+    TRACER_PRINT(gone, true, "stripped print %d", Expensive());
+    TRACER_PRINT_LIMITED(gone, TRACER_LIMIT_EVERY, 10, true, "stripped limited %d", n);
+
+    // inside the floor
+    TRACER(true, "Net", 5, "kept by floor %d", n);
+    TRACER_SCOPE(kept, true, "Db", 1, "kept scope %d", n);
+    TRACER_PRINT(kept, true, "kept print %d", n);
+}
+EOF
+
+failed=0
+for opt in -O0 -O1 -O2 -Os; do
+    obj="$DIR/floor$opt.o"
+    if ! $CXX -std=c++17 $opt -I. -DTRACER_COMPILE_LEVEL=5 -DTRACER_COMPILE_GROUPS='"Net,Db"' \
+              -c "$DIR/floor.cpp" -o "$obj"; then
+        echo "$opt: does not compile"
+        failed=1
+        continue
+    fi
+
+    result=ok
+    if strings "$obj" | grep -q 'stripped'; then
+        echo "$opt: a stripped message string is in the object file:"
+        strings "$obj" | grep 'stripped' | sed 's/^/    /'
+        result=FAILED
+    fi
+    if nm -C "$obj" | grep -q 'gone_\|Expensive'; then
+        echo "$opt: a stripped site is in the object file:"
+        nm -C "$obj" | grep 'gone_\|Expensive' | sed 's/^/    /'
+        result=FAILED
+    fi
+    if [ "$(strings "$obj" | grep -c 'kept.* %d')" -ne 3 ]; then
+        echo "$opt: the sites inside the floor are not all kept"
+        result=FAILED
+    fi
+    if [ "$(nm -C "$obj" | grep -c 'tracer_site\|kept_site')" -ne 2 ]; then
+        echo "$opt: the TracerSites inside the floor are not both kept"
+        result=FAILED
+    fi
+
+    echo "$opt $result"
+    [ $result = ok ] || failed=1
+done
+
+exit $failed
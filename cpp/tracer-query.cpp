@@ -0,0 +1,449 @@
+//
+//    tracer-query
+//
+//    Prints the records of an archive written with TRACEARCHIVE (see
+//    TracerArchive.h) that match a query, as the familiar Tracer text lines,
+//    to stdout.  Only the blocks whose header shows they can hold a match
+//    are read and decompressed.
+//
+//        tracer-query [-t] [-T] [-g group,...] [-l level[-level]]
+//                     [-s serial[-serial]] [-f time] [-u time] trace.tza ...
+//        tracer-query -i trace.tza ...
+//
+//    Options:
+//
+//        -g Db,Net     records of the given groups
+//        -l 1-5        records of levels 1 to 5, or -l 5 for level 5 only
+//        -s 100-200    records of Tracers with serial numbers 100 to 200
+//        -f time       records from this time on
+//        -u time       records up to this time
+//        -t            prefix each line with the time of its record
+//        -T            show the ID of the thread that wrote each record
+//        -i            list the blocks of the archive, with their ranges,
+//                      instead of printing records
+//
+//    A time is seconds since the epoch, such as 1692812345.5, or a local
+//    date and time, 2023-08-23 17:39:05, or just a time of day, 17:39:05,
+//    on the day the archive was started.  An archive without its index, from
+//    a process that died, is read block by block from the start.  With more
+//    than one archive, the records of each are printed in turn.
+//
+//    Build with
+//
+//        g++ -std=c++17 -O2 -o tracer-query tracer-query.cpp -lz
+//
+
+#include "TracerArchive.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+
+
+//
+// the query.  Ranges are inclusive
+//
+struct Query
+{
+    std::vector<std::string> groups;        // empty for every group
+    int minlevel = -2147483647 - 1, maxlevel = 2147483647;
+    int minserial = -2147483647 - 1, maxserial = 2147483647;
+    long long from = 0, until = 0x7fffffffffffffffLL;
+    const char *fromtext = 0, *untiltext = 0;   // times as given, read
+                                            // against each archive's date
+    bool times = false;
+    bool threads = false;
+    bool index = false;
+};
+
+
+//
+// one archive being read
+//
+struct Archive
+{
+    FILE *fp;
+    const char *path;
+    TracerArchiveHeader header;
+    std::vector<std::string> groups;        // names, by group number
+    std::vector<bool> wanted;               // does the query want each group?
+};
+
+
+//
+// read a range, "5" or "1-5"
+//
+static bool Range(const char *text, int& low, int& high)
+{
+    char *end;
+    low = (int)strtol(text, &end, 10);
+    high = low;
+    if (*end == '-')
+        high = (int)strtol(end + 1, &end, 10);
+    return (*end == 0) && (end != text) && (low <= high);
+}
+
+
+//
+// read a time, in nanoseconds since the epoch, against the day the
+// archive was started
+//
+static bool Time(const char *text, long long created, long long& ns)
+{
+    struct tm tm;
+    double fraction = 0;
+    const char *rest = 0;
+
+    // strptime() may fill in part of 'tm' before it fails, so each try
+    // starts from the archive's day afresh
+    time_t day = (time_t)(created / 1000000000LL);
+    localtime_r(&day, &tm);
+    rest = strptime(text, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!rest)
+    {
+        localtime_r(&day, &tm);
+        rest = strptime(text, "%H:%M:%S", &tm);
+    }
+
+    if (rest)
+    {
+        if (*rest == '.')
+            fraction = atof(rest);
+        else if (*rest)
+            return false;
+
+        tm.tm_isdst = -1;
+        ns = (long long)mktime(&tm) * 1000000000LL + (long long)(fraction * 1e9);
+        return true;
+    }
+
+    char *end;
+    double seconds = strtod(text, &end);
+    if ( (*end != 0) || (end == text) )
+        return false;
+
+    ns = (long long)(seconds * 1e9);
+    return true;
+}
+
+
+//
+// print the timestamp prefix for -t, as tracer-decode does
+//
+static void PrintTime(long long timestamp)
+{
+    time_t seconds = (time_t)(timestamp / 1000000000LL);
+    struct tm tm;
+    char text[32];
+
+    localtime_r(&seconds, &tm);
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%09lld ", text, timestamp % 1000000000LL);
+}
+
+
+//
+// the offsets of the blocks, from the index at the end of the archive, or
+// by walking the block headers if it has none
+//
+static std::vector<long long> Blocks(Archive& archive)
+{
+    std::vector<long long> offsets;
+    TracerArchiveIndex index;
+
+    if ( (fseeko(archive.fp, -(off_t)sizeof(index), SEEK_END) == 0) &&
+         (fread(&index, 1, sizeof(index), archive.fp) == sizeof(index)) &&
+         (0 == memcmp(index.magic, TRACER_ARCHIVE_INDEXMAGIC, sizeof(index.magic))) &&
+         (index.blocks >= 0) )
+    {
+        offsets.resize(index.blocks);
+        if ( (fseeko(archive.fp, index.offset, SEEK_SET) == 0) &&
+             (fread(offsets.data(), sizeof(long long), index.blocks, archive.fp) == (size_t)index.blocks) )
+            return offsets;
+        offsets.clear();
+    }
+
+    // no index, so follow the headers along
+    fprintf(stderr, "tracer-query: %s has no index, reading it from the start\n", archive.path);
+
+    long long offset = sizeof(TracerArchiveHeader);
+    TracerArchiveBlock block;
+    while ( (fseeko(archive.fp, offset, SEEK_SET) == 0) &&
+            (fread(&block, 1, sizeof(block), archive.fp) == sizeof(block)) &&
+            (0 == memcmp(block.magic, TRACER_ARCHIVE_BLOCKMAGIC, sizeof(block.magic))) )
+    {
+        offsets.push_back(offset);
+        offset += (long long)sizeof(block) + block.names + block.compressed;
+    }
+
+    // the last block may have been cut short
+    if (!offsets.empty())
+    {
+        fseeko(archive.fp, 0, SEEK_END);
+        if (offset > (long long)ftello(archive.fp))
+            offsets.pop_back();
+    }
+
+    return offsets;
+}
+
+
+//
+// take up the names of the groups first seen in a block
+//
+static void Names(Archive& archive, const Query& query, const char *names, int length)
+{
+    while (length >= 4)
+    {
+        unsigned short header[2];
+        memcpy(header, names, sizeof(header));
+        if (4 + header[1] > length)
+            break;
+
+        if (header[0] >= archive.groups.size())
+        {
+            archive.groups.resize(header[0] + 1);
+            archive.wanted.resize(header[0] + 1);
+        }
+
+        std::string name(names + 4, header[1]);
+        bool wanted = query.groups.empty();
+        for (const std::string& group : query.groups)
+            wanted = wanted || (group == name);
+
+        archive.groups[header[0]] = name;
+        archive.wanted[header[0]] = wanted;
+
+        names += 4 + header[1];
+        length -= 4 + header[1];
+    }
+}
+
+
+//
+// could a block hold a record the query wants?
+//
+static bool Matches(const Archive& archive, const Query& query, const TracerArchiveBlock& block)
+{
+    if ( (block.maxlevel < query.minlevel) || (block.minlevel > query.maxlevel) ||
+         (block.maxserial < query.minserial) || (block.minserial > query.maxserial) ||
+         (block.maxtime < query.from) || (block.mintime > query.until) )
+        return false;
+
+    if (query.groups.empty())
+        return true;
+
+    // groups past the last bit share it, so that bit only says "maybe"
+    for (size_t n = 0; n < archive.groups.size(); n++)
+    {
+        int bit = (n < TRACER_ARCHIVE_GROUPS) ? (int)n : TRACER_ARCHIVE_GROUPS - 1;
+        if ( archive.wanted[n] && (block.groups[bit / 64] & (1ULL << (bit % 64))) )
+            return true;
+    }
+    return false;
+}
+
+
+//
+// print the records of a block that the query wants
+//
+static void Print(const Archive& archive, const Query& query, const char *data, int length)
+{
+    int at = 0;
+    while (at + (int)sizeof(TracerArchiveEntry) <= length)
+    {
+        TracerArchiveEntry entry;
+        memcpy(&entry, data + at, sizeof(entry));
+        const char *text = data + at + sizeof(entry);
+        at += (int)sizeof(entry) + entry.length;
+        if ( (entry.length < 0) || (at > length) )
+            break;
+
+        if ( (entry.level < query.minlevel) || (entry.level > query.maxlevel) ||
+             (entry.serial < query.minserial) || (entry.serial > query.maxserial) ||
+             (entry.timestamp < query.from) || (entry.timestamp > query.until) ||
+             (entry.group >= archive.groups.size()) || !archive.wanted[entry.group] )
+            continue;
+
+        if (query.times)
+            PrintTime(entry.timestamp);
+
+        const char *group = archive.groups[entry.group].c_str();
+        if (query.threads)
+            printf("Tracer: [%d][%s, %d][%d] ", entry.serial, group, entry.level, entry.thread);
+        else
+            printf("Tracer: [%d][%s, %d] ", entry.serial, group, entry.level);
+
+        // in timing mode, nested scopes are indented
+        for (int i = 0; i < entry.depth; i++)
+            printf("  ");
+
+        if (entry.suppressed)
+            printf("%.*s (%d suppressed)\n", entry.length, text, entry.suppressed);
+        else
+            printf("%.*s\n", entry.length, text);
+    }
+}
+
+
+//
+// run the query over one archive
+//
+static bool Search(const char *path, Query query)
+{
+    Archive archive;
+    archive.path = path;
+    archive.fp = fopen(path, "rb");
+    if (!archive.fp)
+    {
+        fprintf(stderr, "tracer-query: cannot open %s\n", path);
+        return false;
+    }
+
+    if ( (fread(&archive.header, 1, sizeof(archive.header), archive.fp) != sizeof(archive.header)) ||
+         (0 != memcmp(archive.header.magic, TRACER_ARCHIVE_MAGIC, sizeof(archive.header.magic))) ||
+         (archive.header.version != TRACER_ARCHIVE_VERSION) )
+    {
+        fprintf(stderr, "tracer-query: %s is not an archive this tracer-query understands\n", path);
+        fclose(archive.fp);
+        return false;
+    }
+
+    // a time of day is taken on the day this archive was started
+    if ( (query.fromtext && !Time(query.fromtext, archive.header.created, query.from)) ||
+         (query.untiltext && !Time(query.untiltext, archive.header.created, query.until)) )
+    {
+        fprintf(stderr, "tracer-query: cannot read the time given\n");
+        fclose(archive.fp);
+        return false;
+    }
+
+    std::vector<long long> offsets = Blocks(archive);
+    std::vector<char> names, compressed, data;
+    int read = 0;
+
+    for (size_t n = 0; n < offsets.size(); n++)
+    {
+        TracerArchiveBlock block;
+        if ( (fseeko(archive.fp, offsets[n], SEEK_SET) != 0) ||
+             (fread(&block, 1, sizeof(block), archive.fp) != sizeof(block)) ||
+             (0 != memcmp(block.magic, TRACER_ARCHIVE_BLOCKMAGIC, sizeof(block.magic))) )
+        {
+            fprintf(stderr, "tracer-query: %s has a bad block at offset %lld\n", path, offsets[n]);
+            break;
+        }
+
+        // the group names must be taken up from every block, wanted or not
+        names.resize(block.names);
+        if (fread(names.data(), 1, block.names, archive.fp) != (size_t)block.names)
+            break;
+        Names(archive, query, names.data(), block.names);
+
+        if (query.index)
+        {
+            printf("block %zu at %lld: %d records, %d bytes in %d, levels %d-%d, serials %d-%d, times %lld.%06lld-%lld.%06lld, groups",
+                   n, offsets[n], block.records, block.length, block.compressed, block.minlevel, block.maxlevel,
+                   block.minserial, block.maxserial, block.mintime / 1000000000LL, (block.mintime % 1000000000LL) / 1000,
+                   block.maxtime / 1000000000LL, (block.maxtime % 1000000000LL) / 1000);
+            for (size_t g = 0; g < archive.groups.size(); g++)
+            {
+                int bit = (g < TRACER_ARCHIVE_GROUPS) ? (int)g : TRACER_ARCHIVE_GROUPS - 1;
+                if (block.groups[bit / 64] & (1ULL << (bit % 64)))
+                    printf(" %s", archive.groups[g].c_str());
+            }
+            printf("\n");
+            continue;
+        }
+
+        if (!Matches(archive, query, block))
+            continue;
+
+        compressed.resize(block.compressed);
+        data.resize(block.length);
+        uLongf length = block.length;
+        if ( (fread(compressed.data(), 1, block.compressed, archive.fp) != (size_t)block.compressed) ||
+             (uncompress((Bytef *)data.data(), &length, (const Bytef *)compressed.data(), block.compressed) != Z_OK) )
+        {
+            fprintf(stderr, "tracer-query: %s has a damaged block at offset %lld\n", path, offsets[n]);
+            continue;
+        }
+
+        Print(archive, query, data.data(), (int)length);
+        ++read;
+    }
+
+    if (!query.index)
+        fprintf(stderr, "tracer-query: %s: read %d of %zu blocks\n", path, read, offsets.size());
+
+    fclose(archive.fp);
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    Query query;
+    bool ok = true;
+    int first = 1;
+
+    for ( ; (first < argc) && (argv[first][0] == '-'); first++)
+    {
+        const char *option = argv[first];
+        const char *value = (first + 1 < argc) ? argv[first + 1] : 0;
+
+        if (0 == strcmp(option, "-t"))
+            query.times = true;
+        else if (0 == strcmp(option, "-T"))
+            query.threads = true;
+        else if (0 == strcmp(option, "-i"))
+            query.index = true;
+        else if ( value && (0 == strcmp(option, "-g")) )
+        {
+            std::string list(value);
+            size_t start = 0;
+            while (start <= list.length())
+            {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos)
+                    comma = list.length();
+                if (comma > start)
+                    query.groups.push_back(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+            first++;
+        }
+        else if ( value && (0 == strcmp(option, "-l")) && Range(value, query.minlevel, query.maxlevel) )
+            first++;
+        else if ( value && (0 == strcmp(option, "-s")) && Range(value, query.minserial, query.maxserial) )
+            first++;
+        else if ( value && (0 == strcmp(option, "-f")) )
+            query.fromtext = argv[++first];
+        else if ( value && (0 == strcmp(option, "-u")) )
+            query.untiltext = argv[++first];
+        else
+        {
+            first = argc;
+            break;
+        }
+    }
+
+    if (first >= argc)
+    {
+        fprintf(stderr, "usage: tracer-query [-t] [-T] [-g group,...] [-l level[-level]] [-s serial[-serial]]\n"
+                        "                    [-f time] [-u time] trace.tza ...\n"
+                        "       tracer-query -i trace.tza ...\n");
+        return 2;
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        if (!Search(argv[i], query))
+            ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+//
+//    tracer-stress
+//
+//    Checks that lines written by many threads at once never interleave.
+//    Each thread prints messages from a TRACER() site, and from a
+//    TRACER_SCOPE() with a Print() and its -exit- line, while one thread
+//    calls Tracer::Configure() to make every site decide again.  The output
+//    file is then read back, and every line must be whole, and every message
+//    must appear exactly once:
+//
+//        tracer-stress [threads [iterations]]
+//
+//    The threads run in a child process, and output goes to a temporary
+//    file, which is removed if the check passes.  The other TRACExx
+//    variables, such as TRACEASYNC, are honoured as usual, so each output
+//    path can be checked.  With TRACEASYNC a full ring drops records, so
+//    then the messages missing must add up to the drops reported.  Exits
+//    with 0 if the check passes.
+//
+//    Build with
+//
+//        g++ -std=c++17 -O2 -pthread -o tracer-stress tracer-stress.cpp Tracer*.cpp
+//
+
+#include "Tracer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// long enough that a line interleaved with another can't go unnoticed
+#define STRESS_PADDING  "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789" \
+                        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+
+
+//
+// one thread's share of the messages
+//
+static void Work(int thread, int iterations)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        TRACER(true, "Stress", 5, "t %d i %d %s", thread, i, STRESS_PADDING);
+
+        TRACER_SCOPE(tt, true, "Stress", 5, "scope t %d i %d", thread, i);
+        TRACER_PRINT(tt, true, "print t %d i %d %s", thread, i, STRESS_PADDING);
+
+        // every site decides again, now and then
+        if ( (thread == 0) && (i % 1000 == 0) )
+            Tracer::Configure("Stress,Other", 10, false);
+    }
+}
+
+
+//
+// check one message.  Returns false if it is not one the threads print,
+// or has been seen before
+//
+static bool Check(const char *text, int threads, int iterations, std::vector<unsigned char>& seen)
+{
+    // the kinds of message, in the order of their bits in 'seen'
+    static const char *formats[] = { "t %d i %d %n", "scope t %d i %d%n", "print t %d i %d %n" };
+
+    for (int kind = 0; kind < 3; kind++)
+    {
+        int thread = -1, i = -1, end = -1;
+        if ( (sscanf(text, formats[kind], &thread, &i, &end) != 2) || (end < 0) )
+            continue;
+        if ( (thread < 0) || (thread >= threads) || (i < 0) || (i >= iterations) )
+            return false;
+
+        const char *rest = text + end;
+        if ( (kind != 1) && (strcmp(rest, STRESS_PADDING) != 0) )
+            return false;
+        if ( (kind == 1) && (*rest != '\0') )
+            return false;
+
+        unsigned char& bits = seen[(size_t)thread * iterations + i];
+        if (bits & (1 << kind))
+            return false;
+        bits |= 1 << kind;
+        return true;
+    }
+    return false;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int threads = (argc > 1) ? atoi(argv[1]) : 16;
+    int iterations = (argc > 2) ? atoi(argv[2]) : 20000;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/tracer-stress-%d", (int)getpid());
+    setenv("TRACEGROUP", "Stress", 1);
+    setenv("TRACELEVEL", "10", 1);
+    setenv("TRACEFILE", path, 1);
+    unsetenv("TRACETIME");
+    unsetenv("TRACETHREAD");
+    unsetenv("TRACEFORMAT");
+    unsetenv("TRACECOALESCE");
+
+    // the threads run in a child, so that asynchronous output has all been
+    // written when it exits
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++)
+            workers.emplace_back(Work, t, iterations);
+        for (std::thread& worker : workers)
+            worker.join();
+        exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if ( !WIFEXITED(status) || (WEXITSTATUS(status) != 0) )
+    {
+        fprintf(stderr, "tracer-stress: the threads did not finish\n");
+        return 1;
+    }
+
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "tracer-stress: cannot read %s\n", path);
+        return 1;
+    }
+
+    std::vector<unsigned char> seen((size_t)threads * iterations, 0);
+    long long lines = 0, exits = 0, bad = 0, dropped = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        ++lines;
+        size_t length = strlen(line);
+        bool whole = (length > 0) && (line[length - 1] == '\n');
+        if (whole)
+            line[length - 1] = '\0';
+
+        // Tracer: [serial][Stress, 5] message
+        int serial = 0, end = -1;
+        long long drops = 0;
+        bool ok = whole && (sscanf(line, "Tracer: [%d][Stress, 5] %n", &serial, &end) == 1) && (end > 0);
+        if ( whole && (sscanf(line, "Tracer: [async] %lld records dropped", &drops) == 1) )
+        {
+            dropped += drops;
+            ok = true;
+        }
+        else if ( ok && (strcmp(line + end, "-exit-") == 0) )
+            ++exits;
+        else if (ok)
+            ok = Check(line + end, threads, iterations, seen);
+
+        if (!ok && (++bad <= 10))
+            fprintf(stderr, "tracer-stress: bad line %lld: %s\n", lines, line);
+    }
+    fclose(fp);
+
+    // every message, and every -exit- line, is either there or dropped
+    long long missing = (long long)threads * iterations - exits;
+    for (unsigned char bits : seen)
+        missing += ((bits & 1) == 0) + ((bits & 2) == 0) + ((bits & 4) == 0);
+
+    printf("%lld lines, %lld bad, %lld missing, %lld dropped\n", lines, bad, missing, dropped);
+    if ( bad || (missing != dropped) )
+        return 1;
+
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,374 @@
+//
+//    tracerctl
+//
+//    Shows and changes the Tracer settings of a running process, through
+//    the control segment it publishes when TRACESHARED=TRUE (see
+//    TracerShared.h).
+//
+//        tracerctl                         list the processes publishing a segment
+//        tracerctl pid                     show the settings, the groups, and the
+//                                          call sites with their hit counts
+//        tracerctl pid on group[:level]    turn a group on, optionally at its own level
+//        tracerctl pid off group           turn a group off
+//        tracerctl pid level n             set TRACELEVEL
+//        tracerctl pid only TRUE|FALSE     set TRACEONLY
+//        tracerctl pid set groups [level [only]]
+//                                          replace TRACEGROUP, and optionally
+//                                          TRACELEVEL and TRACEONLY
+//
+//    A change is installed by the process the next time any of its threads
+//    reaches a Tracer.  tracerctl waits a moment for that, and says whether
+//    it has happened.
+//
+//    Build with
+//
+//        g++ -std=c++17 -O2 -o tracerctl tracerctl.cpp
+//
+
+#include "TracerShared.h"
+#include "Tracer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+//
+// map the segment of process 'pid'.  Returns 0, with a message, if there
+// is no usable segment
+//
+static TracerSharedSegment *Open(int pid, bool quiet)
+{
+    char path[64];
+    snprintf(path, sizeof(path), TRACER_SHARED_PATH "%d", pid);
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+    {
+        if (!quiet)
+            fprintf(stderr, "tracerctl: no Tracer control segment for process %d\n", pid);
+        return 0;
+    }
+
+    struct stat st;
+    void *mapped = MAP_FAILED;
+    if ( (fstat(fd, &st) == 0) && (st.st_size >= (off_t)sizeof(TracerSharedSegment)) )
+        mapped = mmap(0, sizeof(TracerSharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    TracerSharedSegment *segment = (TracerSharedSegment *)mapped;
+    if ( (mapped == MAP_FAILED) || (segment->magic != TRACER_SHARED_MAGIC) ||
+         (segment->version != TRACER_SHARED_VERSION) || (segment->size != sizeof(TracerSharedSegment)) )
+    {
+        if (!quiet)
+            fprintf(stderr, "tracerctl: %s is not a control segment this tracerctl understands\n", path);
+        if (mapped != MAP_FAILED)
+            munmap(mapped, sizeof(TracerSharedSegment));
+        return 0;
+    }
+
+    return segment;
+}
+
+
+//
+// is a setting TRUE, as Tracer reads it?
+//
+static bool True(const char *value)
+{
+    return (0 == strcmp(value, "TRUE")) || (0 == strcmp(value, "true")) || (0 == strcmp(value, "True"));
+}
+
+
+//
+// is process 'pid' still running?
+//
+static bool Alive(int pid)
+{
+    return (kill(pid, 0) == 0) || (errno == EPERM);
+}
+
+
+//
+// list the processes that have published a segment
+//
+static int List()
+{
+    DIR *dir = opendir("/dev/shm");
+    if (!dir)
+    {
+        perror("tracerctl: /dev/shm");
+        return 1;
+    }
+
+    printf("%8s  %-10s  %s\n", "pid", "state", "settings");
+
+    struct dirent *entry;
+    while ( (entry = readdir(dir)) )
+    {
+        if (0 != strncmp(entry->d_name, "tracer.", 7))
+            continue;
+
+        int pid = atoi(entry->d_name + 7);
+        TracerSharedSegment *segment = (pid > 0) ? Open(pid, true) : 0;
+        if (!segment)
+            continue;
+
+        printf("%8d  %-10s  TRACEGROUP=%s TRACELEVEL=%d TRACEONLY=%s\n", pid, Alive(pid) ? "running" : "gone",
+               segment->current.groups, segment->current.level, segment->current.only ? "TRUE" : "FALSE");
+        munmap(segment, sizeof(TracerSharedSegment));
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+
+//
+// show the settings, the groups and the sites of one process
+//
+static int Show(TracerSharedSegment *segment)
+{
+    unsigned request = segment->request.load(std::memory_order_acquire);
+    printf("process %d%s  TRACEGROUP=%s TRACELEVEL=%d TRACEONLY=%s  epoch %d%s\n",
+           segment->pid, Alive(segment->pid) ? "" : " (gone)", segment->current.groups, segment->current.level,
+           segment->current.only ? "TRUE" : "FALSE", segment->epoch.load(std::memory_order_relaxed),
+           (request != segment->applied.load(std::memory_order_relaxed)) ? "  (change pending)" : "");
+
+    int groups = segment->groupcount.load(std::memory_order_acquire);
+    if (groups > TRACER_MAX_GROUPS)
+        groups = TRACER_MAX_GROUPS;
+
+    printf("\n%5s  %-24s %-4s %6s\n", "id", "group", "on", "level");
+    for (int id = 1; id <= groups; id++)
+    {
+        const TracerSharedGroup& g = segment->groups[id];
+        printf("%5d  %-24.*s %-4s %6d\n", id, TRACER_SHARED_NAME, g.name,
+               g.enabled.load(std::memory_order_relaxed) ? "yes" : "no", g.threshold.load(std::memory_order_relaxed));
+    }
+
+    // the sites, busiest first
+    std::vector<const TracerSharedSite *> sites;
+    for (int i = 0; i < TRACER_SHARED_SITES; i++)
+    {
+        if (segment->sites[i].state.load(std::memory_order_acquire) == TRACER_SHARED_READY)
+            sites.push_back(&segment->sites[i]);
+    }
+
+    std::sort(sites.begin(), sites.end(), [](const TracerSharedSite *a, const TracerSharedSite *b)
+    {
+        return a->hits.load(std::memory_order_relaxed) > b->hits.load(std::memory_order_relaxed);
+    });
+
+    static const char *decisions[] = { "new", "off", "on", "recorded" };
+
+    printf("\n%12s  %-24s %6s  %-8s  %s\n", "hits", "group", "level", "state", "site");
+    for (const TracerSharedSite *site : sites)
+    {
+        int groupid = site->groupid;
+        const char *group = ( (groupid > 0) && (groupid <= groups) ) ? segment->groups[groupid].name : "?";
+
+        printf("%12llu  %-24.*s %6d  %-8s  %.*s\n", site->hits.load(std::memory_order_relaxed),
+               TRACER_SHARED_NAME, group, site->level, decisions[site->decision.load(std::memory_order_relaxed) & 3],
+               TRACER_SHARED_FORMAT, site->format);
+    }
+
+    unsigned full = segment->sitesfull.load(std::memory_order_relaxed);
+    if (full)
+        printf("(%u sites not shown, more than %d)\n", full, TRACER_SHARED_SITES);
+
+    return 0;
+}
+
+
+//
+// the settings a change starts from: those asked for, if a change is still
+// pending, otherwise those in force
+//
+static TracerSharedSettings Base(TracerSharedSegment *segment)
+{
+    TracerSharedSettings settings;
+
+    unsigned request = segment->request.load(std::memory_order_acquire);
+    if ( !(request & 1) && (request != segment->applied.load(std::memory_order_acquire)) )
+        memcpy(&settings, &segment->wanted, sizeof(settings));
+    else
+        memcpy(&settings, &segment->current, sizeof(settings));
+
+    settings.groups[sizeof(settings.groups) - 1] = 0;
+    return settings;
+}
+
+
+//
+// the entries of a TRACEGROUP setting, less any for group 'name'
+//
+static std::vector<std::string> Without(const char *groups, const std::string& name)
+{
+    std::vector<std::string> entries;
+
+    std::string list = groups;
+    size_t start = 0;
+    while (start <= list.length())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.length();
+
+        std::string entry = list.substr(start, end - start);
+        std::string entryname = entry.substr(0, entry.find(':'));
+        if ( !entry.empty() && (entryname != name) )
+            entries.push_back(entry);
+
+        start = end + 1;
+    }
+
+    return entries;
+}
+
+
+//
+// hand new settings to the process.  They are written while 'request' is
+// odd, and the epoch is advanced once it is even again, so that call sites
+// look for them
+//
+static int Change(TracerSharedSegment *segment, const TracerSharedSettings& settings)
+{
+    // serialize with other tracerctl commands.  A lock held for a second is
+    // taken to belong to a tracerctl that died holding it
+    int me = (int)getpid();
+    for (int tries = 0; ; tries++)
+    {
+        int owner = 0;
+        if (segment->lock.compare_exchange_strong(owner, me, std::memory_order_acquire))
+            break;
+        if (tries >= 1000)
+        {
+            segment->lock.store(me, std::memory_order_relaxed);
+            break;
+        }
+        usleep(1000);
+    }
+
+    unsigned request = segment->request.load(std::memory_order_relaxed) | 1;
+    segment->request.store(request, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(&segment->wanted, &settings, sizeof(settings));
+
+    ++request;
+    segment->request.store(request, std::memory_order_release);
+
+    int epoch = segment->epoch.load(std::memory_order_relaxed);
+    while (!segment->epoch.compare_exchange_weak(epoch, (epoch + 1) & TRACER_EPOCH_MASK, std::memory_order_release))
+        ;
+
+    segment->lock.store(0, std::memory_order_release);
+
+    printf("TRACEGROUP=%s TRACELEVEL=%d TRACEONLY=%s\n", settings.groups, settings.level, settings.only ? "TRUE" : "FALSE");
+
+    // give the process a moment to install it
+    for (int waited = 0; waited < 500; waited += 10)
+    {
+        if (segment->applied.load(std::memory_order_acquire) == request)
+        {
+            printf("installed by process %d\n", segment->pid);
+            return 0;
+        }
+        usleep(10000);
+    }
+
+    printf("process %d will install it the next time it reaches a Tracer\n", segment->pid);
+    return 0;
+}
+
+
+static int Usage()
+{
+    fprintf(stderr, "usage: tracerctl\n"
+                    "       tracerctl pid\n"
+                    "       tracerctl pid on group[:level]\n"
+                    "       tracerctl pid off group\n"
+                    "       tracerctl pid level n\n"
+                    "       tracerctl pid only TRUE|FALSE\n"
+                    "       tracerctl pid set groups [level [only]]\n");
+    return 2;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+        return List();
+
+    int pid = atoi(argv[1]);
+    if (pid <= 0)
+        return Usage();
+
+    TracerSharedSegment *segment = Open(pid, false);
+    if (!segment)
+        return 1;
+
+    if (argc == 2)
+        return Show(segment);
+
+    std::string command = argv[2];
+    if (argc < 4)
+        return Usage();
+
+    TracerSharedSettings settings = Base(segment);
+
+    if ( (command == "on") || (command == "off") )
+    {
+        std::string entry = argv[3];
+        std::string name = entry.substr(0, entry.find(':'));
+
+        std::vector<std::string> entries = Without(settings.groups, name);
+        if (command == "on")
+            entries.push_back(entry);
+        else if ( (name != "ALL") && (std::find_if(entries.begin(), entries.end(), [](const std::string& e)
+                                     { return e.substr(0, e.find(':')) == "ALL"; }) != entries.end()) )
+            fprintf(stderr, "tracerctl: TRACEGROUP has ALL, so group %s stays on\n", name.c_str());
+
+        std::string groups;
+        for (const std::string& e : entries)
+            groups += (groups.empty() ? "" : ",") + e;
+        if (groups.length() >= sizeof(settings.groups))
+        {
+            fprintf(stderr, "tracerctl: group list is longer than %d characters\n", TRACER_SHARED_GROUPS - 1);
+            return 1;
+        }
+        strcpy(settings.groups, groups.c_str());
+    }
+    else if (command == "level")
+        settings.level = atoi(argv[3]);
+    else if (command == "only")
+        settings.only = True(argv[3]);
+    else if (command == "set")
+    {
+        if (strlen(argv[3]) >= sizeof(settings.groups))
+        {
+            fprintf(stderr, "tracerctl: group list is longer than %d characters\n", TRACER_SHARED_GROUPS - 1);
+            return 1;
+        }
+        strcpy(settings.groups, argv[3]);
+        if (argc > 4)
+            settings.level = atoi(argv[4]);
+        if (argc > 5)
+            settings.only = True(argv[5]);
+    }
+    else
+        return Usage();
+
+    return Change(segment, settings);
+}
@@ -0,0 +1,336 @@
+//
+//    tracerd
+//
+//    Aggregates the Tracer output of many processes, sent with TRACESOCKET
+//    (see TracerSocket.h), into one log.  Records are merged in timestamp
+//    order across all the processes, each tagged with the pid of the
+//    process that wrote it:
+//
+//        [4711] Tracer: [12][Db, 5] query done
+//        [4712] Tracer: [3][Net, 5] packet 17
+//
+//    A JSON line gets a "pid" member instead, so it stays valid JSON.
+//
+//        tracerd [-s socket] [-o file] [-m megabytes] [-n files] [-d delay] [-t]
+//
+//        -s socket       the socket to listen on, TRACER_SOCKET_PATH by default
+//        -o file         write to a file, instead of stdout
+//        -m megabytes    start a new file once this one reaches this size,
+//                        64 by default
+//        -n files        keep at most this many files, the current one
+//                        included: file, file.1, file.2, and so on.  8 by
+//                        default
+//        -d delay        milliseconds to hold each record for, waiting for
+//                        older records from other processes, 250 by default
+//        -t              prefix each line with the time of its record
+//
+//    Each process sends its records in order, but in batches, so records
+//    from different processes arrive out of order.  tracerd holds every
+//    record for the delay before writing it, so that records up to that
+//    much older, from other processes, can be put in front of it.  A record
+//    later than that is written as soon as it arrives, and counted.
+//
+//    tracerd stops on SIGINT or SIGTERM, writing everything it holds first.
+//
+//    Build with
+//
+//        g++ -std=c++17 -O2 -o tracerd tracerd.cpp
+//
+
+#include "TracerSocket.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <queue>
+#include <string>
+#include <vector>
+
+
+//
+// one record waiting to be written
+//
+struct Pending
+{
+    long long timestamp;
+    unsigned long long arrival;     // keeps records with the same timestamp in order
+    int pid;
+    std::string line;
+
+    bool operator>(const Pending& other) const
+    {
+        return (timestamp > other.timestamp) || ((timestamp == other.timestamp) && (arrival > other.arrival));
+    }
+};
+
+
+//
+// options
+//
+static const char  *output      = 0;
+static long long    limit       = 64LL << 20;
+static int          keep        = 8;
+static long long    delay       = 250000000LL;
+static bool         times       = false;
+
+//
+// output state
+//
+static FILE                *out         = stdout;
+static long long            written     = 0;        // bytes in the current file
+static long long            newest      = 0;        // timestamp of the last record written
+static unsigned long long   late        = 0;        // records written out of order
+static volatile sig_atomic_t stopping   = 0;
+
+static std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>> pending;
+
+
+//
+// nanoseconds since the epoch
+//
+static long long Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static void Stop(int)
+{
+    stopping = 1;
+}
+
+
+//
+// open the output file, appending to what is there
+//
+static bool Open()
+{
+    if (!output)
+        return true;
+
+    out = fopen(output, "a");
+    if (!out)
+    {
+        fprintf(stderr, "tracerd: cannot open %s: %s\n", output, strerror(errno));
+        return false;
+    }
+
+    written = ftell(out);
+    return true;
+}
+
+
+//
+// start a new file, shifting the old ones along, and dropping the oldest
+//
+static void Rotate()
+{
+    fclose(out);
+
+    std::string base = output;
+    for (int n = keep - 1; n >= 1; n--)
+    {
+        std::string from = (n == 1) ? base : base + "." + std::to_string(n - 1);
+        std::string to = base + "." + std::to_string(n);
+        rename(from.c_str(), to.c_str());
+    }
+    if (keep <= 1)
+        unlink(output);
+
+    if (!Open())
+        exit(1);
+}
+
+
+//
+// write one record, tagged with its pid
+//
+static void Write(const Pending& record)
+{
+    if (record.timestamp < newest)
+        ++late;
+    else
+        newest = record.timestamp;
+
+    if (times)
+    {
+        time_t seconds = (time_t)(record.timestamp / 1000000000LL);
+        struct tm tm;
+        char text[32];
+
+        localtime_r(&seconds, &tm);
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+        written += fprintf(out, "%s.%09lld ", text, record.timestamp % 1000000000LL);
+    }
+
+    const std::string& line = record.line;
+    if ( !line.empty() && (line[0] == '{') )
+    {
+        written += fprintf(out, "{\"pid\":%d%s", record.pid, (line.length() > 2) && (line[1] != '}') ? "," : "");
+        written += fwrite(line.data() + 1, 1, line.length() - 1, out);
+    }
+    else
+    {
+        written += fprintf(out, "[%d] ", record.pid);
+        written += fwrite(line.data(), 1, line.length(), out);
+    }
+
+    if ( output && (written >= limit) )
+        Rotate();
+}
+
+
+//
+// write every record held for at least the delay, or all of them
+//
+static void Release(bool all)
+{
+    long long cutoff = Now() - delay;
+    bool any = false;
+
+    while ( !pending.empty() && (all || (pending.top().timestamp <= cutoff)) )
+    {
+        Write(pending.top());
+        pending.pop();
+        any = true;
+    }
+
+    if (any)
+        fflush(out);
+}
+
+
+//
+// take the records out of one datagram
+//
+static void Receive(const char *data, int length)
+{
+    static unsigned long long arrivals = 0;
+
+    TracerSocketHeader header;
+    if (length < (int)sizeof(header))
+        return;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != TRACER_SOCKET_MAGIC)
+        return;
+
+    long long cutoff = Now() - delay;
+    int offset = sizeof(header);
+    for (int i = 0; (i < header.count) && (offset + TRACER_SOCKET_RECORD <= length); i++)
+    {
+        Pending record;
+        int size;
+        memcpy(&record.timestamp, data + offset, 8);
+        memcpy(&size, data + offset + 8, 4);
+        offset += TRACER_SOCKET_RECORD;
+        if ( (size < 0) || (offset + size > length) )
+            return;
+
+        record.arrival = arrivals++;
+        record.pid = header.pid;
+        record.line.assign(data + offset, size);
+        offset += size;
+
+        // a record already past the delay can't be put in order, so it is
+        // written at once
+        if (record.timestamp <= cutoff)
+            Write(record);
+        else
+            pending.push(std::move(record));
+    }
+}
+
+
+static int Usage()
+{
+    fprintf(stderr, "usage: tracerd [-s socket] [-o file] [-m megabytes] [-n files] [-d delay] [-t]\n");
+    return 2;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *path = TRACER_SOCKET_PATH;
+
+    int option;
+    while ( (option = getopt(argc, argv, "s:o:m:n:d:t")) != -1 )
+    {
+        switch (option)
+        {
+        case 's':   path = optarg;                                  break;
+        case 'o':   output = optarg;                                break;
+        case 'm':   limit = atoll(optarg) << 20;                    break;
+        case 'n':   keep = atoi(optarg);                            break;
+        case 'd':   delay = atoll(optarg) * 1000000LL;              break;
+        case 't':   times = true;                                   break;
+        default:    return Usage();
+        }
+    }
+    if ( (optind != argc) || (limit <= 0) || (keep < 1) || (delay < 0) )
+        return Usage();
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "tracerd: socket path too long\n");
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if ( (sock < 0) || (bind(sock, (struct sockaddr *)&address, sizeof(address)) != 0) )
+    {
+        fprintf(stderr, "tracerd: cannot listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    // a deep receive queue, so bursts don't push clients onto their local output
+    int size = 8 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    if (!Open())
+        return 1;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+
+    static char datagram[TRACER_SOCKET_BATCH];
+    while (!stopping)
+    {
+        struct pollfd fds = { sock, POLLIN, 0 };
+        if (poll(&fds, 1, 20) > 0)
+        {
+            // take everything queued before writing anything
+            ssize_t n;
+            while ( (n = recv(sock, datagram, sizeof(datagram), MSG_DONTWAIT)) > 0 )
+                Receive(datagram, (int)n);
+        }
+
+        Release(false);
+    }
+
+    Release(true);
+    unlink(path);
+
+    if (late)
+        fprintf(stderr, "tracerd: %llu records arrived too late to be written in order\n", late);
+    if (output)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,350 @@
+//
+//    TracerNative
+//
+//    The C++ Tracer as a CPython extension module, with the API of the pure
+//    Python class in Tracer.py, which uses it in place of its own class once
+//    it has been built:
+//
+//        tt = Tracer.Tracer(True, 'Foo', 10, 'Doing some detailed calculations')
+//        for i in range(10):
+//            tt.Print(True, 'Iteration {}', i)
+//
+//    Python Tracers go through the same machinery as the C++ ones in the
+//    process.  The enable decision is cached for each group and level, as
+//    it is for a TRACER() call site, and made again only when the settings
+//    change.  Serial numbers come from the C++ counter, and records go to the
+//    C++ output, in whatever TRACEFORMAT, and through the TRACEASYNC ring,
+//    the flight recorder and statistics mode, so Python and C++ lines are
+//    numbered and ordered as one stream.
+//
+//    Arguments after the message are formatted into it with str.format(),
+//    only if the Tracer prints, so a disabled Tracer costs no formatting.
+//    As in Tracer.py, a Tracer whose print_flag is False is inactive, and
+//    its Print() calls print nothing.
+//
+//    Build with, on one line,
+//
+//        g++ -std=c++17 -O2 -shared -fPIC -pthread $(python3-config --includes) -I../cpp
+//            -o TracerNative$(python3-config --extension-suffix) TracerNative.cpp ../cpp/Tracer*.cpp
+//
+//    That gives the module its own copy of the Tracer classes, which is
+//    all a pure Python program needs.  In a process that also has C++ code
+//    tracing, the two must share one copy, or each keeps its own counter
+//    and output.  Build the Tracer classes as a shared library, and link
+//    both the C++ code and the module against it:
+//
+//        g++ -std=c++17 -O2 -shared -fPIC -pthread -o libtracer.so ../cpp/Tracer*.cpp
+//        g++ -std=c++17 -O2 -shared -fPIC -pthread $(python3-config --includes) -I../cpp
+//            -o TracerNative$(python3-config --extension-suffix) TracerNative.cpp -L. -ltracer
+//
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "Tracer.h"
+
+#include <new>
+#include <string>
+#include <vector>
+
+
+//
+// the format string Python call sites are registered under, in statistics
+// mode and with tracerctl.  Python messages are formatted before they reach
+// the Tracer, so the site is known by its group and level
+//
+#define TRACER_PYTHON_FORMAT    "(python)"
+
+
+//
+// the call sites of one group, one for each level it has been traced at.
+// Like the static TracerSite of a TRACER() call site, they are kept for
+// the life of the process
+//
+struct PythonGroupSites
+{
+    std::string name;
+    std::vector<TracerSite *> levels;
+};
+
+
+//
+// group name to a capsule holding its PythonGroupSites.  Only touched with
+// the GIL held
+//
+static PyObject *groups = 0;
+
+
+//
+// a Python Tracer object
+//
+struct TracerObject
+{
+    PyObject_HEAD
+    Tracer tracer;
+};
+
+
+//
+// the call site for a group and level, created the first time it is seen.
+// Returns 0, with an exception set, on failure
+//
+static TracerSite *Site(PyObject *group, int level)
+{
+    PythonGroupSites *sites;
+
+    PyObject *capsule = PyDict_GetItemWithError(groups, group);
+    if (capsule)
+        sites = (PythonGroupSites *)PyCapsule_GetPointer(capsule, "TracerNative.sites");
+    else
+    {
+        if (PyErr_Occurred())
+            return 0;
+
+        Py_ssize_t length;
+        const char *name = PyUnicode_AsUTF8AndSize(group, &length);
+        if (!name)
+            return 0;
+
+        sites = new PythonGroupSites;
+        sites->name.assign(name, length);
+
+        capsule = PyCapsule_New(sites, "TracerNative.sites", 0);
+        if ( !capsule || (PyDict_SetItem(groups, group, capsule) < 0) )
+        {
+            Py_XDECREF(capsule);
+            delete sites;
+            return 0;
+        }
+        Py_DECREF(capsule);
+    }
+
+    // a group is traced at only a few levels, so a list does
+    for (TracerSite *site : sites->levels)
+    {
+        if (site->level == level)
+            return site;
+    }
+
+    TracerSite *site = new TracerSite{ sites->name.c_str(), level, { TRACER_SITE_UNCHECKED }, { 0 }, { 0 } };
+    sites->levels.push_back(site);
+    return site;
+}
+
+
+//
+// print a message, formatting any arguments into it first.  Returns false,
+// with an exception set, on failure
+//
+static bool Emit(TracerObject *self, PyObject *const *args, Py_ssize_t nargs, bool announce)
+{
+    PyObject *text;
+    if (nargs == 1)
+        text = PyObject_Str(args[0]);
+    else
+    {
+        PyObject *format = PyObject_GetAttrString(args[0], "format");
+        if (!format)
+            return false;
+        text = PyObject_Vectorcall(format, args + 1, nargs - 1, 0);
+        Py_DECREF(format);
+    }
+    if (!text)
+        return false;
+
+    const char *utf8 = PyUnicode_Check(text) ? PyUnicode_AsUTF8(text) : 0;
+    if (!utf8)
+    {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_TypeError, "Tracer message must format to a str");
+        Py_DECREF(text);
+        return false;
+    }
+
+    if (announce)
+        self->tracer.Announce("%s", utf8);
+    else
+        self->tracer.Print(true, "%s", utf8);
+
+    Py_DECREF(text);
+    return true;
+}
+
+
+//
+// Tracer(print_flag, group, level, message, *args)
+//
+static PyObject *TracerNew(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames)
+{
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+    if ( (kwnames && PyTuple_GET_SIZE(kwnames)) || (nargs < 4) )
+    {
+        PyErr_SetString(PyExc_TypeError, "Tracer(print_flag, group, level, message, *args)");
+        return 0;
+    }
+
+    int condition = PyObject_IsTrue(args[0]);
+    if (condition < 0)
+        return 0;
+
+    if (!PyUnicode_Check(args[1]))
+    {
+        PyErr_SetString(PyExc_TypeError, "Tracer group must be a str");
+        return 0;
+    }
+
+    int level = (int)PyLong_AsLong(args[2]);
+    if ( (level == -1) && PyErr_Occurred() )
+        return 0;
+
+    TracerSite *site = Site(args[1], level);
+    if (!site)
+        return 0;
+
+    TracerObject *self = (TracerObject *)((PyTypeObject *)type)->tp_alloc((PyTypeObject *)type, 0);
+    if (!self)
+        return 0;
+    new (&self->tracer) Tracer();
+
+    // the same test a TRACER_SCOPE() makes, before doing anything else
+    if ( condition && (site->state.load(std::memory_order_relaxed) != Tracer::SiteDisabled()) &&
+         self->tracer.Open(*site, true, TRACER_PYTHON_FORMAT) )
+    {
+        if (!Emit(self, args + 3, nargs - 3, true))
+        {
+            Py_DECREF(self);
+            return 0;
+        }
+    }
+
+    return (PyObject *)self;
+}
+
+
+//
+// the same, called with a tuple, for the odd caller that doesn't use
+// vectorcall
+//
+static PyObject *TracerNewTuple(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    if ( kwargs && PyDict_GET_SIZE(kwargs) )
+    {
+        PyErr_SetString(PyExc_TypeError, "Tracer(print_flag, group, level, message, *args)");
+        return 0;
+    }
+
+    return TracerNew((PyObject *)type, &PyTuple_GET_ITEM(args, 0), PyTuple_GET_SIZE(args), 0);
+}
+
+
+//
+// the dtor prints the -exit- line, as ~Tracer does.  The type is a heap
+// type, which each of its objects holds a reference to
+//
+static void TracerDealloc(TracerObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    self->tracer.~Tracer();
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+
+//
+// tt.Print(print_flag, message, *args)
+//
+static PyObject *TracerPrint(TracerObject *self, PyObject *const *args, Py_ssize_t nargs)
+{
+    if (nargs < 2)
+    {
+        PyErr_SetString(PyExc_TypeError, "Print(print_flag, message, *args)");
+        return 0;
+    }
+
+    if (self->tracer.Active())
+    {
+        int condition = PyObject_IsTrue(args[0]);
+        if (condition < 0)
+            return 0;
+        if ( condition && !Emit(self, args + 1, nargs - 1, false) )
+            return 0;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef TracerMethods[] =
+{
+    { "Print", (PyCFunction)(void (*)(void))TracerPrint, METH_FASTCALL,
+      "Print(print_flag, message, *args): print a message, if print_flag is true and this Tracer prints" },
+    { NULL, NULL, 0, NULL }
+};
+
+
+static PyType_Slot TracerSlots[] =
+{
+    { Py_tp_dealloc, (void *)TracerDealloc },
+    { Py_tp_doc, (void *)"Tracer(print_flag, group, level, message, *args)" },
+    { Py_tp_methods, (void *)TracerMethods },
+    { Py_tp_new, (void *)TracerNewTuple },
+    { 0, NULL }
+};
+
+
+static PyType_Spec TracerSpec =
+{
+    "TracerNative.Tracer",                  // name
+    sizeof(TracerObject),                   // basicsize
+    0,                                      // itemsize
+    Py_TPFLAGS_DEFAULT,                     // flags
+    TracerSlots,                            // slots
+};
+
+
+static struct PyModuleDef TracerModule =
+{
+    PyModuleDef_HEAD_INIT,
+    "TracerNative",                         // m_name
+    "The C++ Tracer, with the API of Tracer.py",    // m_doc
+    -1,                                     // m_size
+    NULL,                                   // m_methods
+    NULL,                                   // m_slots
+    NULL,                                   // m_traverse
+    NULL,                                   // m_clear
+    NULL,                                   // m_free
+};
+
+
+PyMODINIT_FUNC PyInit_TracerNative()
+{
+    // there is no slot for tp_vectorcall before Python 3.14, so it is set
+    // on the type once made
+    PyTypeObject *type = (PyTypeObject *)PyType_FromSpec(&TracerSpec);
+    if (!type)
+        return 0;
+    type->tp_vectorcall = TracerNew;
+
+    groups = PyDict_New();
+    if (!groups)
+    {
+        Py_DECREF(type);
+        return 0;
+    }
+
+    PyObject *module = PyModule_Create(&TracerModule);
+    if (!module)
+    {
+        Py_DECREF(type);
+        return 0;
+    }
+
+    if (PyModule_AddObject(module, "Tracer", (PyObject *)type) < 0)
+    {
+        Py_DECREF(type);
+        Py_DECREF(module);
+        return 0;
+    }
+
+    return module;
+}
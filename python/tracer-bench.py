@@ -0,0 +1,131 @@
+#
+#    tracer-bench.py
+#
+#    Measures the cost of a Tracer call, in nanoseconds, for the pure Python
+#    class and for the C++ Tracer of the TracerNative module, and writes the
+#    results to stdout as JSON, as cpp/tracer-bench does:
+#
+#        group_filtered      Tracer whose group is not enabled
+#        level_filtered      Tracer whose group is enabled, but whose level
+#                            is too high
+#        enabled             Tracer that prints, to /dev/null
+#        exit                Tracer with one Print(), so it prints its -exit-
+#                            line when released
+#        eager_args          Tracer whose group is not enabled, with a message
+#                            formatted by the caller, as it must be without
+#                            format arguments
+#        lazy_args           the same, with the argument passed to the
+#                            Tracer to format, which it never does
+#
+#    Each result also gives the speedup of the native Tracer over the pure
+#    Python class.
+#
+#        python3 tracer-bench.py [iterations]
+#
+#    Output goes to /dev/null unless TRACEFILE is set.  The other TRACExx
+#    variables, such as TRACEASYNC and TRACEFORMAT, are honoured by the
+#    native Tracer as usual.  The TracerNative module must have been built
+#    (see TracerNative.cpp).
+#
+
+import json
+import os
+import sys
+import time
+
+
+#
+# the cases.  Each runs 'iterations' calls, and returns the elapsed time
+#
+def GroupFiltered(tracer, iterations):
+    start = time.perf_counter_ns()
+    for i in range(iterations):
+        tracer(True, 'Other', 5, 'Iteration {}', i)
+    return time.perf_counter_ns() - start
+
+def LevelFiltered(tracer, iterations):
+    start = time.perf_counter_ns()
+    for i in range(iterations):
+        tracer(True, 'Bench', 10, 'Iteration {}', i)
+    return time.perf_counter_ns() - start
+
+def Enabled(tracer, iterations):
+    start = time.perf_counter_ns()
+    for i in range(iterations):
+        tracer(True, 'Bench', 5, 'Iteration {}', i)
+    return time.perf_counter_ns() - start
+
+def Exit(tracer, iterations):
+    start = time.perf_counter_ns()
+    for i in range(iterations):
+        tt = tracer(True, 'Bench', 5, 'Scope {}', i)
+        tt.Print(True, 'Iteration {}', i)
+        del tt
+    return time.perf_counter_ns() - start
+
+def EagerArgs(tracer, iterations):
+    values = list(range(64))
+    start = time.perf_counter_ns()
+    for i in range(iterations):
+        tracer(True, 'Other', 5, 'Dump {}'.format(values))
+    return time.perf_counter_ns() - start
+
+def LazyArgs(tracer, iterations):
+    values = list(range(64))
+    start = time.perf_counter_ns()
+    for i in range(iterations):
+        tracer(True, 'Other', 5, 'Dump {}', values)
+    return time.perf_counter_ns() - start
+
+
+def main():
+
+    iterations = int(sys.argv[1]) if (len(sys.argv) > 1) else 200000
+    if iterations <= 0:
+        print('usage: tracer-bench.py [iterations]', file=sys.stderr)
+        return 1
+
+    # both Tracers read the same settings.  Enabled output goes nowhere,
+    # unless asked otherwise
+    os.environ['TRACEGROUP'] = 'Bench'
+    os.environ['TRACELEVEL'] = '5'
+    os.environ.pop('TRACEONLY', None)
+    os.environ.setdefault('TRACEFILE', '/dev/null')
+
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+    import Tracer
+    import TracerNative
+
+    # the pure Python class writes to sys.stderr, so point that at TRACEFILE
+    # too, keeping the real stderr for errors
+    stderr = sys.stderr
+    sys.stderr = open(os.environ['TRACEFILE'], 'a')
+
+    cases = [ ('group_filtered', GroupFiltered), ('level_filtered', LevelFiltered), ('enabled', Enabled),
+              ('exit', Exit), ('eager_args', EagerArgs), ('lazy_args', LazyArgs) ]
+
+    results = []
+    for name, run in cases:
+
+        # warm up, so that group lookups and call sites are settled
+        run(Tracer.PyTracer, 10)
+        run(TracerNative.Tracer, 10)
+
+        python = run(Tracer.PyTracer, iterations)
+        native = run(TracerNative.Tracer, iterations)
+
+        results.append({ 'case': name, 'calls': iterations,
+                         'python_ns_per_call': round(python / iterations, 2),
+                         'native_ns_per_call': round(native / iterations, 2),
+                         'speedup': round(python / native, 2) })
+
+    sys.stderr.close()
+    sys.stderr = stderr
+
+    json.dump({ 'benchmark': 'tracer-bench.py', 'iterations': iterations, 'results': results }, sys.stdout, indent=2)
+    print()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())